@@ -0,0 +1,588 @@
+/* ace_bench.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+// Benchmarks the DataBuffer commands on synthetic files of various numbers
+// of lines and line lengths. The results are written to standard output in
+// JSON format, so that results from different versions may be compared.
+// The output includes the compiler options, and given the output of another
+// build as a baseline, the speedup of each result relative to the baseline
+// and overall (geometric mean), e.g. to measure an optimised build.
+//
+// ace_bench replaces the global operator new, so that each result also
+// includes the number of heap allocations per operation. --check-allocations
+// instead runs the steady state loops in allocationBudgets, and exits with
+// status 1 if any exceeds its allocation budget.
+//
+// usage: ace_bench [--max-lines N] [--max-bytes N] [--min-time SECONDS]
+//                  [--command NAME] [--baseline FILE]
+//        ace_bench --check-allocations
+//
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "build_datetime.h"
+#include "data_buffer.h"
+#include "editor.h"
+
+//------------------------------------------------------------------------------
+// Allocation counting. Only this program is affected, not libace clients in
+// general. The array and nothrow forms use these, and free is used directly
+// by the sized delete forms.
+//
+static long long allocations = 0;
+
+void* operator new (std::size_t size)
+{
+   allocations++;
+   void* result = malloc (size > 0 ? size : 1);
+   if (!result) throw std::bad_alloc ();
+   return result;
+}
+
+void operator delete (void* ptr) noexcept
+{
+   free (ptr);
+}
+
+void operator delete (void* ptr, std::size_t) noexcept
+{
+   free (ptr);
+}
+
+//------------------------------------------------------------------------------
+// Discards the output of the print command.
+//
+class NullBuffer : public std::streambuf
+{
+protected:
+   int overflow (int c) { return c; }                               // override
+   std::streamsize xsputn (const char*, std::streamsize n) { return n; }   // override
+};
+
+//------------------------------------------------------------------------------
+// The synthetic file. Each line is filler text followed by "=end", so the
+// search commands scan most of each line before finding "=".
+//
+struct Corpus {
+   int lines;
+   int length;
+   std::string text;
+   std::string filename;   // the same text as a file, for absorbe
+};
+
+static const std::string marker = "=";
+
+//------------------------------------------------------------------------------
+//
+static void makeCorpus (Corpus& corpus)
+{
+   static const char filler [] = "abcdefghijklmnopqrstuvwxyz ";
+   const int fillLength = corpus.length > 4 ? corpus.length - 4 : 0;
+
+   std::string line;
+   for (int j = 0; j < fillLength; j++) {
+      line.push_back (filler [j % (sizeof (filler) - 1)]);
+   }
+   line.append ("=end", corpus.length - fillLength);
+   line.push_back ('\n');
+
+   corpus.text.clear ();
+   corpus.text.reserve ((size_t) corpus.lines * line.length());
+   for (int j = 0; j < corpus.lines; j++) {
+      corpus.text.append (line);
+   }
+}
+
+//------------------------------------------------------------------------------
+// Each benchmark function runs one command over the whole buffer, from the
+// start, and returns the number of operations, i.e. command executions
+// (or lines processed for commands with a repeat count). Where a command
+// applies within a line, the time includes a move to the next line.
+//
+typedef long (*BenchFunc) (DataBuffer& db, const Corpus& corpus);
+
+static long benchFind (DataBuffer& db, const Corpus& corpus)
+{
+   db.find (INT_MAX, marker, corpus.lines);
+   return corpus.lines;
+}
+
+static long benchTraverse (DataBuffer& db, const Corpus& corpus)
+{
+   db.traverse (INT_MAX, marker, corpus.lines);
+   return corpus.lines;
+}
+
+static long benchUncover (DataBuffer& db, const Corpus& corpus)
+{
+   for (int j = 0; j < corpus.lines; j++) {
+      db.uncover (INT_MAX, marker, 1);
+      db.move (1);
+   }
+   return corpus.lines;
+}
+
+static long benchDelete (DataBuffer& db, const Corpus& corpus)
+{
+   db.deleteText (INT_MAX, marker, corpus.lines);
+   return corpus.lines;
+}
+
+static long benchSubstitute (DataBuffer& db, const Corpus& corpus)
+{
+   // find then substitute
+   for (int j = 0; j < corpus.lines; j++) {
+      db.find (INT_MAX, marker, 1);
+      db.substitute ("==", 1);
+   }
+   return corpus.lines;
+}
+
+static long benchJoin (DataBuffer& db, const Corpus& corpus)
+{
+   // Join pairs of lines, as joining all the lines into one is quadratic.
+   //
+   for (int j = 0; j < corpus.lines / 2; j++) {
+      db.join (1);
+      db.move (1);
+   }
+   return corpus.lines / 2;
+}
+
+static long benchKill (DataBuffer& db, const Corpus& corpus)
+{
+   db.kill (corpus.lines);
+   return corpus.lines;
+}
+
+static long benchBreak (DataBuffer& db, const Corpus& corpus)
+{
+   // Break each line in the middle.
+   //
+   for (int j = 0; j < corpus.lines; j++) {
+      db.right (corpus.length / 2);
+      db.breakLine (1);
+      db.move (1);
+   }
+   return corpus.lines;
+}
+
+static long benchMove (DataBuffer& db, const Corpus& corpus)
+{
+   db.move (corpus.lines);
+   return corpus.lines;
+}
+
+static long benchPrint (DataBuffer& db, const Corpus& corpus)
+{
+   NullBuffer null;
+   std::streambuf* saved = std::cerr.rdbuf (&null);
+   db.print (corpus.lines);
+   std::cerr.rdbuf (saved);
+   return corpus.lines;
+}
+
+static long benchWrite (DataBuffer& db, const Corpus& corpus)
+{
+   db.output ("/dev/null");
+   db.write (corpus.lines);
+   db.output ("");   // flush
+   return corpus.lines;
+}
+
+static long benchAbsorbe (DataBuffer& db, const Corpus& corpus)
+{
+   db.connect (corpus.filename);
+   db.absorbe (corpus.lines);
+   db.connect ("");
+   return corpus.lines;
+}
+
+struct Benchmark {
+   const char* name;
+   BenchFunc func;
+};
+
+static const Benchmark benchmarks [] = {
+   { "find",       benchFind       },
+   { "traverse",   benchTraverse   },
+   { "uncover",    benchUncover    },
+   { "delete",     benchDelete     },
+   { "substitute", benchSubstitute },
+   { "join",       benchJoin       },
+   { "kill",       benchKill       },
+   { "break",      benchBreak      },
+   { "move",       benchMove       },
+   { "print",      benchPrint      },
+   { "write",      benchWrite      },
+   { "absorbe",    benchAbsorbe    }
+};
+
+//------------------------------------------------------------------------------
+// Baseline results, ns per op keyed by command/lines/line length, and the
+// accumulated log of the speedups for the geometric mean.
+//
+struct Baseline {
+   std::map<std::string, double> nsPerOp;
+   std::string options;
+   double logSpeedups;
+   int compared;
+};
+
+//------------------------------------------------------------------------------
+//
+static std::string resultKey (const std::string& command, const int lines,
+                              const int length)
+{
+   return command + "/" + std::to_string (lines) + "/" + std::to_string (length);
+}
+
+//------------------------------------------------------------------------------
+// Reads the results from a previous ace_bench output, which has one result
+// per line. Returns false if the file cannot be read.
+//
+static bool readBaseline (const std::string& filename, Baseline& baseline)
+{
+   std::ifstream file (filename.c_str ());
+   if (!file.is_open ()) return false;
+
+   static const std::string optionsTag = "\"options\": \"";
+   static const std::string nsTag = "\"ns_per_op\": ";
+
+   std::string line;
+   while (std::getline (file, line)) {
+      const size_t options = line.find (optionsTag);
+      if (options != std::string::npos) {
+         const size_t start = options + optionsTag.length ();
+         baseline.options = line.substr (start, line.find ('"', start) - start);
+         continue;
+      }
+
+      const size_t brace = line.find ('{');
+      const size_t ns = line.find (nsTag);
+      if ((brace == std::string::npos) || (ns == std::string::npos)) continue;
+
+      char command [32];
+      int lines;
+      int length;
+      if (sscanf (line.c_str () + brace,
+                  "{\"command\": \"%31[^\"]\", \"lines\": %d, \"line_length\": %d,",
+                  command, &lines, &length) == 3)
+      {
+         baseline.nsPerOp [resultKey (command, lines, length)] =
+            atof (line.c_str () + ns + nsTag.length ());
+      }
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Runs the benchmark repeatedly, on a freshly loaded buffer each time, until
+// at least minTime seconds have been measured. Only the command is timed.
+//
+static void run (const Benchmark& benchmark, const Corpus& corpus,
+                 const double minTime, const bool first, Baseline& baseline)
+{
+   typedef std::chrono::steady_clock Clock;
+
+   double seconds = 0.0;
+   long ops = 0;
+   long long allocated = 0;
+   int runs = 0;
+
+   while ((runs == 0) || (seconds < minTime)) {
+      DataBuffer db;
+      db.loadText (corpus.text.data(), corpus.text.length());
+
+      const long long before = allocations;
+      const Clock::time_point start = Clock::now ();
+      ops += benchmark.func (db, corpus);
+      const Clock::time_point finish = Clock::now ();
+      allocated += allocations - before;
+
+      seconds += std::chrono::duration<double> (finish - start).count ();
+      runs++;
+   }
+
+   const double opsPerSec = seconds > 0.0 ? ops / seconds : 0.0;
+   const double nsPerOp = ops > 0 ? 1.0e9 * seconds / ops : 0.0;
+   const double allocsPerOp = ops > 0 ? double (allocated) / ops : 0.0;
+
+   char item [512];
+   snprintf (item, sizeof (item),
+             "%s    {\"command\": \"%s\", \"lines\": %d, \"line_length\": %d, "
+             "\"runs\": %d, \"ops\": %ld, \"seconds\": %.6f, "
+             "\"ops_per_sec\": %.1f, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f",
+             first ? "" : ",\n", benchmark.name, corpus.lines, corpus.length,
+             runs, ops, seconds, opsPerSec, nsPerOp, allocsPerOp);
+   std::cout << item;
+
+   std::map<std::string, double>::const_iterator found =
+      baseline.nsPerOp.find (resultKey (benchmark.name, corpus.lines, corpus.length));
+   if ((found != baseline.nsPerOp.end ()) && (found->second > 0.0) && (nsPerOp > 0.0)) {
+      const double speedup = found->second / nsPerOp;
+      baseline.logSpeedups += log (speedup);
+      baseline.compared++;
+
+      snprintf (item, sizeof (item),
+                ", \"baseline_ns_per_op\": %.2f, \"speedup\": %.3f",
+                found->second, speedup);
+      std::cout << item;
+   }
+
+   std::cout << "}" << std::flush;
+}
+
+//------------------------------------------------------------------------------
+// Allocation budgets, i.e. the maximum number of heap allocations per loop
+// iteration once in the steady state, for loops that should not allocate.
+// Each loop is run over a freshly loaded buffer once to warm up (last search
+// text etc.), and then counted on a second freshly loaded buffer.
+// The buffer loading is not counted.
+//
+struct Budget {
+   const char* name;
+   const char* commandLine;
+   double perIteration;
+};
+
+static const Budget allocationBudgets [] = {
+   { "move",         "(m)*",                   0.0 },
+   { "verify",       "(v/abc/ m)*",            0.0 },
+   { "verify_miss",  "(v/x/? m)*",             0.0 },
+   { "find_hit",     "(f/=/ m)*",              0.0 },
+   { "print",        "(p m)*",                 0.0 },
+   { "rewrite",      "(f/=/ s/:/ m)*",         0.0 },
+   { "rewrite_back", "(t/=/ s-/:/ m)*",        0.0 },
+   { "delete",       "(d/=/ m)*",              0.0 },
+   { "uncover",      "(u/=/ m)*",              0.0 },
+   { "quary",        "(q20 m)*",               0.0 },
+
+   // Each line grows beyond its capacity once - the line's own allocation.
+   //
+   { "insert",       "(f/=/ i/key/ i/=/ m)*",  1.0 }
+};
+
+//------------------------------------------------------------------------------
+// Returns the number of allocations made running the command line, or -1 if
+// the command line is invalid.
+//
+static long long countAllocations (const std::string& commandLine,
+                                   const std::string& text)
+{
+   Editor editor;
+   CompoundCommands* commands = editor.compile (commandLine);
+   if (!commands) return -1;
+
+   editor.load (text);
+   editor.run (*commands);
+
+   editor.load (text);
+   const long long before = allocations;
+   editor.run (*commands);
+   const long long result = allocations - before;
+
+   delete commands;
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Print output goes to /dev/null, as opposed to being discarded, so that any
+// allocation by the stream itself is included.
+//
+static int checkAllocations ()
+{
+   Corpus corpus;
+   corpus.lines = 10000;
+   corpus.length = 80;
+   makeCorpus (corpus);
+
+   std::ofstream devNull ("/dev/null");
+   std::streambuf* saved = std::cerr.rdbuf (devNull.rdbuf ());
+
+   std::ostringstream stream;
+   int failures = 0;
+   const size_t number = sizeof (allocationBudgets) / sizeof (allocationBudgets [0]);
+   for (size_t j = 0; j < number; j++) {
+      const Budget& budget = allocationBudgets [j];
+      const long long count = countAllocations (budget.commandLine, corpus.text);
+      const double perIteration = double (count) / corpus.lines;
+      const bool ok = (count >= 0) && (perIteration <= budget.perIteration);
+      if (!ok) failures++;
+
+      char item [256];
+      snprintf (item, sizeof (item),
+                "    {\"loop\": \"%s\", \"command\": \"%s\", \"iterations\": %d, "
+                "\"allocations\": %lld, \"budget_per_iteration\": %.3f, \"ok\": %s}%s\n",
+                budget.name, budget.commandLine, corpus.lines, count,
+                budget.perIteration, ok ? "true" : "false",
+                j + 1 < number ? "," : "");
+      stream << item;
+   }
+
+   std::cerr.rdbuf (saved);
+
+   std::cout << "{\n"
+             << "  \"benchmark\": \"ace_bench\",\n"
+             << "  \"build\": \"" << build_datetime () << "\",\n"
+             << "  \"options\": \"" << build_options () << "\",\n"
+             << "  \"allocation_budgets\": [\n"
+             << stream.str ()
+             << "  ],\n"
+             << "  \"failures\": " << failures << "\n"
+             << "}" << std::endl;
+
+   return failures > 0 ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+//
+static void usage ()
+{
+   std::cerr << "usage: ace_bench [--max-lines N] [--max-bytes N] "
+                "[--min-time SECONDS] [--command NAME] [--baseline FILE]\n"
+                "       ace_bench --check-allocations" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+int main (int argc, char** argv)
+{
+   long maxLines = 1000000;
+   long maxBytes = 256L * 1024 * 1024;
+   double minTime = 0.2;
+   std::string only;
+   std::string baselineFile;
+
+   for (int j = 1; j < argc; j++) {
+      const std::string p1 = argv [j];
+      if (p1 == "--check-allocations") {
+         return checkAllocations ();
+      }
+
+      if (j + 1 >= argc) {
+         usage ();
+         return 1;
+      }
+      const char* value = argv [++j];
+
+      if (p1 == "--max-lines") {
+         maxLines = atol (value);
+      } else if (p1 == "--max-bytes") {
+         maxBytes = atol (value);
+      } else if (p1 == "--min-time") {
+         minTime = atof (value);
+      } else if (p1 == "--command") {
+         only = value;
+      } else if (p1 == "--baseline") {
+         baselineFile = value;
+      } else {
+         usage ();
+         return 1;
+      }
+   }
+
+   if ((maxLines < 1) || (maxLines > INT_MAX)) {
+      std::cerr << "invalid --max-lines value" << std::endl;
+      return 1;
+   }
+
+   Baseline baseline;
+   baseline.logSpeedups = 0.0;
+   baseline.compared = 0;
+   if (!baselineFile.empty () && !readBaseline (baselineFile, baseline)) {
+      std::cerr << "ace_bench: cannot read baseline " << baselineFile << std::endl;
+      return 4;
+   }
+
+   static const int lineCounts [] = { 1000, 10000, 100000, 1000000,
+                                      10000000, 100000000 };
+   static const int lineLengths [] = { 8, 80, 800 };
+
+   char tempName [] = "/tmp/ace_bench_XXXXXX";
+   const int tempFd = mkstemp (tempName);
+   if (tempFd < 0) {
+      perror ("ace_bench: mkstemp");
+      return 4;
+   }
+   close (tempFd);
+
+   std::cout << "{\n"
+             << "  \"benchmark\": \"ace_bench\",\n"
+             << "  \"build\": \"" << build_datetime () << "\",\n"
+             << "  \"options\": \"" << build_options () << "\",\n"
+             << "  \"min_time\": " << minTime << ",\n"
+             << "  \"results\": [\n";
+
+   bool first = true;
+   for (size_t n = 0; n < sizeof (lineCounts) / sizeof (lineCounts [0]); n++) {
+      for (size_t k = 0; k < sizeof (lineLengths) / sizeof (lineLengths [0]); k++) {
+         Corpus corpus;
+         corpus.lines = lineCounts [n];
+         corpus.length = lineLengths [k];
+         corpus.filename = tempName;
+
+         if (corpus.lines > maxLines) continue;
+         if ((long) corpus.lines * (corpus.length + 1) > maxBytes) continue;
+
+         makeCorpus (corpus);
+
+         FILE* file = fopen (tempName, "w");
+         if (!file || (fwrite (corpus.text.data(), 1, corpus.text.length(), file)
+                       != corpus.text.length())) {
+            perror ("ace_bench: write");
+            if (file) fclose (file);
+            unlink (tempName);
+            return 4;
+         }
+         fclose (file);
+
+         for (size_t b = 0; b < sizeof (benchmarks) / sizeof (benchmarks [0]); b++) {
+            if (!only.empty() && (only != benchmarks [b].name)) continue;
+            run (benchmarks [b], corpus, minTime, first, baseline);
+            first = false;
+         }
+      }
+   }
+
+   std::cout << "\n  ]";
+
+   if (!baselineFile.empty ()) {
+      const double geomean = baseline.compared > 0 ?
+                             exp (baseline.logSpeedups / baseline.compared) : 0.0;
+      char item [80];
+      snprintf (item, sizeof (item), "%.3f", geomean);
+      std::cout << ",\n  \"baseline\": \"" << baselineFile << "\",\n"
+                << "  \"baseline_options\": \"" << baseline.options << "\",\n"
+                << "  \"compared\": " << baseline.compared << ",\n"
+                << "  \"speedup_geomean\": " << item;
+   }
+
+   std::cout << "\n}" << std::endl;
+
+   unlink (tempName);
+   return 0;
+}
+
+// end
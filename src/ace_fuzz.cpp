@@ -0,0 +1,1690 @@
+/* ace_fuzz.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+// Fuzz and differential test harness for the command parser and the editing
+// engine. Each input is a command line followed by the text to be edited,
+// i.e. the first line of the input is the command line and any remaining
+// lines are the buffer contents.
+//
+// The command line is parsed, and then run several times, by two editors:
+// the reference, with optimisation off (as per -N, i.e. no command fusion),
+// and the optimised. The parse and command status, failed
+// command image, buffer contents, cursor line and column, and any close or
+// abandon request must match. The cursor line number must also match a walk
+// of the buffer. Command lines that access files, the command input or the
+// clock are skipped, as are those with large repeat counts or deeply nested
+// compound commands.
+//
+// As the reference is the same engine, the DataBuffer operations are also
+// checked directly against a simple model of the buffer (--model), see Model.
+// With --model, each input is instead a string of encoded operations followed
+// by the text to be edited, and the line readers are also checked.
+//
+// Built with libFuzzer (make fuzz FUZZER=1), this provides the libFuzzer
+// entry point, which checks each input both ways, and a mismatch aborts.
+// Otherwise this is a standalone program that checks the given input files,
+// or by default random inputs, and stops at the first mismatch, outputting
+// the input as a reproducer. --fusion instead checks a fixed set of inputs,
+// one per fusible command (and each command that must not be fused) for
+// several forms and cursor positions. make check runs the fusion cases and
+// both random checks with fixed seeds.
+//
+// usage: ace_fuzz [--model] [--runs N] [--seed N] [FILE...]
+//        ace_fuzz --fusion
+//
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <climits>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "editor.h"
+#include "global.h"
+
+//------------------------------------------------------------------------------
+// Discards the output of the print, view etc. commands.
+//
+class NullBuffer : public std::streambuf
+{
+protected:
+   int overflow (int c) { return c; }                               // override
+   std::streamsize xsputn (const char*, std::streamsize n) { return n; }   // override
+};
+
+// Number of times the command line is run, so that state carried over from
+// one run to the next (last search text etc.) is also exercised.
+//
+static const int runsPerInput = 4;
+
+// Number of inputs parsed and run, as opposed to rejected or skipped.
+//
+static long inputsRun = 0;
+
+// Limits * loops that make progress forever, e.g. (i/a/)*.
+//
+static const int repeatLimit = 20;
+
+//------------------------------------------------------------------------------
+// The outcome of one run of the command line.
+//
+struct Outcome {
+   bool status;
+   std::string failure;
+   std::string text;
+   int line;
+   int col;
+   bool closed;
+   bool abandoned;
+   int exitCode;
+};
+
+//------------------------------------------------------------------------------
+//
+static std::string getLine (const char*)
+{
+   return "m";
+}
+
+//------------------------------------------------------------------------------
+// The current line number found the slow way, for comparison with the
+// buffer's own (incremental) line number.
+//
+static int walkedLineNo (DataBuffer& db)
+{
+   const DataBuffer::Position position = db.getPosition ();
+   const DataBuffer::StringList& lines = db.getLines ();
+
+   int result = 1;
+   for (DataBuffer::StringList::const_iterator it = lines.begin ();
+        it != lines.end (); ++it, ++result)
+   {
+      if (&(*it) == position.line) break;
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+static void setUp (Editor& editor, const bool optimise)
+{
+   Session& session = editor.getSession ();
+   session.setOptimize (optimise);
+   session.setRepeatMax (repeatLimit);
+   session.setGetLineFunction (&getLine);
+}
+
+//------------------------------------------------------------------------------
+// Runs the commands and returns the outcome. Returns false, with a reason,
+// if the buffer's line number is wrong.
+//
+static bool runOnce (Editor& editor, const CompoundCommands& commands,
+                     Outcome& outcome, std::string& reason)
+{
+   outcome.status = editor.run (commands);
+   outcome.failure = outcome.status ? "" : editor.getFailure ();
+   editor.save (outcome.text);
+
+   DataBuffer& db = editor.getBuffer ();
+   outcome.line = db.currentLineNo ();
+   outcome.col = db.getPosition ().col;
+
+   const Session& session = editor.getSession ();
+   outcome.closed = session.getCloseRequested ();
+   outcome.abandoned = session.getAbandonRequested ();
+   outcome.exitCode = session.getExitCode ();
+
+   const int walked = walkedLineNo (db);
+   if (outcome.line != walked) {
+      reason = "line number " + std::to_string (outcome.line) +
+               ", walked " + std::to_string (walked);
+      return false;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+static void describe (const char* title, const Outcome& outcome,
+                      std::ostream& stream)
+{
+   stream << title << ": status " << outcome.status
+          << " failure '" << outcome.failure << "'"
+          << " cursor " << outcome.line << ":" << outcome.col
+          << " closed " << outcome.closed << " abandoned " << outcome.abandoned
+          << " exit code " << outcome.exitCode << std::endl
+          << outcome.text;
+}
+
+//------------------------------------------------------------------------------
+//
+static bool operator== (const Outcome& a, const Outcome& b)
+{
+   return (a.status == b.status) && (a.failure == b.failure) &&
+          (a.text == b.text) && (a.line == b.line) && (a.col == b.col) &&
+          (a.closed == b.closed) && (a.abandoned == b.abandoned) &&
+          (a.exitCode == b.exitCode);
+}
+
+//------------------------------------------------------------------------------
+// Command lines with repeat counts of four or more digits, or nested more than
+// three deep, could take a very long time or use a lot of memory. This is only
+// approximate, as quoted text is not allowed for.
+//
+static bool isTooCostly (const std::string& commandLine)
+{
+   int digits = 0;
+   int depth = 0;
+   for (size_t j = 0; j < commandLine.length (); j++) {
+      const char c = commandLine [j];
+      if (isdigit ((unsigned char) c)) {
+         if (++digits >= 4) return true;
+      } else {
+         digits = 0;
+      }
+      if ((c == '(') && (++depth > 3)) return true;
+      if (c == ')') depth--;
+   }
+   return false;
+}
+
+//------------------------------------------------------------------------------
+// Checks the one input. Returns false on a mismatch, with a report.
+//
+static bool check (const std::string& input, std::string& report)
+{
+   const size_t eol = input.find ('\n');
+   const std::string commandLine = input.substr (0, eol);
+   const std::string text = (eol == std::string::npos) ? "" : input.substr (eol + 1);
+
+   if (isTooCostly (commandLine)) return true;
+
+   // Parse and run quietly.
+   //
+   NullBuffer nullBuffer;
+   std::streambuf* savedErr = std::cerr.rdbuf (&nullBuffer);
+   std::streambuf* savedOut = std::cout.rdbuf (&nullBuffer);
+
+   Editor reference;
+   Editor optimised;
+   setUp (reference, false);
+   setUp (optimised, true);
+
+   std::ostringstream stream;
+   bool result = true;
+
+   CompoundCommands* referenceCommands = reference.compile (commandLine);
+   CompoundCommands* optimisedCommands = optimised.compile (commandLine);
+
+   if ((referenceCommands == nullptr) != (optimisedCommands == nullptr)) {
+      stream << "parse mismatch: reference " << (referenceCommands != nullptr)
+             << " optimised " << (optimisedCommands != nullptr) << std::endl;
+      result = false;
+
+   } else if (referenceCommands && !referenceCommands->isExternal ()) {
+      inputsRun++;
+      reference.load (text);
+      optimised.load (text);
+
+      for (int r = 0; r < runsPerInput; r++) {
+         Outcome expected;
+         Outcome actual;
+         std::string reason;
+
+         if (!runOnce (reference, *referenceCommands, expected, reason)) {
+            stream << "run " << r << ": reference " << reason << std::endl;
+            result = false;
+            break;
+         }
+
+         if (!runOnce (optimised, *optimisedCommands, actual, reason)) {
+            stream << "run " << r << ": optimised " << reason << std::endl;
+            result = false;
+            break;
+         }
+
+         if (!(expected == actual)) {
+            stream << "run " << r << ": outcome mismatch" << std::endl;
+            describe ("reference", expected, stream);
+            describe ("optimised", actual, stream);
+            result = false;
+            break;
+         }
+
+         if (expected.closed || expected.abandoned) break;
+      }
+   }
+
+   delete referenceCommands;
+   delete optimisedCommands;
+
+   std::cerr.rdbuf (savedErr);
+   std::cout.rdbuf (savedOut);
+
+   report = stream.str ();
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// A simple model of the buffer, against which the DataBuffer operations are
+// checked directly, i.e. without the parser. The lines are held in a vector
+// and the cursor is a line index and column, and each operation is written
+// as plainly as possible, as per the original (unoptimised) implementation.
+// The corner cases, e.g. an uncover back from the end of the buffer, are
+// modelled as is. The buffer's contents, cursor line and column, changed flag
+// and result must match the model after every operation, as must the line
+// number, the last quary text and any printed output.
+//
+class Model
+{
+public:
+   enum Direction {
+      Forward,
+      Reverse
+   };
+
+   explicit Model ();
+   ~Model ();
+
+   std::vector<std::string> lines;
+   int line;         // 0 .. lines.size(), i.e. the end
+   int col;
+   bool changed;
+   std::string lastModify;
+
+   void loadText (const std::string& text);
+
+   bool find (const int limit, const std::string& text, const int number);
+   bool findBack (const int limit, const std::string& text, const int number);
+   bool traverse (const int limit, const std::string& text, const int number);
+   bool traverseBack (const int limit, const std::string& text, const int number);
+   bool uncover (const int limit, const std::string& text, const int number);
+   bool uncoverBack (const int limit, const std::string& text, const int number);
+   bool deleteText (const int limit, const std::string& text, const int number);
+   bool deleteBack (const int limit, const std::string& text, const int number);
+   bool verify (const std::string& text);
+   bool verifyBack (const std::string& text);
+   bool substitute (const Direction direction, const std::string& text, const int number);
+   bool insert (const Direction direction, const std::string& text, const int number);
+   bool erase (const int number);
+   bool eraseBack (const int number);
+   bool changeCase (const bool upper, const int number);
+   bool breakLine (const Direction direction, const int number);
+   bool join (const int number);
+   bool joinBack (const int number);
+   bool kill (const int number);
+   bool killBack (const int number);
+   bool left (const int number);
+   bool right (const int number);
+   bool move (const int number);
+   bool moveBack (const int number);
+   bool quary (const int number);
+   bool quaryBack (const int number);
+   bool get (const Direction direction, const int number);
+   bool print (const Direction direction, const int number, const bool showLineNumbers,
+               const int terminalMax, std::ostream& stream);
+
+private:
+   // Don't allow copying.
+   //
+   explicit Model (const Model&);
+   Model& operator= (const Model&);
+
+   enum SearchType {
+      stVoid,
+      stFind,
+      stTraverse,
+      stUncover,
+      stVerify,
+      stFindBack,
+      stTraverseBack,
+      stUncoverBack,
+      stVerifyBack
+   };
+
+   bool atEnd () const;
+   const std::string& currentLine () const;
+   void setChanged ();
+   bool locate (const int limit, const std::string& text, const int skip);
+   bool locateBack (const int limit, const std::string& text, const int skip);
+
+   SearchType lastSearchType;
+   std::string lastSearchText;
+};
+
+//------------------------------------------------------------------------------
+//
+Model::Model () : line (0), col (0), changed (false), lastSearchType (stVoid) { }
+
+//------------------------------------------------------------------------------
+//
+Model::~Model () { }
+
+//------------------------------------------------------------------------------
+// Splits the text as DataBuffer::loadText and LineReader do, i.e. a last line
+// with a missing new line is a complete line.
+//
+static void splitText (const std::string& text, std::vector<std::string>& lines)
+{
+   lines.clear ();
+   std::string::size_type start = 0;
+   while (start < text.length ()) {
+      std::string::size_type end = text.find ('\n', start);
+      if (end == std::string::npos) end = text.length ();
+      lines.push_back (text.substr (start, end - start));
+      start = end + 1;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void Model::loadText (const std::string& text)
+{
+   splitText (text, this->lines);
+   this->line = 0;
+   this->col = 0;
+}
+
+//------------------------------------------------------------------------------
+// private
+bool Model::atEnd () const
+{
+   return this->line >= int (this->lines.size ());
+}
+
+//------------------------------------------------------------------------------
+// private
+const std::string& Model::currentLine () const
+{
+   static const std::string empty;
+   return this->atEnd () ? empty : this->lines [this->line];
+}
+
+//------------------------------------------------------------------------------
+// private - as DataBuffer, any change also forgets the last search.
+void Model::setChanged ()
+{
+   this->changed = true;
+   this->lastSearchType = stVoid;
+   this->lastSearchText = "";
+}
+
+//------------------------------------------------------------------------------
+// private
+bool Model::locate (const int limit, const std::string& text, const int skip)
+{
+   if (this->atEnd ()) return false;
+
+   std::string::size_type pos = this->lines [this->line].find (text, this->col + skip);
+   for (int count = 1; (pos == std::string::npos) && (count < limit); count++) {
+      this->line++;
+      this->col = 0;
+      this->setChanged ();
+      if (this->atEnd ()) return false;
+      pos = this->lines [this->line].find (text, 0);
+   }
+
+   if (pos == std::string::npos) return false;
+   if (this->col != int (pos)) {
+      this->col = pos;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// private
+bool Model::locateBack (const int limit, const std::string& text, const int skip)
+{
+   const int length = text.length ();
+
+   int from = this->col - length - skip;
+   std::string::size_type pos = (from >= 0) ? this->currentLine ().rfind (text, from)
+                                            : std::string::npos;
+
+   for (int count = 1; (pos == std::string::npos) && (count < limit); count++) {
+      if (this->line == 0) return false;
+      this->line--;
+      this->col = this->lines [this->line].length ();
+      this->setChanged ();
+
+      from = this->col - length;
+      pos = (from >= 0) ? this->lines [this->line].rfind (text, from) : std::string::npos;
+   }
+
+   if (pos == std::string::npos) return false;
+   if (this->col != int (pos)) {
+      this->col = pos;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::find (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stFind) && (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      if (!this->locate (limit, text, skip)) return false;
+      this->lastSearchType = stFind;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::findBack (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stFindBack) && (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      if (!this->locateBack (limit, text, skip)) return false;
+      this->lastSearchType = stFindBack;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::traverse (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stTraverse) && (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      if (!this->locate (limit, text, skip)) return false;
+      this->col += text.length ();
+      this->setChanged ();
+      this->lastSearchType = stTraverse;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Note: unlike traverse, the move past the text does not count as a change.
+//
+bool Model::traverseBack (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stTraverseBack) &&
+               (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      if (!this->locateBack (limit, text, skip)) return false;
+      this->col += text.length ();
+      this->lastSearchType = stTraverseBack;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::uncover (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stUncover) && (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      const int wasLine = this->line;
+      const int wasCol = this->col;
+
+      if (!this->locate (limit, text, skip)) return false;
+
+      // Remove everything from where we were up to the text.
+      //
+      const std::string part1 = this->lines [wasLine].substr (0, wasCol);
+      const std::string part2 = this->lines [this->line].substr (this->col);
+      this->lines.erase (this->lines.begin () + wasLine, this->lines.begin () + this->line);
+      this->line = wasLine;
+      this->lines [this->line] = part1 + part2;
+      this->col = wasCol;
+      this->setChanged ();
+
+      this->lastSearchType = stUncover;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Note: when uncovering back from the end, the line holding the text is also
+// removed, and the column is left as is.
+//
+bool Model::uncoverBack (const int limit, const std::string& text, const int number)
+{
+   int skip = ((this->lastSearchType == stUncoverBack) &&
+               (this->lastSearchText == text)) ? 1 : 0;
+   for (int j = 0; j < number; j++) {
+      const int wasLine = this->line;
+      const int wasCol = this->col;
+
+      if (!this->locateBack (limit, text, skip)) return false;
+      this->col += text.length ();
+
+      // Remove everything from after the text up to where we were. The text
+      // may be "found" at the end itself, e.g. an empty text, if the column
+      // was left as is by an earlier uncover back from the end.
+      //
+      if (!this->atEnd ()) {
+         const std::string part1 = this->lines [this->line].substr (0, this->col);
+         const std::string part2 = (wasLine < int (this->lines.size ())) ?
+                                   this->lines [wasLine].substr (wasCol) : "";
+         this->lines.erase (this->lines.begin () + this->line, this->lines.begin () + wasLine);
+         if (!this->atEnd ()) this->lines [this->line] = part1 + part2;
+      }
+      this->setChanged ();
+
+      this->lastSearchType = stUncoverBack;
+      this->lastSearchText = text;
+      skip = 1;
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::deleteText (const int limit, const std::string& text, const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (!this->locate (limit, text, 0)) return false;
+      if (!text.empty ()) this->lines [this->line].erase (this->col, text.length ());
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::deleteBack (const int limit, const std::string& text, const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (!this->locateBack (limit, text, 0)) return false;
+      if (!text.empty ()) this->lines [this->line].erase (this->col, text.length ());
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::verify (const std::string& text)
+{
+   if (this->atEnd ()) return false;
+
+   const std::string& current = this->lines [this->line];
+   if (int (text.length ()) > int (current.length ()) - this->col) return false;
+   if (current.substr (this->col, text.length ()) != text) return false;
+
+   this->lastSearchType = stVerify;
+   this->lastSearchText = text;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::verifyBack (const std::string& text)
+{
+   if (this->atEnd ()) return false;
+
+   const std::string& current = this->lines [this->line];
+   if (int (text.length ()) > this->col) return false;
+   if (current.substr (this->col - text.length (), text.length ()) != text) return false;
+
+   this->lastSearchType = stVerifyBack;
+   this->lastSearchText = text;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::substitute (const Direction direction, const std::string& text,
+                        const int number)
+{
+   if (this->atEnd ()) return false;
+   if (this->lastSearchType == stVoid) return false;
+
+   const int replaceLength = this->lastSearchText.length ();
+
+   // The last search text is to the left of the cursor after these.
+   //
+   if ((this->lastSearchType == stTraverse) || (this->lastSearchType == stTraverseBack) ||
+       (this->lastSearchType == stUncoverBack) || (this->lastSearchType == stVerifyBack))
+   {
+      this->col = std::max (0, this->col - replaceLength);
+   }
+
+   std::string replacement;
+   for (int j = 0; j < number; j++) {
+      replacement += text;
+   }
+
+   std::string& current = this->lines [this->line];
+   const int from = std::min (int (current.length ()), this->col + replaceLength);
+   current = current.substr (0, this->col) + replacement + current.substr (from);
+   if (direction == Forward) {
+      this->col += replacement.length ();
+   }
+   this->setChanged ();
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Note: inserting nothing is not a change.
+//
+bool Model::insert (const Direction direction, const std::string& text, const int number)
+{
+   if (this->atEnd ()) return false;
+   if (text.empty ()) return true;
+
+   for (int j = 0; j < number; j++) {
+      this->lines [this->line].insert (this->col, text);
+      if (direction == Forward) {
+         this->col += text.length ();
+      }
+   }
+   this->setChanged ();
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::erase (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   std::string& current = this->lines [this->line];
+   const int size = std::min (number, int (current.length ()) - this->col);
+   if (size > 0) current.erase (this->col, size);
+   this->setChanged ();
+   return size == number;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::eraseBack (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   const int size = std::min (number, this->col);
+   this->col -= size;
+   this->lines [this->line].erase (this->col, size);
+   this->setChanged ();
+   return size == number;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::changeCase (const bool upper, const int number)
+{
+   if (this->atEnd ()) return false;
+
+   std::string& current = this->lines [this->line];
+   const int length = current.length ();
+   const int size = std::min (number, length - this->col);
+   for (int j = this->col; j < this->col + size; j++) {
+      current [j] = upper ? toupper (current [j]) : tolower (current [j]);
+   }
+   const bool result = (this->col + number <= length);
+   this->col += size;
+   this->setChanged ();
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Note: breaking the end appends empty lines, i.e. even when a break back
+// has moved the cursor off the end, and is not a change.
+//
+bool Model::breakLine (const Direction direction, const int number)
+{
+   const bool breakEnd = this->atEnd ();
+
+   for (int j = 0; j < number; j++) {
+      if (breakEnd) {
+         this->lines.push_back ("");
+         this->line = this->lines.size () - ((direction == Forward) ? 0 : 1);
+         this->col = 0;
+         continue;
+      }
+
+      const std::string part2 = this->lines [this->line].substr (this->col);
+      this->lines [this->line].erase (this->col);
+      this->lines.insert (this->lines.begin () + this->line + 1, part2);
+      if (direction == Forward) {
+         this->line++;
+         this->col = 0;
+      }
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::join (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (this->line + 1 >= int (this->lines.size ())) return false;
+
+      this->col = this->lines [this->line].length ();
+      this->lines [this->line] += this->lines [this->line + 1];
+      this->lines.erase (this->lines.begin () + this->line + 1);
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::joinBack (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if ((this->line == 0) || this->atEnd ()) return false;
+
+      this->line--;
+      this->col = this->lines [this->line].length ();
+      this->lines [this->line] += this->lines [this->line + 1];
+      this->lines.erase (this->lines.begin () + this->line + 1);
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::kill (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (this->atEnd ()) return false;
+      this->lines.erase (this->lines.begin () + this->line);
+      this->col = 0;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Note: removing the previous line is not itself a change.
+//
+bool Model::killBack (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (this->col != 0) {
+         this->col = 0;
+         this->setChanged ();
+      }
+      if (this->line == 0) return false;
+      this->line--;
+      this->lines.erase (this->lines.begin () + this->line);
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::left (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   const int delta = std::min (number, this->col);
+   this->col -= delta;
+   if (delta) this->setChanged ();
+   return delta == number;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::right (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   const int delta = std::min (number, int (this->lines [this->line].length ()) - this->col);
+   this->col += delta;
+   if (delta) this->setChanged ();
+   return delta == number;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::move (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (this->atEnd ()) return false;
+      this->line++;
+      this->col = 0;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::moveBack (const int number)
+{
+   for (int j = 0; j < number; j++) {
+      if (this->col != 0) {
+         this->col = 0;
+         this->setChanged ();
+      }
+      if (this->line == 0) return false;
+      this->line--;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::quary (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   const std::string& current = this->lines [this->line];
+   this->lastModify = current.substr (this->col, number);
+   return this->col + number <= int (current.length ());
+}
+
+//------------------------------------------------------------------------------
+//
+bool Model::quaryBack (const int number)
+{
+   if (this->atEnd ()) return false;
+
+   const int size = std::min (number, this->col);
+   this->lastModify = this->lines [this->line].substr (this->col - size, size);
+   return this->col >= number;
+}
+
+//------------------------------------------------------------------------------
+// The line got is always "m" - see getLine.
+//
+bool Model::get (const Direction direction, const int number)
+{
+   for (int j = 0; j < number; j++) {
+      this->lines.insert (this->lines.begin () + this->line, "m");
+      if (direction == Forward) {
+         this->line++;
+      }
+      this->col = 0;
+      this->setChanged ();
+   }
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// As put_text, but building a new string.
+//
+static std::string displayable (const std::string& text)
+{
+   static const char hex [17] = "0123456789abcdef";
+
+   std::string result;
+   for (size_t j = 0; j < text.length (); j++) {
+      const unsigned char c = text [j];
+      std::string special;
+      switch (c) {
+         case '\0': special = "\\0"; break;
+         case '\t': special = "\\t"; break;
+         case '\n': special = "\\n"; break;
+         case '\r': special = "\\r"; break;
+         default:
+            if ((c >= 0x20) && (c < 0x7f)) {
+               result += char (c);
+               continue;
+            }
+            special = std::string ("\\x") + hex [c / 16] + hex [c % 16];
+            break;
+      }
+      result += "\033[36;1m" + special + "\033[00m";
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// The cursor mark is the default ^.
+//
+bool Model::print (const Direction direction, const int number, const bool showLineNumbers,
+                   const int terminalMax, std::ostream& stream)
+{
+   const int size = this->lines.size ();
+   const int width = (size < 1000) ? 3 : (size < 10000) ? 4 : (size < 100000) ? 5 : 6;
+   const std::string eol = showLineNumbers ? "\033[34;1m.\033[00m" : "";
+
+   int lineNo = this->line + 1;
+   for (int j = 0; j < number; j++) {
+      if (j >= 1) {
+         const bool moved = (direction == Forward) ? this->move (1) : this->moveBack (1);
+         if (!moved) return false;
+         lineNo += (direction == Forward) ? 1 : -1;
+      }
+
+      std::string prefix;
+      int prefixLength = 0;
+      if (showLineNumbers) {
+         char lnb [16];
+         snprintf (lnb, sizeof (lnb), "%*d ", width, lineNo);
+         prefix = "\033[33;1m" + std::string (lnb) + "\033[00m";
+         prefixLength = strlen (lnb);
+      }
+
+      if (this->atEnd ()) {
+         stream << prefix << "\033[32;1m**END**\033[00m" << std::endl;
+      } else {
+         const std::string& current = this->lines [this->line];
+         const int length = current.length ();
+         const int perLine = terminalMax - prefixLength - 1;
+         const int subLines = std::max (1, (length + perLine - 1) / perLine);
+
+         for (int s = 0; s < subLines; s++) {
+            const int first = perLine * s;
+            const int last = std::min (perLine * (s + 1), length);
+            if ((number == 1) && (first < this->col) && (this->col <= last)) {
+               stream << prefix << displayable (current.substr (first, this->col - first))
+                      << "\033[31;1m^\033[00m"
+                      << displayable (current.substr (this->col, last - this->col))
+                      << eol << std::endl;
+            } else {
+               stream << prefix << displayable (current.substr (first, perLine))
+                      << eol << std::endl;
+            }
+         }
+      }
+      this->changed = false;
+   }
+   return true;
+}
+
+// The model operations. Each is encoded as three bytes: the operation, the
+// number (low 3 bits), limit (next 2 bits) and whether to check the line
+// number (top bit), and the text.
+//
+enum ModelOps {
+   moFind, moFindBack, moTraverse, moTraverseBack, moUncover, moUncoverBack,
+   moDelete, moDeleteBack, moVerify, moVerifyBack, moSubstitute, moSubstituteBack,
+   moInsert, moInsertBack, moErase, moEraseBack, moUpper, moLower, moBreak,
+   moBreakBack, moJoin, moJoinBack, moKill, moKillBack, moLeft, moRight, moMove,
+   moMoveBack, moQuary, moQuaryBack, moGet, moGetBack, moPrint, moPrintBack,
+   moReload,
+   NumberOfModelOps
+};
+
+static const int modelNumbers [8] = { 0, 1, 1, 1, 2, 3, 5, 100 };
+static const int modelLimits [4] = { 1, 2, 3, INT_MAX };
+#define ARRAY_LENGTH(xx)    (sizeof (xx) / sizeof (xx [0]))
+
+static const char* const modelTexts [] = {
+   "", "a", "b", "ab", "aa", "ba", "\t", "a\001"
+};
+
+//------------------------------------------------------------------------------
+//
+static void describeModel (const Model& model, const DataBuffer& db, std::ostream& stream)
+{
+   stream << "model: cursor " << model.line + 1 << ":" << model.col
+          << " changed " << model.changed << std::endl;
+   for (size_t j = 0; j < model.lines.size (); j++) {
+      stream << model.lines [j] << std::endl;
+   }
+   stream << "buffer: col " << db.getPosition ().col
+          << " changed " << db.hasChanged () << std::endl;
+   const DataBuffer::StringList& lines = db.getLines ();
+   for (DataBuffer::StringList::const_iterator it = lines.begin (); it != lines.end (); ++it) {
+      stream << *it << std::endl;
+   }
+}
+
+//------------------------------------------------------------------------------
+// Checks the one input against the model. The first line of the input is the
+// encoded operations, and any remaining lines are the buffer contents.
+// Returns false on a mismatch, with a report.
+//
+static bool checkModel (const std::string& input, std::string& report)
+{
+   const size_t eol = input.find ('\n');
+   const std::string ops = input.substr (0, eol);
+   const std::string text = (eol == std::string::npos) ? "" : input.substr (eol + 1);
+
+   Session session;
+   session.setGetLineFunction (&getLine);
+   std::ostringstream printed;
+   session.setReport (&printed);
+
+   DataBuffer db (session);
+   Model model;
+   db.loadText (text.data (), text.length ());
+   model.loadText (text);
+
+   std::ostringstream stream;
+   bool result = true;
+
+   for (size_t j = 0; j + 3 <= ops.length (); j += 3) {
+      const unsigned op = (unsigned char) ops [j] % NumberOfModelOps;
+      const unsigned char b1 = ops [j + 1];
+      const int number = modelNumbers [b1 & 7];
+      const int limit = modelLimits [(b1 >> 3) & 3];
+      const bool checkLineNo = (b1 & 0x80) != 0;
+      const unsigned t = (unsigned char) ops [j + 2];
+      const std::string opText = modelTexts [t % ARRAY_LENGTH (modelTexts)];
+      const bool showLineNumbers = (t & 0x10) != 0;
+      const int terminalMax = (t & 0x20) ? 32 : 160;
+
+      const DataBuffer::Position before = db.getPosition ();
+      const std::vector<std::string> linesBefore = model.lines;
+      std::ostringstream expectedPrint;
+      printed.str ("");
+
+      bool expected = false;
+      bool actual = false;
+
+      // Runs the operation on both the model and the buffer.
+      //
+#define RUN_BOTH(modelCall, bufferCall) \
+         expected = model.modelCall; actual = db.bufferCall; break;
+
+      switch (op) {
+         case moFind:
+            RUN_BOTH (find (limit, opText, number), find (limit, opText, number))
+         case moFindBack:
+            RUN_BOTH (findBack (limit, opText, number), findBack (limit, opText, number))
+         case moTraverse:
+            RUN_BOTH (traverse (limit, opText, number), traverse (limit, opText, number))
+         case moTraverseBack:
+            RUN_BOTH (traverseBack (limit, opText, number), traverseBack (limit, opText, number))
+         case moUncover:
+            RUN_BOTH (uncover (limit, opText, number), uncover (limit, opText, number))
+         case moUncoverBack:
+            RUN_BOTH (uncoverBack (limit, opText, number), uncoverBack (limit, opText, number))
+         case moDelete:
+            RUN_BOTH (deleteText (limit, opText, number), deleteText (limit, opText, number))
+         case moDeleteBack:
+            RUN_BOTH (deleteBack (limit, opText, number), deleteBack (limit, opText, number))
+         case moVerify:
+            RUN_BOTH (verify (opText), verify (opText))
+         case moVerifyBack:
+            RUN_BOTH (verifyBack (opText), verifyBack (opText))
+         case moSubstitute:
+            RUN_BOTH (substitute (Model::Forward, opText, number), substitute (opText, number))
+         case moSubstituteBack:
+            RUN_BOTH (substitute (Model::Reverse, opText, number), substituteBack (opText, number))
+         case moInsert:
+            RUN_BOTH (insert (Model::Forward, opText, number), insert (opText, number))
+         case moInsertBack:
+            RUN_BOTH (insert (Model::Reverse, opText, number), insertBack (opText, number))
+         case moErase:
+            RUN_BOTH (erase (number), erase (number))
+         case moEraseBack:
+            RUN_BOTH (eraseBack (number), eraseBack (number))
+         case moUpper:
+            RUN_BOTH (changeCase (true, number), upperCase (number))
+         case moLower:
+            RUN_BOTH (changeCase (false, number), lowerCase (number))
+         case moBreak:
+            RUN_BOTH (breakLine (Model::Forward, number), breakLine (number))
+         case moBreakBack:
+            RUN_BOTH (breakLine (Model::Reverse, number), breakLineBack (number))
+         case moJoin:
+            RUN_BOTH (join (number), join (number))
+         case moJoinBack:
+            RUN_BOTH (joinBack (number), joinBack (number))
+         case moKill:
+            RUN_BOTH (kill (number), kill (number))
+         case moKillBack:
+            RUN_BOTH (killBack (number), killBack (number))
+         case moLeft:
+            RUN_BOTH (left (number), left (number))
+         case moRight:
+            RUN_BOTH (right (number), right (number))
+         case moMove:
+            RUN_BOTH (move (number), move (number))
+         case moMoveBack:
+            RUN_BOTH (moveBack (number), moveBack (number))
+         case moQuary:
+            RUN_BOTH (quary (number), quary (number))
+         case moQuaryBack:
+            RUN_BOTH (quaryBack (number), quaryBack (number))
+         case moGet:
+            RUN_BOTH (get (Model::Forward, number), get (number))
+         case moGetBack:
+            RUN_BOTH (get (Model::Reverse, number), getBack (number))
+#undef RUN_BOTH
+
+         case moPrint:
+         case moPrintBack:
+            session.setShowLineNumbers (showLineNumbers);
+            session.setTerminalMax (terminalMax);
+            if (op == moPrint) {
+               expected = model.print (Model::Forward, number, showLineNumbers,
+                                       terminalMax, expectedPrint);
+               actual = db.print (number);
+            } else {
+               expected = model.print (Model::Reverse, number, showLineNumbers,
+                                       terminalMax, expectedPrint);
+               actual = db.printBack (number);
+            }
+            break;
+
+         case moReload:
+            {
+               std::string saved;
+               db.saveText (saved);
+               db.loadText (saved.data (), saved.length ());
+               model.loadText (saved);
+               expected = actual = true;
+            }
+            break;
+      }
+
+      // Compare everything, so that a mismatch is found at the operation that
+      // caused it.
+      //
+      const DataBuffer::Position after = db.getPosition ();
+      const DataBuffer::StringList& lines = db.getLines ();
+      const bool sameLines = (lines.size () == model.lines.size ()) &&
+                             std::equal (lines.begin (), lines.end (), model.lines.begin ());
+      const bool atEnd = (model.line >= int (model.lines.size ()));
+      const bool sameLine = atEnd ? (after.line == nullptr)
+                                  : (after.line && (*after.line == model.lines [model.line]));
+
+      std::string reason;
+      if (actual != expected) {
+         reason = "result " + std::to_string (actual) + ", model " + std::to_string (expected);
+      } else if (!sameLines) {
+         reason = "contents differ";
+      } else if (!sameLine || (after.col != model.col)) {
+         reason = "cursor differs";
+      } else if (db.hasChanged () != model.changed) {
+         reason = "changed flag differs";
+      } else if ((model.lines != linesBefore) && (after.version == before.version)) {
+         reason = "contents changed, version not";
+      } else if ((op == moQuary || op == moQuaryBack) &&
+                 (session.getLastModify () != model.lastModify)) {
+         reason = "quary text '" + session.getLastModify () + "', model '" +
+                  model.lastModify + "'";
+      } else if (printed.str () != expectedPrint.str ()) {
+         reason = "printed output differs:\n" + printed.str () +
+                  "model:\n" + expectedPrint.str ();
+      } else if ((checkLineNo || (j + 6 > ops.length ())) &&
+                 (db.currentLineNo () != model.line + 1)) {
+         reason = "line number " + std::to_string (db.currentLineNo ()) +
+                  ", model " + std::to_string (model.line + 1);
+      }
+
+      if (!reason.empty ()) {
+         stream << "operation " << j / 3 << " (" << op << " number " << number
+                << " limit " << limit << " text '" << opText << "'): "
+                << reason << std::endl;
+         describeModel (model, db, stream);
+         result = false;
+         break;
+      }
+   }
+
+   inputsRun++;
+   report = stream.str ();
+   return result;
+}
+
+#ifdef ACE_LIBFUZZER
+
+//------------------------------------------------------------------------------
+// libFuzzer entry point.
+//
+extern "C" int LLVMFuzzerTestOneInput (const uint8_t* data, size_t size)
+{
+   const std::string input (reinterpret_cast <const char*> (data), size);
+   std::string report;
+   if (!check (input, report) || !checkModel (input, report)) {
+      std::cerr << report;
+      abort ();
+   }
+   return 0;
+}
+
+#else
+
+//------------------------------------------------------------------------------
+// Random input generation - a small deterministic generator, so that a seed
+// gives the same inputs on any platform.
+//
+class Random
+{
+public:
+   explicit Random (const unsigned long seed) : state (seed * 2654435761UL + 1) { }
+
+   unsigned next (const unsigned n) {
+      this->state ^= this->state << 13;
+      this->state ^= this->state >> 7;
+      this->state ^= this->state << 17;
+      return (unsigned) ((this->state >> 16) % n);
+   }
+
+private:
+   unsigned long long state;
+};
+
+template <typename T, size_t N>
+static const T& pick (Random& random, const T (&items) [N])
+{
+   return items [random.next (N)];
+}
+
+static const char* const plainCommands [] = {
+   "m", "m-", "k", "k-", "j", "j-", "l", "r", "e", "e-", "b", "b-",
+   "h", "h-", "q", "q-", "p", "p-", "a", "w", "%e", "%q", "%m", "%n"
+};
+
+static const char* const textCommands [] = {
+   "f", "f-", "t", "t-", "u", "u-", "d", "d-", "s", "s-", "v", "v-", "i", "i-"
+};
+
+static const char* const texts [] = {
+   "a", "e", "an", "ta", "x", "", "alpha", "a b"
+};
+
+static const char* const counts [] = {
+   "", "", "", "2", "3", "0", "*", "?", "\\"
+};
+
+static const char* const lines [] = {
+   "alpha beta", "gamma", "delta epsilon zeta", "", "eta theta", "iota",
+   "key=val", "aaa a", "tatata"
+};
+
+//------------------------------------------------------------------------------
+//
+static std::string randomSequence (Random& random, const int depth);
+
+//------------------------------------------------------------------------------
+//
+static std::string randomCommand (Random& random, const int depth)
+{
+   std::string result;
+
+   const unsigned choice = random.next (10);
+   if ((choice == 0) && (depth < 2)) {
+      result = "(" + randomSequence (random, depth + 1);
+      while (random.next (3) == 0) {
+         result += ", " + randomSequence (random, depth + 1);
+      }
+      result += ")";
+   } else if (choice < 5) {
+      result = pick (random, plainCommands);
+   } else {
+      result = pick (random, textCommands);
+      result += "/";
+      result += pick (random, texts);
+      result += "/";
+   }
+   result += pick (random, counts);
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+static std::string randomSequence (Random& random, const int depth)
+{
+   std::string result = randomCommand (random, depth);
+   const unsigned n = random.next (4);
+   for (unsigned j = 0; j < n; j++) {
+      result += " " + randomCommand (random, depth);
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+static std::string randomInput (Random& random)
+{
+   std::string result = randomSequence (random, 0) + "\n";
+
+   const unsigned n = random.next (40);
+   for (unsigned j = 0; j < n; j++) {
+      result += pick (random, lines);
+      result += "\n";
+   }
+   return result;
+}
+
+static const char* const modelLines [] = {
+   "ab", "", "aab a", "b\tab", "ba\001a", "\351ab", "a",
+   "abababababababababababababababababababababababababab"
+};
+
+//------------------------------------------------------------------------------
+//
+static std::string randomModelInput (Random& random)
+{
+   std::string result;
+   const unsigned n = 3 * (1 + random.next (40));
+   for (unsigned j = 0; j < n; j++) {
+      const char c = random.next (256);
+      result += (c == '\n') ? char (0x8a) : c;   // the new line ends the operations
+   }
+   result += "\n";
+
+   const unsigned lines = random.next (12);
+   for (unsigned j = 0; j < lines; j++) {
+      result += pick (random, modelLines);
+      if ((j + 1 < lines) || (random.next (4) != 0)) result += "\n";
+   }
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Checks that the buffer's lines are as expected.
+//
+static bool sameLines (const DataBuffer& db, const std::vector<std::string>& expected)
+{
+   const DataBuffer::StringList& lines = db.getLines ();
+   return (lines.size () == expected.size ()) &&
+          std::equal (lines.begin (), lines.end (), expected.begin ());
+}
+
+//------------------------------------------------------------------------------
+// Checks the line readers, i.e. load, plain and compressed as supported by
+// this build, and absorbe forward and back in random batch sizes, against
+// the model's split of the text. Some lines are longer than the reader's
+// block, and some texts have many lines, so that lines span blocks.
+// Returns false on a mismatch, with a report.
+//
+static bool checkReaders (Random& random, std::string& report)
+{
+   static const char characters [] = "ab\t\r\0x";
+
+   // Either many short lines, or a few lines some of which are long.
+   //
+   std::string text;
+   const bool many = (random.next (4) == 0);
+   const unsigned lines = many ? 40000 + random.next (40000) : random.next (8);
+   for (unsigned j = 0; j < lines; j++) {
+      const unsigned length = (!many && (random.next (4) == 0)) ? 100000 + random.next (300000)
+                                                                : random.next (12);
+      for (unsigned k = 0; k < length; k++) {
+         text += characters [random.next (sizeof (characters) - 1)];
+      }
+      if ((j + 1 < lines) || (random.next (2) != 0)) text += "\n";
+   }
+
+   std::vector<std::string> expected;
+   splitText (text, expected);
+
+   const std::string filename = Global::getTemporaryFilename ();
+   std::ofstream file (filename.c_str (), std::ios::binary);
+   file.write (text.data (), text.length ());
+   file.close ();
+
+   Session session;
+   std::ostringstream messages;
+   session.setReport (&messages);
+   DataBuffer db (session);
+
+   std::ostringstream stream;
+   bool result = true;
+
+   if (!db.load (filename) || !sameLines (db, expected)) {
+      stream << "load: " << db.getLines ().size () << " lines, expected "
+             << expected.size () << std::endl << messages.str ();
+      result = false;
+   }
+
+   // Compressed, i.e. as written by LineWriter, so no missing last new line.
+   //
+   static const Compressions compressions [] = { cpGzip, cpZstd };
+   for (size_t c = 0; result && c < ARRAY_LENGTH (compressions); c++) {
+      LineWriter writer;
+      const std::string compressed = filename + ((c == 0) ? ".gz" : ".zst");
+      if (!writer.open (compressed, compressions [c])) continue;   // not supported
+      for (size_t j = 0; j < expected.size (); j++) {
+         writer.putLine (expected [j]);
+      }
+      writer.close ();
+
+      if (!db.load (compressed) || !sameLines (db, expected)) {
+         stream << "load " << compressed << ": " << db.getLines ().size ()
+                << " lines, expected " << expected.size () << std::endl << messages.str ();
+         result = false;
+      }
+      remove (compressed.c_str ());
+   }
+
+   // Absorbe into the middle of a small buffer. Forward, each line goes just
+   // before the current line. Back, each line goes before the current line
+   // and becomes the current line, i.e. the lines end up in reverse order.
+   // The model is the lines before the cursor, and the current line onwards.
+   //
+   if (result) {
+      const std::string initial = "x\ny\n";
+      db.loadText (initial.data (), initial.length ());
+      std::vector<std::string> before;
+      std::deque<std::string> after;
+      after.push_back ("x");
+      after.push_back ("y");
+      const int move = random.next (3);
+      db.move (move);
+      for (int j = 0; j < move; j++) {
+         before.push_back (after.front ());
+         after.pop_front ();
+      }
+
+      if (!db.connect (filename)) {
+         stream << "connect: " << messages.str () << std::endl;
+         result = false;
+      }
+
+      size_t next = 0;
+      while (result) {
+         const int number = 1 + random.next ((random.next (4) == 0) ? 5000 : 4);
+         const bool forward = random.next (2) != 0;
+         const bool absorbed = forward ? db.absorbe (number) : db.absorbeBack (number);
+
+         const int count = std::min (number, int (expected.size () - next));
+         for (int j = 0; j < count; j++) {
+            if (forward) {
+               before.push_back (expected [next++]);
+            } else {
+               after.push_front (expected [next++]);
+            }
+         }
+
+         if ((absorbed != (count == number)) ||
+             (db.currentLineNo () != int (before.size ()) + 1))
+         {
+            stream << "absorbe " << (forward ? "" : "back ") << number << ": result "
+                   << absorbed << " line " << db.currentLineNo () << ", expected "
+                   << before.size () + 1 << std::endl;
+            result = false;
+         }
+         if (!absorbed) break;
+      }
+
+      before.insert (before.end (), after.begin (), after.end ());
+      if (result && !sameLines (db, before)) {
+         stream << "absorbe: " << db.getLines ().size () << " lines, expected "
+                << before.size () << std::endl;
+         result = false;
+      }
+   }
+
+   remove (filename.c_str ());
+
+   report = stream.str ();
+   return result;
+}
+
+// Fusion cases. Each command is combined with each form (C is replaced by the
+// command), preceded by each position, and run on each buffer. The commands
+// include those that are fused by BasicCommands::fuse, and similar commands
+// that must not be, e.g. B- (see fuse).
+//
+static const char* const fusionCommands [] = {
+   "b", "b-", "e", "e-", "h", "h-", "j", "j-", "k", "k-", "l", "r", "m", "m-",
+   "i/x/", "i/yz/", "i-/x/", "i//", "a", "q", "f/a/", "s/a/"
+};
+
+static const char* const fusionForms [] = {
+   "C C", "C C C", "C2 C", "C C3", "C C?", "C\\ C", "C C*", "(C C)2", "(C C, m)"
+};
+
+static const char* const fusionPositions [] = {
+   "", "r3 ", "m2 r2 ", "m* ", "m* m- ", "m* m- r* ", "m- "
+};
+
+static const char* const fusionBuffers [] = {
+   "",
+   "a\n",
+   "alpha beta\ngamma\n\ndelta\n",
+   "a\nb\nc\nd\ne\nf\ng\nh\n"
+};
+
+//------------------------------------------------------------------------------
+// Checks the fusion cases. Returns false at the first mismatch.
+//
+static bool checkFusion ()
+{
+   std::string report;
+   long cases = 0;
+
+   for (size_t c = 0; c < sizeof (fusionCommands) / sizeof (fusionCommands [0]); c++) {
+      const std::string command = fusionCommands [c];
+
+      for (size_t f = 0; f < sizeof (fusionForms) / sizeof (fusionForms [0]); f++) {
+         std::string form;
+         for (const char* x = fusionForms [f]; *x; x++) {
+            if (*x == 'C') {
+               form += command;
+            } else {
+               form += *x;
+            }
+         }
+
+         for (size_t p = 0; p < sizeof (fusionPositions) / sizeof (fusionPositions [0]); p++) {
+            for (size_t b = 0; b < sizeof (fusionBuffers) / sizeof (fusionBuffers [0]); b++) {
+               const std::string input = fusionPositions [p] + form + "\n" + fusionBuffers [b];
+               cases++;
+               if (!check (input, report)) {
+                  std::cerr << "ace_fuzz: fusion case " << cases << ": " << report;
+                  std::cout << input;   // the reproducer
+                  return false;
+               }
+            }
+         }
+      }
+   }
+
+   std::cout << "ace_fuzz: " << cases << " fusion cases, " << inputsRun
+             << " run, no mismatches" << std::endl;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+static void usage ()
+{
+   std::cerr << "usage: ace_fuzz [--model] [--runs N] [--seed N] [FILE...]" << std::endl
+             << "       ace_fuzz --fusion" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+int main (int argc, char** argv)
+{
+   long runs = 10000;
+   unsigned long seed = 1;
+   bool modelled = false;
+   std::vector<std::string> files;
+
+   for (int j = 1; j < argc; j++) {
+      const std::string p1 = argv [j];
+      if (p1 == "--fusion") {
+         return checkFusion () ? 0 : 1;
+      } else if (p1 == "--model") {
+         modelled = true;
+      } else if ((p1 == "--runs") || (p1 == "--seed")) {
+         if (j + 1 >= argc) {
+            usage ();
+            return 1;
+         }
+         const char* value = argv [++j];
+         if (p1 == "--runs") {
+            runs = atol (value);
+         } else {
+            seed = strtoul (value, NULL, 10);
+         }
+      } else if (!p1.empty () && (p1 [0] == '-')) {
+         usage ();
+         return 1;
+      } else {
+         files.push_back (p1);
+      }
+   }
+
+   std::string report;
+
+   if (!files.empty ()) {
+      for (size_t j = 0; j < files.size (); j++) {
+         std::ifstream file (files [j].c_str ());
+         if (!file.is_open ()) {
+            std::cerr << "ace_fuzz: cannot open " << files [j] << std::endl;
+            return 4;
+         }
+         std::stringstream content;
+         content << file.rdbuf ();
+
+         const bool okay = modelled ? checkModel (content.str (), report)
+                                    : check (content.str (), report);
+         if (!okay) {
+            std::cerr << files [j] << ": " << report;
+            return 1;
+         }
+      }
+      std::cout << "ace_fuzz: " << files.size () << " files, " << inputsRun
+                << " run, no mismatches" << std::endl;
+      return 0;
+   }
+
+   Random random (seed);
+   for (long n = 0; n < runs; n++) {
+      const std::string input = modelled ? randomModelInput (random) : randomInput (random);
+      const bool okay = modelled ? checkModel (input, report) : check (input, report);
+      if (!okay) {
+         std::cerr << "ace_fuzz: seed " << seed << " input " << n << ": " << report;
+         std::cout << input;   // the reproducer
+         return 1;
+      }
+
+      // The readers are relatively slow to check, so only every so often.
+      //
+      if (modelled && (n % 20 == 0) && !checkReaders (random, report)) {
+         std::cerr << "ace_fuzz: seed " << seed << " input " << n << ": readers: " << report;
+         return 1;
+      }
+   }
+
+   std::cout << "ace_fuzz: seed " << seed << ", " << runs << " inputs, "
+             << inputsRun << " run, no mismatches" << std::endl;
+   return 0;
+}
+
+#endif
+
+// end
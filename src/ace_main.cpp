@@ -9,10 +9,22 @@
  * andrew.starritt@gmail.com
  */
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -25,11 +37,15 @@
 #include "command_parser.h"
 #include "commands.h"
 #include "data_buffer.h"
+#include "editor.h"
 #include "global.h"
+#include "profile.h"
+#include "trace_log.h"
 
 
 //------------------------------------------------------------------------------
 // Macro to define functions to read and output contents of a resource text file.
+// The text is output as one block, as std::cerr is unbuffered.
 //
 #define PUT_RESOURCE(function, resource)                                  \
                                                                           \
@@ -39,7 +55,7 @@ static void function (std::ostream& stream)                               \
    extern char _binary_##resource##_end;                                  \
                                                                           \
    const char* p = &_binary_##resource##_start;                           \
-   while (p < &_binary_##resource##_end) stream << (*p++);                \
+   stream.write (p, &_binary_##resource##_end - p);                       \
 }
 
 
@@ -101,10 +117,72 @@ static void help (int argc, char** argv)
    }
 }
 
+//------------------------------------------------------------------------------
+// Start up instrumentation (-T, --timing): reports the time of each phase,
+// in ms since main was entered.
+//
+typedef std::chrono::steady_clock Clock;
+
+static Clock::time_point startTime;
+static bool startupTiming = false;
+
+static void startupPhase (const char* phase)
+{
+   if (!startupTiming) return;
+
+   const double ms = std::chrono::duration<double, std::milli> (Clock::now () - startTime).count ();
+   char item [80];
+   snprintf (item, sizeof (item), "ace: timing: %-16s %9.3f ms", phase, ms);
+   std::cerr << item << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+static void backupSource (const std::string& source)
+{
+   std::ifstream  src (source,       std::ios::binary);
+   std::ofstream  bup (source + "~", std::ios::binary);
+   bup << src.rdbuf();
+}
+
+//------------------------------------------------------------------------------
+// Determines if the initial option command string ends by abandoning the edit
+// session (%A), in which case, when the %A is executed, the source file is not
+// modified, so need not be backed up. To be on the safe side, this does not
+// apply when the option string might include a %B (save).
+//
+static bool endsWithAbandon (const std::string& option)
+{
+   if (option.find_first_of ("bB") != std::string::npos) return false;
+
+   std::string::size_type end = option.find_last_not_of (" \t0123456789");
+   if ((end == std::string::npos) || (end < 1)) return false;
+   if ((option [end] != 'a') && (option [end] != 'A')) return false;
+
+   end = option.find_last_not_of (" \t", end - 1);
+   return (end != std::string::npos) && (option [end] == '%');
+}
+
+//------------------------------------------------------------------------------
+// In batch mode, a SIGINT or SIGTERM stops the batch: each file being edited
+// is closed (and so saved) after its current command line, and any files not
+// yet started are skipped.
+//
+static bool batchRunning = false;
+static volatile sig_atomic_t batchSignal = 0;
+
 //------------------------------------------------------------------------------
 //
 static void signalCatcher (int sig)
 {
+   // In batch mode, the workers check for the signal between command lines,
+   // see runCommandLines.
+   //
+   if (batchRunning) {
+      batchSignal = sig;
+      return;
+   }
+
    switch (sig) {
 
       case SIGINT:
@@ -124,7 +202,7 @@ static void signalCatcher (int sig)
 //------------------------------------------------------------------------------
 //
 inline static void inputTerminated() {
-   std::cerr << "input terminated" << std::endl;
+   Global::report () << "input terminated" << std::endl;
    Global::requestClose (1);
 }
 
@@ -186,33 +264,458 @@ static std::string getFromStandardInput (const char* prompt)
 }
 
 //------------------------------------------------------------------------------
-// Used when command input is NOT from standard input
+// Used when command input is NOT from standard input, i.e. the -c and -s
+// command file. The whole file is read up front and split into lines.
+//
+static std::vector<std::string> commandLines;
+static thread_local size_t commandLineNo = 0;  // number of lines read so far
+
+// Outcome of checking the command file in advance, see checkCommandFile.
 //
-static std::ifstream commandStream;
+static size_t checkedLines = 0;      // up to and including any dynamic line
+static bool checkedForwardOnly = true;
 
+// The parsed checked lines, by line number, nullptr for lines not checked.
+// Recurring lines share one parsed line, owned by checkedPrograms.
+//
+static std::vector<const CompoundCommands*> commandPrograms;
+static std::unordered_map<std::string, CompoundCommands*> checkedPrograms;
+
+//------------------------------------------------------------------------------
+// The lines are split as per std::getline, in particular a file that ends
+// with a newline has a final empty line.
+//
+static bool readCommandFile (const std::string& filename)
+{
+   std::ifstream file (filename, std::ios::binary);
+   if (!file.is_open()) return false;
+
+   const std::string content ((std::istreambuf_iterator<char> (file)),
+                              std::istreambuf_iterator<char> ());
+
+   std::string::size_type start = 0;
+   while (true) {
+      const std::string::size_type end = content.find ('\n', start);
+      if (end == std::string::npos) break;
+      commandLines.push_back (content.substr (start, end - start));
+      start = end + 1;
+   }
+   commandLines.push_back (content.substr (start));
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
 static std::string getFromCommandStream (const char* prompt)
 {
    std::string result;
 
-   if (commandStream.is_open()) {
-      std::getline (commandStream, result);
+   if (commandLineNo < commandLines.size()) {
+      result = commandLines [commandLineNo];
+   }
+   commandLineNo++;
 
-      if (!commandStream.good ()) {
-         // end of file
-         inputTerminated();
+   // As per std::getline, reading the last line also hits the end of file.
+   //
+   if (commandLineNo >= commandLines.size()) {
+      inputTerminated();
+   }
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Parses the command file in advance, so that any errors are reported before
+// the file being edited is touched. Returns false if any line fails to parse.
+// Checking stops after a dynamic command (G, %X etc.), as any subsequent
+// lines may be read as data or be parsed differently.
+// The parsed lines are kept, see commandPrograms, and executed as is by
+// runCommandLines, so checked lines are only parsed once. Recurring lines,
+// common in generated scripts, are only parsed once in all.
+//
+static bool checkCommandFile (const std::string& filename,
+                              const CompoundCommands* optionCommands)
+{
+   if (optionCommands && optionCommands->isDynamic ()) {
+      checkedForwardOnly = false;
+      return true;
+   }
+
+   commandPrograms.assign (commandLines.size(), nullptr);
+
+   bool result = true;
+   for (size_t j = 0; j < commandLines.size(); j++) {
+      checkedLines = j + 1;
+
+      const std::unordered_map<std::string, CompoundCommands*>::const_iterator
+         found = checkedPrograms.find (commandLines [j]);
+      if (found != checkedPrograms.end ()) {
+         commandPrograms [j] = found->second;
+         continue;
       }
 
-   } else {
-      inputTerminated();
+      CompoundCommands* commands = CommandParser::parse (commandLines [j]);
+
+      if (!commands) {
+         std::cerr << "Command file " << filename << " line " << (j + 1)
+                   << ": " << commandLines [j] << std::endl;
+         result = false;
+         continue;
+      }
+
+      checkedPrograms [commandLines [j]] = commands;
+      commandPrograms [j] = commands;
+
+      if (!commands->isForwardOnly ()) checkedForwardOnly = false;
+      if (commands->isDynamic ()) break;
    }
 
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+static void deleteCheckedPrograms ()
+{
+   for (std::unordered_map<std::string, CompoundCommands*>::iterator
+        it = checkedPrograms.begin (); it != checkedPrograms.end (); ++it)
+   {
+      delete it->second;
+   }
+   checkedPrograms.clear ();
+   commandPrograms.clear ();
+}
+
+//------------------------------------------------------------------------------
+// Determines if all the commands in the command file (and the initial option
+// command string) are forward only, i.e. if the file may be streamed.
+//
+static bool isForwardOnlyScript (const CompoundCommands* optionCommands)
+{
+   if (optionCommands && !optionCommands->isForwardOnly ()) return false;
+
+   // Any lines not checked follow a dynamic command, and dynamic commands
+   // are not forward only anyway.
+   //
+   return checkedForwardOnly && (checkedLines >= commandLines.size());
+}
+
+//------------------------------------------------------------------------------
+// Appends the buffer's hot path counters and memory use (see DataBuffer::
+// Counters and Memory) for the file to the statistics file as a single line
+// JSON object. The line is written in one go, so that in batch mode concurrent
+// workers do not interleave their output.
+//
+static void writeStats (const std::string& filename, const std::string& file,
+                        const DataBuffer& db)
+{
+   const DataBuffer::Counters& counters = db.getCounters ();
+   const DataBuffer::Memory memory = db.getMemory ();
+
+   char item [768];
+   snprintf (item, sizeof (item),
+             "\"lines\": %lu, \"lines_scanned\": %lu, \"bytes_compared\": %lu, "
+             "\"line_copies\": %lu, \"allocations\": %lu, "
+             "\"lines_allocated\": %lu, \"lines_freed\": %lu, "
+             "\"memory\": {\"payload\": %lu, \"container\": %lu, \"slack\": %lu, "
+             "\"arena\": %lu, \"total\": %lu}, \"exit_code\": %d}\n",
+             memory.lines, counters.linesScanned,
+             counters.bytesCompared, counters.lineCopies, counters.allocations,
+             counters.linesAllocated, counters.linesFreed,
+             memory.payload, memory.container, memory.slack, memory.arena,
+             memory.total, Global::getExitCode ());
+
+   const std::string line = "{\"file\": " + TraceLog::jsonString (file) + ", " + item;
+
+   int fd = open (filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+   if ((fd < 0) || (write (fd, line.data(), line.length()) != ssize_t (line.length()))) {
+      const int error = errno;
+      Global::report () << "Cannot write stats file '" << filename << "' : "
+                        << strerror (error) << std::endl;
+   }
+   if (fd >= 0) close (fd);
+}
+
+//------------------------------------------------------------------------------
+// Main processing read/parse/execute loop. Command lines are read and run on
+// the editor until the session is closed, or in batch mode, a signal stops
+// the batch, see signalCatcher.
+//
+static void runCommandLines (Editor& editor, const bool shellInterpretor,
+                             std::ofstream& backupStream)
+{
+   DataBuffer& db = editor.getBuffer ();
+
+   while ((shellInterpretor || std::cin) && !Global::getCloseRequested()) {
+
+      if (batchSignal) {
+         Global::requestClose (128 + batchSignal);
+         break;
+      }
+
+      // Lines from the command file (see getFromCommandStream) that were
+      // checked in advance have already been parsed.
+      //
+      const size_t lineNo = commandLineNo;
+      std::string line = Global::getLine (Global::getPromptOn() ? ">" : NULL);
+
+      if (backupStream.is_open()) {
+         backupStream << line << std::endl;
+      }
+
+      // Otherwise the parsed command line is owned by the parser's cache.
+      //
+      const CompoundCommands* doThis = nullptr;
+      if (lineNo < commandPrograms.size()) {
+         doThis = commandPrograms [lineNo];
+      }
+      if (!doThis) {
+         doThis = CommandParser::compile (line);
+      }
+      if (doThis) {
+         ExecutionState state;
+         bool status = editor.run (*doThis, state);
+         if (!status) {
+            Global::report () << "Command failure: " << editor.getFailure () << std::endl;
+         }
+
+         switch (Global::getMode()) {
+            case Global::Full:
+               {
+                  // Always print line (unless last successfull command was a print).
+                  //
+                  const AbstractCommands* lsc = state.lastSuccessfullCommand;
+                  const BasicCommands* blsc = dynamic_cast <const BasicCommands*> (lsc);
+
+                  if (!blsc || ((blsc->getKind() != BasicCommands::Print) &&
+                                (blsc->getKind() != BasicCommands::PrintBack))) {
+                     db.print (1);
+                  }
+               }
+               break;
+
+            case Global::Quiet:
+               break;
+
+            case Global::Monitor:
+               if (db.hasChanged()) {
+                  db.print (1);
+               }
+         }
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+// Saves the buffer to target, or failing that to an alternative file, and sets
+// the exit code accordingly.
+//
+static void saveBuffer (DataBuffer& db, const std::string& target,
+                        const bool replaceOnSave)
+{
+   bool status = db.save (target, replaceOnSave ? DataBuffer::Replace : DataBuffer::InPlace);
+   if (!status && !db.getRecoveryName().empty()) {
+      // All the data was written, just not to target.
+      //
+      Global::setExitCode (32);
+   } else if (!status && db.isStreaming ()) {
+      // Lines already written out and the unread input are not in the
+      // buffer, so an alternative file would only hold the window.
+      //
+      Global::setExitCode (64);
+   } else if (!status) {
+      Global::report () << "Attempting to save contents to an alternative file..." << std::endl;
+      std::string name = Global::getTemporaryFilename();
+      status = db.save (name);
+      if (status) {
+         Global::setExitCode (32);
+      } else {
+         Global::setExitCode (64);
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+// Batch mode: the one checked command file is applied to each of the files,
+// with up to jobs files edited concurrently by a pool of worker threads.
+// Each file is edited with its own Editor and Session, which starts out as
+// the main session was after the options were processed, and so behaves
+// exactly as ace -c SCRIPT FILE would. The parsed option commands are
+// shared, as compiled commands are not modified when run.
+//
+struct BatchSettings {
+   std::string option;                     // see endsWithAbandon
+   const CompoundCommands* optionCommands;
+   bool optimize;
+   bool profile;
+   bool replaceOnSave;
+   std::string stats;                      // empty if none
+};
+
+// The work shared by the workers: the next file to be edited, and for each
+// file, once done, its captured report output and exit code.
+//
+struct BatchJobs {
+   const std::vector<std::string>* files;
+   const BatchSettings* settings;
+
+   std::mutex mutex;
+   std::condition_variable completed;
+   size_t next;
+   std::vector<std::string> reports;
+   std::vector<int> exitCodes;
+   std::vector<bool> done;
+};
+
+//------------------------------------------------------------------------------
+// Edits one file using session, which is the calling thread's current session.
+// Returns the exit code.
+//
+static int editBatchFile (const std::string& file, const BatchSettings& settings,
+                          Session& session)
+{
+   session.setTargetFilename (file);
+   commandLineNo = 0;
+
+   bool backupPending = (file != DataBuffer::stdInOut());
+   if (backupPending && !endsWithAbandon (settings.option)) {
+      backupSource (file);
+      backupPending = false;
+   }
+
+   Editor editor (session);
+   DataBuffer& db = editor.getBuffer ();
+   if (!db.load (file)) {
+      return 4;
+   }
+
+   if (settings.optionCommands) {
+      if (!editor.run (*settings.optionCommands)) {
+         session.report () << "Command failure: " << editor.getFailure () << std::endl;
+      }
+   }
+
+   if (backupPending && !session.getAbandonRequested ()) {
+      backupSource (file);
+   }
+
+   std::ofstream noBackup;
+   runCommandLines (editor, false, noBackup);
+
+   if (settings.profile && session.getProfile ()) {
+      session.getProfile ()->report (session.report ());
+   }
+
+   if (!session.getAbandonRequested ()) {
+      saveBuffer (db, file, settings.replaceOnSave);
+   }
+
+   if (!settings.stats.empty ()) {
+      writeStats (settings.stats, file, db);
+   }
+
+   return session.getExitCode ();
+}
+
+//------------------------------------------------------------------------------
+// Worker thread: edits files until there are none left. Once a signal has
+// stopped the batch, files not yet started are skipped.
+//
+static void batchWorker (BatchJobs* jobs)
+{
+   while (true) {
+      size_t j;
+      {
+         std::lock_guard<std::mutex> lock (jobs->mutex);
+         if (jobs->next >= jobs->files->size ()) break;
+         j = jobs->next++;
+      }
+
+      const std::string& file = (*jobs->files) [j];
+      std::ostringstream report;
+      int exitCode;
+
+      if (batchSignal) {
+         report << file << ": not edited" << std::endl;
+         exitCode = 128 + batchSignal;
+      } else {
+         Session session;
+         session.setReport (&report);
+         session.setGetLineFunction (&getFromCommandStream);
+         session.setOptimize (jobs->settings->optimize);
+         session.setProfiling (jobs->settings->profile);
+
+         Global::setSession (&session);
+         exitCode = editBatchFile (file, *jobs->settings, session);
+         Global::setSession (nullptr);
+      }
+
+      {
+         std::lock_guard<std::mutex> lock (jobs->mutex);
+         jobs->reports [j] = report.str ();
+         jobs->exitCodes [j] = exitCode;
+         jobs->done [j] = true;
+      }
+      jobs->completed.notify_all ();
+   }
+}
+
+//------------------------------------------------------------------------------
+// Edits the files on up to jobs worker threads. The report output of each file
+// is written out in file order, as each completes. Returns the highest of the
+// files' exit codes.
+//
+static int runBatch (const std::vector<std::string>& files, const int jobs,
+                     const BatchSettings& settings)
+{
+   BatchJobs work;
+   work.files = &files;
+   work.settings = &settings;
+   work.next = 0;
+   work.reports.resize (files.size());
+   work.exitCodes.resize (files.size(), 0);
+   work.done.resize (files.size(), false);
+
+   std::vector<std::thread> workers;
+   const size_t number = std::min (size_t (jobs), files.size());
+   for (size_t t = 0; t < number; t++) {
+      workers.push_back (std::thread (batchWorker, &work));
+   }
+
+   int exitCode = 0;
+   for (size_t j = 0; j < files.size(); j++) {
+      std::string report;
+      int fileExitCode;
+      {
+         std::unique_lock<std::mutex> lock (work.mutex);
+         while (!work.done [j]) {
+            work.completed.wait (lock);
+         }
+         report.swap (work.reports [j]);
+         fileExitCode = work.exitCodes [j];
+      }
+
+      std::cerr << report;
+      if (fileExitCode != 0) {
+         std::cerr << files [j] << ": exit code " << fileExitCode << std::endl;
+      }
+      if (fileExitCode > exitCode) exitCode = fileExitCode;
+   }
+
+   for (size_t t = 0; t < workers.size(); t++) {
+      workers [t].join ();
+   }
+
+   return exitCode;
+}
+
 //------------------------------------------------------------------------------
 //
 int main (int argc, char** argv)
 {
+   startTime = Clock::now ();
+
    // skip program name.
    //
    argc--;
@@ -256,23 +759,43 @@ int main (int argc, char** argv)
       ofOption  = 0x08,
       ofBackup  = 0x10,
       ofQuiet   = 0x20,
-      ofTheLot  = 0x3F
+      ofWindow  = 0x40,
+      ofReplace = 0x80,
+      ofNoOptimize = 0x100,
+      ofBatch   = 0x200,
+      ofJobs    = 0x400,
+      ofProfile = 0x800,
+      ofStats   = 0x1000,
+      ofTiming  = 0x2000,
+      ofTrace   = 0x4000,
+      ofTheLot  = 0x7FFF
    };
 
    // Certain groups of options are mutually exclusive.
    //
    const unsigned meg1 = ofShell;
    const unsigned meg2 = ofCommand | ofReport | ofBackup;
+   const unsigned meg3 = ofBatch;
+   const unsigned meg4 = ofShell | ofCommand | ofBackup;
 
    unsigned optionFlags = ofNone;
    bool shellInterpretor = false;
    bool suppressCopyRight = false;
+   bool replaceOnSave = false;
+   bool noOptimize = false;
+   bool profile = false;
    std::string command;
    std::string report;
    std::string option;
    std::string backup;
+   std::string window;
+   std::string batch;
+   std::string jobs;
+   std::string stats;
+   std::string trace;
    std::string source;
    std::string target;
+   bool backupPending = false;
 
 // Macro to parse flag options.
 //
@@ -346,6 +869,26 @@ int main (int argc, char** argv)
          PARSE_VALUE_OPTION (backup, ofBackup);
       }
 
+      else if ((p1 == "-W") || (p1 == "--window")) {
+         PARSE_VALUE_OPTION (window, ofWindow);
+      }
+
+      else if ((p1 == "-B") || (p1 == "--batch")) {
+         PARSE_VALUE_OPTION (batch, ofBatch);
+      }
+
+      else if ((p1 == "-j") || (p1 == "--jobs")) {
+         PARSE_VALUE_OPTION (jobs, ofJobs);
+      }
+
+      else if ((p1 == "-S") || (p1 == "--stats")) {
+         PARSE_VALUE_OPTION (stats, ofStats);
+      }
+
+      else if ((p1 == "-t") || (p1 == "--trace")) {
+         PARSE_VALUE_OPTION (trace, ofTrace);
+      }
+
       else if ((p1 == "-s") || (p1 == "--shell")) {
          PARSE_FLAG_OPTION(shell, shellInterpretor, ofShell);
       }
@@ -354,6 +897,22 @@ int main (int argc, char** argv)
          PARSE_FLAG_OPTION(quiet, suppressCopyRight, ofQuiet);
       }
 
+      else if ((p1 == "-R") || (p1 == "--replace")) {
+         PARSE_FLAG_OPTION(replace, replaceOnSave, ofReplace);
+      }
+
+      else if ((p1 == "-N") || (p1 == "--no-optimize")) {
+         PARSE_FLAG_OPTION(no-optimize, noOptimize, ofNoOptimize);
+      }
+
+      else if ((p1 == "-P") || (p1 == "--profile")) {
+         PARSE_FLAG_OPTION(profile, profile, ofProfile);
+      }
+
+      else if ((p1 == "-T") || (p1 == "--timing")) {
+         PARSE_FLAG_OPTION(timing, startupTiming, ofTiming);
+      }
+
       else {
          std::cerr << "unexpected option: " << p1 << std::endl;
          help_usage (std::cerr);
@@ -399,6 +958,66 @@ int main (int argc, char** argv)
       return 1;
    }
 
+   if ( ((optionFlags & meg3) != ofNone) &&
+        ((optionFlags & meg4) != ofNone) ) {
+      std::cerr << "The shell, command and/or backup option(s) are not "
+                   "allowed with the batch option." << std::endl;
+      help_usage (std::cerr);
+      return 1;
+   }
+
+   if ( ((optionFlags & ofBatch) != ofNone) &&
+        ((optionFlags & ofTrace) != ofNone) ) {
+      std::cerr << "The trace option is not allowed with the batch option."
+                << std::endl;
+      help_usage (std::cerr);
+      return 1;
+   }
+
+   // Batch jobs: by default, one per processor.
+   //
+   long batchJobs = sysconf (_SC_NPROCESSORS_ONLN);
+   if (batchJobs < 1) batchJobs = 1;
+   if ((optionFlags & ofJobs) != ofNone) {
+      if ((optionFlags & ofBatch) == ofNone) {
+         std::cerr << "The jobs option is only allowed with the batch option."
+                   << std::endl;
+         help_usage (std::cerr);
+         return 1;
+      }
+
+      char* end = NULL;
+      batchJobs = strtol (jobs.c_str(), &end, 10);
+      if (jobs.empty() || (*end != '\0') || (batchJobs < 1) || (batchJobs > 4096)) {
+         std::cerr << "invalid jobs option value: " << jobs << std::endl;
+         help_usage (std::cerr);
+         return 1;
+      }
+   }
+
+   startupPhase ("options");
+
+   // Streaming window: -1 means decide later, 0 means no streaming.
+   //
+   int streamWindow = -1;
+   if ((optionFlags & ofWindow) != ofNone) {
+      if (!shellInterpretor) {
+         std::cerr << "The window option is only allowed with the shell option."
+                   << std::endl;
+         help_usage (std::cerr);
+         return 1;
+      }
+
+      char* end = NULL;
+      const long value = strtol (window.c_str(), &end, 10);
+      if (window.empty() || (*end != '\0') || (value < 0) || (value > 0x7FFFFFFF)) {
+         std::cerr << "invalid window option value: " << window << std::endl;
+         help_usage (std::cerr);
+         return 1;
+      }
+      streamWindow = value;
+   }
+
    if (argc < 1) {
       std::cerr << "missing argument" << std::endl;
       help_usage (std::cerr);
@@ -413,8 +1032,7 @@ int main (int argc, char** argv)
       // The first argument provides the commands
       //
       command = argv [0];
-      commandStream.open (command);
-      bool result = commandStream.is_open ();
+      bool result = readCommandFile (command);
       if (!result) {
          std::cerr << "connot open file: " << command << std::endl;
          return 4;
@@ -428,6 +1046,19 @@ int main (int argc, char** argv)
       report = "/dev/null";
       optionFlags |= ofReport;
 
+   } else if (optionFlags & ofBatch) {
+      // Batch mode - all the arguments are files to be edited, each as per
+      // -c, and the target is the source. See runBatch.
+      //
+      Global::setGetLineFunction (&getFromCommandStream);
+      command = batch;
+      bool result = readCommandFile (command);
+      if (!result) {
+         std::cerr << "connot open command file: '" << command << "' : ";
+         perror ("");
+         return 4;
+      }
+
    } else {
       // Regular commmand mode
       //
@@ -439,23 +1070,20 @@ int main (int argc, char** argv)
          target = argv [1];
       }
 
-      if ((source == target) && (source != DataBuffer::stdInOut())) {
-         // Backup source file.
-         //
-         std::ifstream  src (source,       std::ios::binary);
-         std::ofstream  bup (source + "~", std::ios::binary);
-         bup << src.rdbuf();
-      }
+      // Backup source file - see below.
+      //
+      backupPending = (source == target) && (source != DataBuffer::stdInOut());
    }
 
-   Global::setTargetFilename (target);
+   if ((optionFlags & ofBatch) == ofNone) {
+      Global::setTargetFilename (target);
+   }
 
    // Command stream processing.
    //
    if (optionFlags & ofCommand) {
       Global::setGetLineFunction (&getFromCommandStream);
-      commandStream.open (command);
-      bool result = commandStream.is_open ();
+      bool result = readCommandFile (command);
       if (!result) {
          std::cerr << "connot open command file: '" << command << "' : ";
          perror ("");
@@ -476,11 +1104,18 @@ int main (int argc, char** argv)
       }
    }
 
-   // Output the pre-amble.
+   // Statistics file - created now so that any error is reported up front.
+   // In batch mode, each file's statistics are appended by its worker.
    //
-   if (!Global::getCloseRequested () && !shellInterpretor) {
-      version (std::cerr);
-      if(!suppressCopyRight) copyright_info (std::cerr);
+   if ((optionFlags & ofStats) != ofNone) {
+      int fd = open (stats.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0) {
+         close (fd);
+      } else {
+         std::cerr << "Cannot open stats file '" << stats << "' : ";
+         perror ("");
+         return 4;
+      }
    }
 
    // Command backup
@@ -494,94 +1129,132 @@ int main (int argc, char** argv)
       }
    }
 
-   // Must call Global::setGetLineFunction before this point.
-   //
-   DataBuffer db;
-   bool status;
+   Global::setOptimize (!noOptimize);
+   Global::setProfiling (profile);
 
-   status = db.load (source);
-   if (!status) {
-      return 4;
+   if ((optionFlags & ofTrace) != ofNone) {
+      if (!Global::openTrace (trace)) {
+         return 4;
+      }
    }
 
+   // Parse the initial option command string and the command file, if any,
+   // in advance so that any errors are reported before the file is loaded.
+   //
+   CompoundCommands* optionCommands = nullptr;
    if (!option.empty()) {
-      CompoundCommands* doThis = CommandParser::parse (option);
-      if (doThis) {
-         bool status = doThis->execute (db);
+      optionCommands = CommandParser::parse (option);
+   }
 
-         if (!status) {
-            AbstractCommands* lastCommand = doThis->getLastCommand();
-            std::string image = lastCommand ? lastCommand->image() : "None";
-            std::cerr << "Command failure: " << image << std::endl;
-         }
-         delete doThis;
+   if (shellInterpretor || ((optionFlags & (ofCommand | ofBatch)) != ofNone)) {
+      if (!checkCommandFile (command, optionCommands)) {
+         deleteCheckedPrograms ();
+         delete optionCommands;
+         return 4;
       }
    }
+   startupPhase ("parse");
+
+   if ((optionFlags & ofBatch) != ofNone) {
+      BatchSettings settings;
+      settings.option = option;
+      settings.optionCommands = optionCommands;
+      settings.optimize = !noOptimize;
+      settings.profile = profile;
+      settings.replaceOnSave = replaceOnSave;
+      if ((optionFlags & ofStats) != ofNone) {
+         settings.stats = stats;
+      }
 
-   if (!Global::getCloseRequested () && !shellInterpretor) {
-      db.print (1);
+      batchRunning = true;
+      signal (SIGTERM, signalCatcher);
+      signal (SIGINT,  signalCatcher);
+
+      const std::vector<std::string> files (argv, argv + argc);
+      const int exitCode = runBatch (files, batchJobs, settings);
+      deleteCheckedPrograms ();
+      delete optionCommands;
+      return exitCode;
    }
 
-   // Moving from option parsing to actual editing.
+   // Backup the source file, unless we can defer this until the initial
+   // option commands have been executed, see endsWithAbandon.
    //
-   signal (SIGTERM, signalCatcher);
-   signal (SIGINT,  signalCatcher);
+   if (backupPending && !endsWithAbandon (option)) {
+      backupSource (source);
+      backupPending = false;
+   }
+   startupPhase ("backup");
 
-   //---------------------------------------------------------------------------
-   // Main processing read/parse/execute loop
-   //---------------------------------------------------------------------------
+   // Must call Global::setGetLineFunction before this point.
    //
-   while ((shellInterpretor || std::cin) && !Global::getCloseRequested()) {
+   Editor editor (Global::session ());
+   DataBuffer& db = editor.getBuffer ();
+   bool status;
 
-      std::string line = Global::getLine (Global::getPromptOn() ? ">" : NULL);
+   if (shellInterpretor && (streamWindow < 0)) {
+      // Not explicitly specified - stream if we can.
+      //
+      static const int defaultWindow = 1000;
+      streamWindow = isForwardOnlyScript (optionCommands) ? defaultWindow : 0;
+   }
 
-      if (backupStream.is_open()) {
-         backupStream << line << std::endl;
-      }
+   if (shellInterpretor && (streamWindow > 0)) {
+      status = db.loadStream (streamWindow);
+   } else {
+      status = db.load (source);
+   }
+   if (!status) {
+      return 4;
+   }
+   startupPhase ("load");
 
-      CompoundCommands* doThis = CommandParser::parse (line);
-      if (doThis) {
-         db.clearChanged ();   // clear the "dirty" flag.
-         Global::clearInterruptRequest();
-         Global::setExecutionInProgress();
-         bool status = doThis->execute (db);
-         Global::clearExecutionInProgress();
-         AbstractCommands* lastCommand = doThis->getLastCommand();
-         if (!status) {
-            std::string image = lastCommand ? lastCommand->image() : "None";
-            std::cerr << "Command failure: " << image << std::endl;
-         }
+   if (optionCommands) {
+      bool status = editor.run (*optionCommands);
+      if (!status) {
+         std::cerr << "Command failure: " << editor.getFailure () << std::endl;
+      }
+   }
+   startupPhase ("option");
 
-         switch (Global::getMode()) {
-            case Global::Full:
-               {
-                  // Always print line (unless last successfull command was a print).
-                  //
-                  AbstractCommands* lsc = doThis->getLastSuccessfullCommand();
-                  BasicCommands* blsc = dynamic_cast <BasicCommands*> (lsc);
+   if (backupPending && !Global::getAbandonRequested ()) {
+      backupSource (source);
+      startupPhase ("backup");
+   }
 
-                  if (!blsc || ((blsc->getKind() != BasicCommands::Print) &&
-                                (blsc->getKind() != BasicCommands::PrintBack))) {
-                     db.print (1);
-                  }
-               }
-               break;
+   // Output the pre-amble, deferred until now as not needed when the option
+   // commands close the edit session.
+   //
+   if (!Global::getCloseRequested () && !shellInterpretor) {
+      version (std::cerr);
+      if(!suppressCopyRight) copyright_info (std::cerr);
+      db.print (1);
+      startupPhase ("ready");
+   }
 
-            case Global::Quiet:
-               break;
+   // Moving from option parsing to actual editing.
+   //
+   signal (SIGTERM, signalCatcher);
+   signal (SIGINT,  signalCatcher);
 
-            case Global::Monitor:
-               if (db.hasChanged()) {
-                  db.print (1);
-               }
-         }
+   runCommandLines (editor, shellInterpretor, backupStream);
 
-         delete doThis;
-      }
+   // Unless turned off by %U0, report the profile for the whole session.
+   //
+   if (profile && Global::getProfile ()) {
+      Global::getProfile ()->report (std::cerr);
    }
 
+   // Write out the remainder of the trace, if any.
+   //
+   Global::closeTrace ();
+
    // Shutting down
    //
+   CommandParser::clearCache ();
+   deleteCheckedPrograms ();
+   delete optionCommands;
+
    if (backupStream.is_open()) {
       backupStream.close();
    }
@@ -589,18 +1262,13 @@ int main (int argc, char** argv)
    // Save if not abandoned/aborted.
    //
    if (!Global::getAbandonRequested()) {
-      status = db.save (target);
-      if (!status) {
-         std::cerr << "Attempting to save contents to an alternative file..." << std::endl;
-         std::string name = Global::getTemporaryFilename();
-         status = db.save (name);
-         if (status) {
-            Global::setExitCode (32);
-         } else {
-            Global::setExitCode (64);
-         }
-      }
+      saveBuffer (db, target, replaceOnSave);
+   }
+
+   if ((optionFlags & ofStats) != ofNone) {
+      writeStats (stats, source, db);
    }
+   startupPhase ("exit");
 
    return Global::getExitCode ();
 }
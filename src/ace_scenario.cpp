@@ -0,0 +1,682 @@
+/* ace_scenario.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+// End to end benchmark. Runs each of the scenario scripts (bench/*.ace) with
+// the ace program, in both shell (-s) and command file (-c) modes, against
+// deterministic generated input. The wall time, peak RSS and number of system
+// calls of each complete load, parse, execute and save is written to standard
+// output in JSON format, together with a checksum of the output. The output
+// is also checked against the expected output, as generated independently of
+// ace, and the exit code is 1 if any output is not as expected.
+//
+// The cold_start scenario measures start up latency, i.e. a short edit of a
+// small file, as in ace -q -o 'f/x/ s/y/ %c' small.conf. This is run ten times
+// as often as the others, as each run is so short.
+//
+// usage: ace_scenario [--lines N] [--runs N] [--scenario NAME] [--ace PATH]
+//                     [--dir PATH] [--no-syscalls]
+//
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+// Deterministic pseudo random numbers, so that the generated input is the
+// same for every run and every version.
+//
+class Random
+{
+public:
+   explicit Random (const unsigned long seed) : state (seed) { }
+
+   unsigned long next (const unsigned long range) {
+      this->state = this->state * 6364136223846793005UL + 1442695040888963407UL;
+      return (this->state >> 33) % range;
+   }
+
+private:
+   unsigned long state;
+};
+
+//------------------------------------------------------------------------------
+// Input generators - each generates lines of input.
+//
+typedef void (*Generator) (const int lines, std::string& text);
+
+static const char* const names [] = {
+   "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi"
+};
+static const int numberOfNames = sizeof (names) / sizeof (names [0]);
+
+static void generateLog (const int lines, std::string& text)
+{
+   static const char* const levels [] = { "INFO", "INFO", "WARN", "DEBUG", "ERROR" };
+   static const char* const hex = "0123456789abcdef";
+   Random random (1);
+   char line [256];
+
+   for (int j = 0; j < lines; j++) {
+      char session [17];
+      for (int k = 0; k < 16; k++) session [k] = hex [random.next (16)];
+      session [16] = '\0';
+
+      snprintf (line, sizeof (line),
+                "2026-10-19 %02d:%02d:%02d %s user=%s ip=10.%lu.%lu.%lu "
+                "session=%s msg=request %d completed in %lu ms\n",
+                (j / 3600) % 24, (j / 60) % 60, j % 60,
+                levels [random.next (5)], names [random.next (numberOfNames)],
+                random.next (256), random.next (256), random.next (256),
+                session, j, random.next (1000));
+      text.append (line);
+   }
+}
+
+static void generateCsv (const int lines, std::string& text)
+{
+   Random random (2);
+   char line [256];
+
+   text.append ("id,name,email,amount,status\n");
+   for (int j = 1; j < lines; j++) {
+      const char* name = names [random.next (numberOfNames)];
+      snprintf (line, sizeof (line), "%d,%s,%s%d@example.com,%lu.%02lu,%s\n",
+                j, name, name, j, random.next (10000), random.next (100),
+                random.next (10) == 0 ? "fail" : "ok");
+      text.append (line);
+   }
+}
+
+static void generateConfig (const int lines, std::string& text)
+{
+   static const char* const keys [] = {
+      "timeout", "host", "retries", "port", "user", "path", "level", "enabled"
+   };
+   Random random (3);
+   char line [256];
+
+   for (int j = 0; j < lines; j++) {
+      if (j % 20 == 0) {
+         snprintf (line, sizeof (line), "[section_%d]\n", j / 20);
+      } else {
+         const int k = random.next (sizeof (keys) / sizeof (keys [0]));
+         snprintf (line, sizeof (line), "%s = value_%lu\n", keys [k], random.next (100000));
+      }
+      text.append (line);
+   }
+}
+
+static void generateBulk (const int lines, std::string& text)
+{
+   Random random (4);
+   char line [256];
+
+   int block = 0;   // lines remaining in a BEGIN/END block
+   for (int j = 0; j < lines; j++) {
+      if (block == 1) {
+         snprintf (line, sizeof (line), "END\n");
+      } else if ((block == 0) && (random.next (50) == 0) && (j + 10 < lines)) {
+         block = 2 + random.next (8);
+         snprintf (line, sizeof (line), "BEGIN block %d\n", j);
+      } else if (random.next (10) == 0) {
+         snprintf (line, sizeof (line), "line %d DELETE this line\n", j);
+      } else {
+         snprintf (line, sizeof (line), "line %d keep this line, value %lu\n",
+                   j, random.next (100000));
+      }
+      if (block > 0) block--;
+      text.append (line);
+   }
+}
+
+//------------------------------------------------------------------------------
+// Expected output - each applies the edits of the corresponding scenario script
+// to the generated input using plain string operations, i.e. independently of
+// ace, so that the output of ace can be checked and not just checksummed.
+//
+typedef void (*Expected) (const std::string& input, std::string& output);
+
+// Splits text into lines, without the new lines.
+//
+static void splitLines (const std::string& text, std::vector<std::string>& lines)
+{
+   lines.clear ();
+   std::string::size_type start = 0;
+   while (start < text.length()) {
+      std::string::size_type end = text.find ('\n', start);
+      if (end == std::string::npos) end = text.length();
+      lines.push_back (text.substr (start, end - start));
+      start = end + 1;
+   }
+}
+
+static bool startsWith (const std::string& line, const char* prefix)
+{
+   return line.compare (0, strlen (prefix), prefix) == 0;
+}
+
+// Drops the DEBUG lines, masks the IP address and removes the session token.
+//
+static void expectedLog (const std::string& input, std::string& output)
+{
+   std::vector<std::string> lines;
+   splitLines (input, lines);
+
+   output.clear ();
+   for (size_t j = 0; j < lines.size(); j++) {
+      std::string line = lines [j];
+      if (line.find (" DEBUG ") != std::string::npos) continue;
+
+      const std::string::size_type ip = line.find (" ip=") + 4;
+      line.replace (ip, line.find (' ', ip) - ip, "x.x.x.x");
+
+      const std::string::size_type session = line.find (" session=");
+      line.erase (session, line.find (" msg=") - session);
+
+      output.append (line);
+      output.push_back ('\n');
+   }
+}
+
+// Drops the third column, and marks the failed rows with a leading !.
+//
+static void expectedCsv (const std::string& input, std::string& output)
+{
+   std::vector<std::string> lines;
+   splitLines (input, lines);
+
+   output.clear ();
+   for (size_t j = 0; j < lines.size(); j++) {
+      std::string line = lines [j];
+      const std::string::size_type second = line.find (',', line.find (',') + 1);
+      line.erase (second + 1, line.find (',', second + 1) - second);
+      if (line.find (",fail") != std::string::npos) line.insert (0, "!");
+
+      output.append (line);
+      output.push_back ('\n');
+   }
+}
+
+// Sets every timeout to 30 and every host to new.example.com, and renames
+// retries to attempts.
+//
+static void expectedConfig (const std::string& input, std::string& output)
+{
+   std::vector<std::string> lines;
+   splitLines (input, lines);
+
+   output.clear ();
+   for (size_t j = 0; j < lines.size(); j++) {
+      std::string line = lines [j];
+      if (startsWith (line, "timeout = ")) {
+         line = "timeout = 30";
+      } else if (startsWith (line, "host = ")) {
+         line = "host = new.example.com";
+      } else if (startsWith (line, "retries = ")) {
+         line.replace (0, 10, "attempts = ");
+      }
+
+      output.append (line);
+      output.push_back ('\n');
+   }
+}
+
+// Drops every DELETE line, and every block from BEGIN to END inclusive.
+//
+static void expectedBulk (const std::string& input, std::string& output)
+{
+   std::vector<std::string> lines;
+   splitLines (input, lines);
+
+   output.clear ();
+   bool inBlock = false;
+   for (size_t j = 0; j < lines.size(); j++) {
+      const std::string& line = lines [j];
+      if (line.find ("DELETE") != std::string::npos) continue;
+
+      if (inBlock) {
+         if (startsWith (line, "END")) inBlock = false;
+         continue;
+      }
+      if (line.find ("BEGIN") != std::string::npos) {
+         inBlock = true;
+         continue;
+      }
+
+      output.append (line);
+      output.push_back ('\n');
+   }
+}
+
+struct Scenario {
+   const char* name;   // also the script name, i.e. name.ace
+   Generator generator;
+   Expected expected;
+};
+
+static const Scenario scenarios [] = {
+   { "log_scrub",      generateLog,    expectedLog    },
+   { "csv_columns",    generateCsv,    expectedCsv    },
+   { "config_rewrite", generateConfig, expectedConfig },
+   { "bulk_delete",    generateBulk,   expectedBulk   }
+};
+
+// Cold start option strings, one per mode. The file is rewritten before
+// each run, as the close mode saves the edited file.
+//
+struct StartMode {
+   const char* mode;
+   const char* option;
+   bool saved;          // i.e. the first host is now server
+   int exitCode;        // %a exits with 2
+};
+
+static const StartMode startModes [] = {
+   { "close",   "f/host/ s/server/ %c", true,  0 },
+   { "abandon", "f/host/ s/server/ %a", false, 2 }
+};
+
+static const int startLines = 20;
+
+//------------------------------------------------------------------------------
+// The result of running ace once.
+//
+struct Measure {
+   int exitCode;
+   double wallSeconds;
+   long maxRssKb;
+   long syscalls;    // -1 when not counted
+};
+
+//------------------------------------------------------------------------------
+// Redirects the child's standard input, output and error, and executes ace.
+// Only returns on failure.
+//
+static void execAce (const std::vector<std::string>& args, const std::string& in,
+                     const std::string& out)
+{
+   const int inFd = open (in.c_str(), O_RDONLY);
+   const int outFd = open (out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   const int nullFd = open ("/dev/null", O_WRONLY);
+   if ((inFd < 0) || (outFd < 0) || (nullFd < 0)) _exit (127);
+
+   dup2 (inFd, STDIN_FILENO);
+   dup2 (outFd, STDOUT_FILENO);
+   dup2 (nullFd, STDERR_FILENO);
+
+   std::vector<char*> argv;
+   for (size_t j = 0; j < args.size(); j++) {
+      argv.push_back (const_cast<char*> (args [j].c_str()));
+   }
+   argv.push_back (nullptr);
+
+   execv (argv [0], argv.data());
+   _exit (127);
+}
+
+//------------------------------------------------------------------------------
+// Runs ace, measuring the wall time and peak RSS.
+//
+static Measure runAce (const std::vector<std::string>& args, const std::string& in,
+                       const std::string& out)
+{
+   typedef std::chrono::steady_clock Clock;
+
+   Measure result = { -1, 0.0, 0, -1 };
+
+   const Clock::time_point start = Clock::now ();
+   const pid_t pid = fork ();
+   if (pid == 0) execAce (args, in, out);
+   if (pid < 0) return result;
+
+   int status;
+   struct rusage usage;
+   if (wait4 (pid, &status, 0, &usage) != pid) return result;
+   const Clock::time_point finish = Clock::now ();
+
+   result.exitCode = WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+   result.wallSeconds = std::chrono::duration<double> (finish - start).count ();
+   result.maxRssKb = usage.ru_maxrss;
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Runs ace under ptrace, and counts the system calls made (after the exec).
+// Returns -1 if ptrace is not available.
+//
+static long countSyscalls (const std::vector<std::string>& args, const std::string& in,
+                           const std::string& out)
+{
+   const pid_t pid = fork ();
+   if (pid == 0) {
+      if (ptrace (PTRACE_TRACEME, 0, nullptr, nullptr) != 0) _exit (126);
+      raise (SIGSTOP);
+      execAce (args, in, out);
+   }
+   if (pid < 0) return -1;
+
+   int status;
+   if ((waitpid (pid, &status, 0) != pid) || !WIFSTOPPED (status)) {
+      waitpid (pid, &status, 0);
+      return -1;
+   }
+   ptrace (PTRACE_SETOPTIONS, pid, nullptr,
+           (void*) (long) (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL));
+
+   long stops = 0;
+   bool execed = false;
+   int signal = 0;
+   while (true) {
+      if (ptrace (PTRACE_SYSCALL, pid, nullptr, (void*) (long) signal) != 0) break;
+      signal = 0;
+      if (waitpid (pid, &status, 0) != pid) break;
+      if (WIFEXITED (status) || WIFSIGNALED (status)) return stops / 2;
+
+      if (WIFSTOPPED (status)) {
+         const int sig = WSTOPSIG (status);
+         if (sig == (SIGTRAP | 0x80)) {
+            if (execed) stops++;   // syscall entry or exit
+         } else if ((status >> 8) == (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
+            execed = true;
+            stops = 1;             // the exec syscall exit is still to come
+         } else if (sig != SIGSTOP) {
+            signal = sig;          // pass on genuine signals
+         }
+      }
+   }
+
+   kill (pid, SIGKILL);
+   waitpid (pid, &status, 0);
+   return -1;
+}
+
+//------------------------------------------------------------------------------
+//
+static bool writeFile (const std::string& filename, const std::string& text)
+{
+   FILE* file = fopen (filename.c_str(), "w");
+   if (!file) return false;
+   const bool result = fwrite (text.data(), 1, text.length(), file) == text.length();
+   return (fclose (file) == 0) && result;
+}
+
+//------------------------------------------------------------------------------
+//
+static bool readFile (const std::string& filename, std::string& text)
+{
+   text.clear ();
+   FILE* file = fopen (filename.c_str(), "r");
+   if (!file) return false;
+
+   char buffer [65536];
+   size_t n;
+   while ((n = fread (buffer, 1, sizeof (buffer), file)) > 0) {
+      text.append (buffer, n);
+   }
+   return fclose (file) == 0;
+}
+
+//------------------------------------------------------------------------------
+// The size and FNV-1a hash of the file, as a hex string.
+//
+static std::string checksum (const std::string& filename, long& size)
+{
+   unsigned long hash = 14695981039346656037UL;
+   size = 0;
+
+   FILE* file = fopen (filename.c_str(), "r");
+   if (file) {
+      char buffer [65536];
+      size_t n;
+      while ((n = fread (buffer, 1, sizeof (buffer), file)) > 0) {
+         for (size_t j = 0; j < n; j++) {
+            hash = (hash ^ (unsigned char) buffer [j]) * 1099511628211UL;
+         }
+         size += n;
+      }
+      fclose (file);
+   }
+
+   char image [20];
+   snprintf (image, sizeof (image), "%016lx", hash);
+   return image;
+}
+
+//------------------------------------------------------------------------------
+//
+static std::string directoryOf (const char* path)
+{
+   const std::string p = path;
+   const std::string::size_type slash = p.rfind ('/');
+   return (slash == std::string::npos) ? "." : p.substr (0, slash);
+}
+
+//------------------------------------------------------------------------------
+//
+static void usage ()
+{
+   std::cerr << "usage: ace_scenario [--lines N] [--runs N] [--scenario NAME] "
+                "[--ace PATH] [--dir PATH] [--no-syscalls]" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+int main (int argc, char** argv)
+{
+   const std::string binDir = directoryOf (argv [0]);
+
+   long lines = 100000;
+   int runs = 3;
+   bool syscalls = true;
+   std::string only;
+   std::string ace = binDir + "/ace";
+   std::string dir = binDir + "/../bench";
+
+   for (int j = 1; j < argc; j++) {
+      const std::string p1 = argv [j];
+      if (p1 == "--no-syscalls") {
+         syscalls = false;
+         continue;
+      }
+
+      if (j + 1 >= argc) {
+         usage ();
+         return 1;
+      }
+      const char* value = argv [++j];
+
+      if (p1 == "--lines") {
+         lines = atol (value);
+      } else if (p1 == "--runs") {
+         runs = atoi (value);
+      } else if (p1 == "--scenario") {
+         only = value;
+      } else if (p1 == "--ace") {
+         ace = value;
+      } else if (p1 == "--dir") {
+         dir = value;
+      } else {
+         usage ();
+         return 1;
+      }
+   }
+
+   if ((lines < 1) || (lines > INT_MAX) || (runs < 1)) {
+      usage ();
+      return 1;
+   }
+
+   char tempDir [] = "/tmp/ace_scenario_XXXXXX";
+   if (!mkdtemp (tempDir)) {
+      perror ("ace_scenario: mkdtemp");
+      return 4;
+   }
+   const std::string input = std::string (tempDir) + "/input.txt";
+   const std::string output = std::string (tempDir) + "/output.txt";
+
+   std::cout << "{\n"
+             << "  \"harness\": \"ace_scenario\",\n"
+             << "  \"ace\": \"" << ace << "\",\n"
+             << "  \"lines\": " << lines << ",\n"
+             << "  \"runs\": " << runs << ",\n"
+             << "  \"results\": [\n";
+
+   int exitCode = 0;
+   bool first = true;
+   for (size_t s = 0; s < sizeof (scenarios) / sizeof (scenarios [0]); s++) {
+      const Scenario& scenario = scenarios [s];
+      if (!only.empty() && (only != scenario.name)) continue;
+
+      const std::string script = dir + "/" + scenario.name + ".ace";
+      if (access (script.c_str(), R_OK) != 0) {
+         std::cerr << "ace_scenario: cannot read " << script << std::endl;
+         exitCode = 4;
+         continue;
+      }
+
+      std::string text;
+      scenario.generator (lines, text);
+      if (!writeFile (input, text)) {
+         perror ("ace_scenario: write input");
+         exitCode = 4;
+         break;
+      }
+
+      std::string expected;
+      scenario.expected (text, expected);
+
+      static const char* const modes [] = { "shell", "command" };
+      for (int m = 0; m < 2; m++) {
+         std::vector<std::string> args;
+         args.push_back (ace);
+         args.push_back ("-q");
+         if (m == 0) {
+            args.push_back ("-s");
+            args.push_back (script);
+         } else {
+            args.push_back ("-c");
+            args.push_back (script);
+            args.push_back (input);
+            args.push_back (output);
+         }
+         // In command mode, standard output is not used.
+         const std::string stdOut = (m == 0) ? output : "/dev/null";
+
+         // The best of the runs, as the least disturbed.
+         //
+         Measure best = runAce (args, input, stdOut);
+         for (int r = 1; r < runs; r++) {
+            const Measure next = runAce (args, input, stdOut);
+            if (next.wallSeconds < best.wallSeconds) best = next;
+         }
+         if (syscalls) best.syscalls = countSyscalls (args, input, stdOut);
+
+         long outputBytes;
+         const std::string hash = checksum (output, outputBytes);
+
+         std::string edited;
+         const bool ok = readFile (output, edited) && (edited == expected) &&
+                         (best.exitCode == 0);
+         if (!ok) {
+            std::cerr << "ace_scenario: " << scenario.name << " (" << modes [m]
+                      << "): output differs from the expected output" << std::endl;
+            exitCode = 1;
+         }
+
+         char item [512];
+         snprintf (item, sizeof (item),
+                   "%s    {\"scenario\": \"%s\", \"mode\": \"%s\", "
+                   "\"input_bytes\": %zu, \"output_bytes\": %ld, "
+                   "\"output_fnv1a\": \"%s\", \"output_ok\": %s, \"exit_code\": %d, "
+                   "\"wall_seconds\": %.6f, \"max_rss_kb\": %ld, \"syscalls\": %ld}",
+                   first ? "" : ",\n", scenario.name, modes [m],
+                   text.length(), outputBytes, hash.c_str(), ok ? "true" : "false",
+                   best.exitCode, best.wallSeconds, best.maxRssKb, best.syscalls);
+         std::cout << item << std::flush;
+         first = false;
+      }
+   }
+
+   for (size_t m = 0; m < sizeof (startModes) / sizeof (startModes [0]); m++) {
+      if (!only.empty() && (only != "cold_start")) break;
+
+      std::string text;
+      generateConfig (startLines, text);
+
+      std::vector<std::string> args;
+      args.push_back (ace);
+      args.push_back ("-q");
+      args.push_back ("-o");
+      args.push_back (startModes [m].option);
+      args.push_back (input);
+
+      Measure best = { -1, 0.0, 0, -1 };
+      for (int r = 0; r < 10 * runs; r++) {
+         if (!writeFile (input, text)) break;
+         const Measure next = runAce (args, "/dev/null", "/dev/null");
+         if ((r == 0) || (next.wallSeconds < best.wallSeconds)) best = next;
+      }
+      if (syscalls && writeFile (input, text)) {
+         best.syscalls = countSyscalls (args, "/dev/null", "/dev/null");
+      }
+
+      long outputBytes;
+      const std::string hash = checksum (input, outputBytes);
+
+      std::string expected = text;
+      if (startModes [m].saved) {
+         expected.replace (expected.find ("host"), 4, "server");
+      }
+      std::string edited;
+      const bool ok = readFile (input, edited) && (edited == expected) &&
+                      (best.exitCode == startModes [m].exitCode);
+      if (!ok) {
+         std::cerr << "ace_scenario: cold_start (" << startModes [m].mode
+                   << "): output differs from the expected output" << std::endl;
+         exitCode = 1;
+      }
+
+      char item [512];
+      snprintf (item, sizeof (item),
+                "%s    {\"scenario\": \"cold_start\", \"mode\": \"%s\", "
+                "\"input_bytes\": %zu, \"output_bytes\": %ld, "
+                "\"output_fnv1a\": \"%s\", \"output_ok\": %s, \"exit_code\": %d, "
+                "\"wall_seconds\": %.6f, \"max_rss_kb\": %ld, \"syscalls\": %ld}",
+                first ? "" : ",\n", startModes [m].mode,
+                text.length(), outputBytes, hash.c_str(), ok ? "true" : "false",
+                best.exitCode, best.wallSeconds, best.maxRssKb, best.syscalls);
+      std::cout << item << std::flush;
+      first = false;
+   }
+
+   std::cout << "\n  ]\n}" << std::endl;
+
+   unlink (input.c_str());
+   unlink ((input + "~").c_str());
+   unlink (output.c_str());
+   rmdir (tempDir);
+   return exitCode;
+}
+
+// end
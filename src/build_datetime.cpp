@@ -1,2 +1,3 @@
 #include "build_datetime.h"
 std::string build_datetime () { return "Thu 05 Feb 2026 11:07:13 UTC"; }
+std::string build_options () { return "-Wall -Werror -Wpedantic -std=gnu++17 -fPIC -O2"; }
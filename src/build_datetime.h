@@ -8,4 +8,8 @@
 
 std::string build_datetime ();
 
+// The compiler options used, e.g. to record in benchmark results.
+//
+std::string build_options ();
+
 # endif  // ACE_BUILD_DATETIME_H
@@ -49,7 +49,7 @@ static const BasicCommands::Kinds charLookup [26][3] = {
    { BC::Right,       BC::Void,           BC::RepeatSet      },
    { BC::Substitute,  BC::SubstituteBack, BC::SetCursorMark  },
    { BC::Traverse,    BC::TraverseBack,   BC::TerminalMaxSet },
-   { BC::Uncover,     BC::UncoverBack,    BC::Void           },
+   { BC::Uncover,     BC::UncoverBack,    BC::UsageProfile   },
    { BC::Verify,      BC::VerifyBack,     BC::View           },
    { BC::Write,       BC::WriteBack,      BC::Void           },
    { BC::Void,        BC::Void,           BC::DefineX        },
@@ -263,7 +263,8 @@ static const CommandSpecification commandLookup [BC::NUMBER_OF_KINDS] = {
      "Quiet monitoring mode - current line never printed after command line.",
      "None." },
    { BC::RepeatSet,       "RepeatSet",       Code,
-     "Set the repitition limit used for '*' and '0' - default is 50000.",
+     "Set the repitition limit used for '*' and '0' - default is 50000,\n"
+     "and no limit for compound command loops unless explicitly set.",
      "None." },
    { BC::SetCursorMark,   "SetCursorMark",   Txt,
      "Set the cursor indication character to first character of string.\n"
@@ -272,6 +273,11 @@ static const CommandSpecification commandLookup [BC::NUMBER_OF_KINDS] = {
    { BC::TerminalMaxSet,  "TerminalMaxSet",  Code,
      "Set the command line terminal width (min is 32) - default is 160.",
      "None." },
+   { BC::UsageProfile,    "UsageProfile",    Code,
+     "Turn on profiling, or if on, report (and reset) the number of calls,\n"
+     "successes, failures and time of each command so far - %U0 reports and\n"
+     "turns profiling off.",
+     "None." },
    { BC::View,            "View",            Code,
      "View current settings - increase value for more detail.",
      "None." },
@@ -517,6 +523,38 @@ void CommandParser::help (const std::string& item, std::ostream& stream)
    }
 }
 
+// Maximum number of cached command lines.
+//
+static const size_t cacheSize = 256;
+
+// Maximum number of optimizer rewrites kept for %V4.
+//
+static const size_t rewritesSize = 20;
+
+//==============================================================================
+// ParserState
+//==============================================================================
+//
+ParserState::ParserState ()
+{
+   this->cacheVersion = 0;
+   this->rewriteCount = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+ParserState::~ParserState ()
+{
+   for (CacheList::iterator it = this->cacheList.begin ();
+        it != this->cacheList.end (); ++it)
+   {
+      delete it->second;
+   }
+}
+
+//==============================================================================
+// CommandParser
+//==============================================================================
 //------------------------------------------------------------------------------
 //
 CommandParser::CommandParser() { }
@@ -526,102 +564,304 @@ CommandParser::CommandParser() { }
 CommandParser::~CommandParser() { }
 
 //------------------------------------------------------------------------------
+// static private
+ParserState& CommandParser::state ()
+{
+   return Global::session ().getParserState ();
+}
+
+//------------------------------------------------------------------------------
+// The macros, smart quote and optimize setting are those of the session, which
+// is made the calling thread's current session for the duration of the parse.
 //
-CompoundCommands* CommandParser::parse (const std::string commandLine)
+CompoundCommands* CommandParser::parse (const std::string& commandLine,
+                                        Session& session)
+{
+   Session& saved = Global::session ();
+   Global::setSession (&session);
+   CompoundCommands* result = CommandParser::parse (commandLine);
+   Global::setSession (&saved);
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+CompoundCommands* CommandParser::parse (const std::string& commandLine)
 {
    CompoundCommands* result = nullptr;
    int last = 0;
    int brackets = 0;
 
    // Macro replacement
-   // Replace content in the line any unquoted ('"/! etc.) X, Y and/or Z
-   // Rince and repeat to 4 times - we have three macros.
    //
-   std::string workLine = commandLine;
+   std::string workLine;
+   if (!CommandParser::expandMacros (commandLine, workLine)) {
+      Global::report () << "Recursive macro expansion - command line ignored" << std::endl;
+      return nullptr;
+   }
 
-   for (int k = 1; k <= 4; k++) {
+   // This does most of the hard parsing work.
+   //
+   result = CommandParser::parseLine (workLine, 0, last, brackets);
 
-      bool isBetweenQuotes = false;
-      char quote = '\0';
-      char prevChar = '\0';
+   if (result && (brackets > 0)) {
+      Global::report () << "Unmatched ( - line ignored" << std::endl;
+      delete result;
+      result = nullptr;
+   }
+   else if (result && (brackets < 0)) {
+      Global::report () << "Unmatched ) - line ignored" << std::endl;
+      delete result;
+      result = nullptr;
+   }
 
-      std::string::size_type ptr = 0;
-      while (ptr < workLine.length()) {
-         char x = workLine.at (ptr++);
+   return result;
+}
 
-         if (isBetweenQuotes) {
-            // We are currently quoted - all we need to worry about is the unquote.
-            //
-            if (x == quote) {
-               isBetweenQuotes = false;
-            }
+//------------------------------------------------------------------------------
+// static
+const CompoundCommands* CommandParser::compile (const std::string& commandLine)
+{
+   ParserState& state = CommandParser::state ();
 
-         } else {
-            // Not currently quoted
-            //
-            char m = toupper (x);
-            if ((prevChar != '%') && (m == 'X' || m == 'Y' || m == 'Z')) {
+   // Any cached lines may now parse differently.
+   //
+   if (state.cacheVersion != Global::getDefinitionsVersion ()) {
+      CommandParser::clearCache ();
+      state.cacheVersion = Global::getDefinitionsVersion ();
+   }
 
-               // unquoted macro call - do replacements
-               //
-               if (k >= 4) {
-                  // Forth time around the loop - we should have been
-                  // all done by the end of the 3rd loop.
-                  //
-                  std::cerr << "Recursive macro expansion - command line ignored" << std::endl;
-                  return nullptr;
-               }
+   ParserState::CacheIndex::iterator found = state.cacheIndex.find (commandLine);
+   if (found != state.cacheIndex.end ()) {
+      // Move to front - most recently used.
+      //
+      ParserState::CacheList& list = state.cacheList;
+      list.splice (list.begin (), list, found->second);
+      return found->second->second;
+   }
 
-               std::string replacement;
-               switch (m) {
-                  case 'X': replacement = Global::getMacroX(); break;
-                  case 'Y': replacement = Global::getMacroY(); break;
-                  case 'Z': replacement = Global::getMacroZ(); break;
-               }
+   // Parse failures are not cached, so that any error is reported each time.
+   //
+   CompoundCommands* result = CommandParser::parse (commandLine);
+   if (!result) return nullptr;
 
-               std::string part1 = workLine.substr (0, ptr - 1);
-               std::string part2 = workLine.substr (ptr);    // to end of line
+   if (state.cacheList.size() >= cacheSize) {
+      // Discard the least recently used.
+      //
+      ParserState::CacheItem& oldest = state.cacheList.back ();
+      state.cacheIndex.erase (oldest.first);
+      delete oldest.second;
+      state.cacheList.pop_back ();
+   }
 
-               workLine = part1 + replacement + part2;
-               ptr = ptr - 1 + replacement.length();
+   state.cacheList.push_front (ParserState::CacheItem (commandLine, result));
+   state.cacheIndex [commandLine] = state.cacheList.begin ();
 
-               if ((ptr > 0) && (ptr <= workLine.size())) {
-                  prevChar = workLine.at (ptr - 1);
-               } else {
-                  prevChar = '\0';
-               }
-            }
+   return result;
+}
 
-            else if (CommandParser::isQuote(x)) {
-               isBetweenQuotes = true;
-               quote = x;
-               prevChar = x;
+//------------------------------------------------------------------------------
+// static
+void CommandParser::clearCache ()
+{
+   ParserState& state = CommandParser::state ();
 
-            } else {
-               // Just an "ordinary" character - no need to do anything.
-               //
-               prevChar = x;
-            }
+   for (ParserState::CacheList::iterator it = state.cacheList.begin ();
+        it != state.cacheList.end (); ++it)
+   {
+      delete it->second;
+   }
+   state.cacheList.clear ();
+   state.cacheIndex.clear ();
+}
+
+//------------------------------------------------------------------------------
+// static
+void CommandParser::showRewrites (const ParserState& state,
+                                  std::ostream& stream)
+{
+   stream << "Optimizer Rewrites: " << state.rewriteCount << std::endl;
+   for (std::list <std::string>::const_iterator it = state.rewrites.begin ();
+        it != state.rewrites.end (); ++it)
+   {
+      stream << "   " << *it << std::endl;
+   }
+}
+
+//------------------------------------------------------------------------------
+// Returns the command in command line form, e.g. M3 or I/abc/, for the
+// optimizer rewrites log and the profile. Modifiers are omitted - modified
+// commands are never rewritten.
+// static
+std::string CommandParser::source (const BasicCommands* command)
+{
+   std::string result = reverseLookUp (command->getKind ());
+
+   const unsigned allowed = commandLookup [command->getKind ()].allowedArgs;
+   if (allowed & Txt) {
+      const std::string& text = command->getText ();
+      const char quote = text.find ('/') == std::string::npos ? '/' : '"';
+      result += quote + text + quote;
+   }
+
+   if (command->getNumber () != 1) {
+      result += std::to_string (command->getNumber ());
+   }
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// static
+void CommandParser::optimize (Alternatives& alt)
+{
+   if (!Global::getOptimize ()) return;
+
+   ParserState& state = CommandParser::state ();
+
+   Alternatives::iterator ai = alt.begin ();
+   while (ai != alt.end ()) {
+      Alternatives::iterator next = ai;
+      ++next;
+
+      std::string before;
+      int fused = 0;
+
+      while (next != alt.end ()) {
+         const BasicCommands* first = dynamic_cast <const BasicCommands*> (*ai);
+         const BasicCommands* second = dynamic_cast <const BasicCommands*> (*next);
+         if (!first || !second) break;
+
+         BasicCommands* combined = BasicCommands::fuse (first, second);
+         if (!combined) break;
+
+         if (fused == 0) before = CommandParser::source (first);
+         before += " " + CommandParser::source (second);
+         fused++;
+
+         delete first;
+         delete second;
+         *ai = combined;
+         next = alt.erase (next);
+      }
+
+      if (fused > 0) {
+         const BasicCommands* result = static_cast <const BasicCommands*> (*ai);
+         state.rewrites.push_back (before + " => " + CommandParser::source (result));
+         if (state.rewrites.size () > rewritesSize) {
+            state.rewrites.pop_front ();
          }
+         state.rewriteCount++;
       }
+
+      ai = next;
    }
+}
 
-   // This does most of the hard parsing work.
-   //
-   result = CommandParser::parseLine (workLine, last, brackets);
+//------------------------------------------------------------------------------
+// Replaces any unquoted ('"/! etc.) X, Y and/or Z in the line with the
+// corresponding macro body. The text substituted for a macro call is only
+// scanned, for any nested macro calls and for quotes, on the next pass, and
+// there are up to three passes, as we have three macros; a fourth pass that
+// finds a macro call implies recursion. So a macro body with an unclosed
+// quote quotes the rest of the line, but only from the next pass on.
+// The passes are run together in one scan of the line, each pass feeding the
+// next, see expandChar. A pass only starts once the previous pass has replaced
+// a macro call, as until then it would see the same text, so a line without
+// macro calls is only scanned once.
+// static
+bool CommandParser::expandMacros (const std::string& commandLine, std::string& workLine)
+{
+   static const int numberOfPasses = 4;
+
+   MacroPass passes [numberOfPasses];
+   for (int k = 0; k < numberOfPasses; k++) {
+      passes [k].active = (k == 0);
+      passes [k].isBetweenQuotes = false;
+      passes [k].quote = '\0';
+      passes [k].prevChar = '\0';
+   }
 
-   if (result && (brackets > 0)) {
-      std::cerr << "Unmatched ( - line ignored" << std::endl;
-      delete result;
-      result = nullptr;
+   workLine.clear ();
+   workLine.reserve (commandLine.length());
+
+   const std::string::size_type len = commandLine.length();
+   for (std::string::size_type ptr = 0; ptr < len; ptr++) {
+      if (!CommandParser::expandChar (passes, 0, commandLine [ptr], workLine)) {
+         return false;
+      }
    }
-   else if (result && (brackets < 0)) {
-      std::cerr << "Unmatched ) - line ignored" << std::endl;
-      delete result;
-      result = nullptr;
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Passes x, the next character of the text seen by the given pass, through
+// that and any subsequent active passes, appending the result to out.
+// static
+bool CommandParser::expandChar (MacroPass passes [], const int pass, const char x,
+                                std::string& out)
+{
+   static const int lastPass = 3;
+
+   if ((pass > lastPass) || !passes [pass].active) {
+      out.push_back (x);
+      return true;
    }
 
-   return result;
+   MacroPass& current = passes [pass];
+
+   if (current.isBetweenQuotes) {
+      // We are currently quoted - all we need to worry about is the unquote.
+      //
+      if (x == current.quote) {
+         current.isBetweenQuotes = false;
+      }
+      return CommandParser::expandChar (passes, pass + 1, x, out);
+   }
+
+   const char m = toupper (x);
+   if ((current.prevChar != '%') && (m == 'X' || m == 'Y' || m == 'Z')) {
+      // Unquoted macro call - do replacement.
+      //
+      if (pass == lastPass) {
+         // Forth time around - we should have been all done by the end
+         // of the third pass.
+         //
+         return false;
+      }
+
+      const std::string& replacement = (m == 'X') ? Global::getMacroX() :
+                                       (m == 'Y') ? Global::getMacroY() :
+                                                    Global::getMacroZ();
+
+      // The next pass has so far seen the same text as this pass.
+      //
+      MacroPass& next = passes [pass + 1];
+      if (!next.active) {
+         next = current;
+         next.active = true;
+      }
+
+      const std::string::size_type len = replacement.length();
+      for (std::string::size_type ptr = 0; ptr < len; ptr++) {
+         if (!CommandParser::expandChar (passes, pass + 1, replacement [ptr], out)) {
+            return false;
+         }
+      }
+
+      if (len > 0) {
+         current.prevChar = replacement [len - 1];
+      }
+      return true;
+   }
+
+   if (CommandParser::isQuote (x)) {
+      current.isBetweenQuotes = true;
+      current.quote = x;
+   }
+   current.prevChar = x;
+   return CommandParser::expandChar (passes, pass + 1, x, out);
 }
 
 //------------------------------------------------------------------------------
@@ -637,9 +877,11 @@ CompoundCommands* CommandParser::parse (const std::string commandLine)
 
 
 //------------------------------------------------------------------------------
-// Note: this is called recusively for compound commands.
+// Note: this is called recusively for compound commands, in which case offset
+// is the position of the compound command's text within the whole line.
 // private
-CompoundCommands* CommandParser::parseLine (const std::string commandLine,
+CompoundCommands* CommandParser::parseLine (const std::string& commandLine,
+                                            const int offset,
                                             int& last, int& brackets)
 {
    CompoundCommands* result = nullptr;
@@ -665,7 +907,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
          std::string subLine = commandLine.substr (ptr);
          int relative;
 
-         command = CommandParser::parseLine (subLine, relative, brackets);
+         command = CommandParser::parseLine (subLine, offset + ptr, relative, brackets);
          if (!command) {
             clearSequence (seq);
             return nullptr;
@@ -676,6 +918,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
       }
 
       else if (x == ',') {
+         CommandParser::optimize (alt);
          seq.push_back (alt);
          alt.clear();
       }
@@ -693,7 +936,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
          const int temp = GET_INT();  // only non -ve numbers are read.
 
          if (temp == magicOverflow) {
-            std::cerr << "Repeat overflow (...)" << std::endl;
+            Global::report () << "Repeat overflow (...)" << std::endl;
             clearSequence (seq);
             return nullptr;
          }
@@ -714,6 +957,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
          }
 
          last = ptr;  // update where we got to.
+         CommandParser::optimize (alt);
          seq.push_back (alt);
 
          result = new CompoundCommands (seq, repeats, modifier);
@@ -723,6 +967,8 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
       else if ((x == '%') || (x >= 'A' && x <= 'Z')) {
          // Allow commands are A, A- and %A.
 
+         const int column = offset + ptr;   // from 1, as x already read
+
          std::string name;
          CommandKind col = Forward;   // default
 
@@ -781,7 +1027,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
                   const int temp = GET_INT ();
 
                   if (temp == magicOverflow) {
-                     std::cerr << "Search limit integer overflow " << name << std::endl;
+                     Global::report () << "Search limit integer overflow " << name << std::endl;
                      clearSequence (seq);
                      return nullptr;
                   }
@@ -802,7 +1048,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
                      bool okay;
                      text = GET_STR(okay);
                      if (!okay) {
-                        std::cerr << "Missing string " << name << std::endl;
+                        Global::report () << "Missing string " << name << std::endl;
                         clearSequence (seq);
                         return nullptr;
                      }
@@ -818,7 +1064,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
                if (allowed & Rep) {
                    temp = GET_INT ();  // only non -ve numbers are read.
                    if (temp == magicOverflow) {
-                      std::cerr << "Repeat integer overflow " << name << std::endl;
+                      Global::report () << "Repeat integer overflow " << name << std::endl;
                       clearSequence (seq);
                       return nullptr;
                    }
@@ -840,23 +1086,24 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
                   modifier = GET_MOD();
                }
 
-               command = new BasicCommands (kind, modifier, limit, repeats, text, useLastText);
+               command = new BasicCommands (kind, modifier, limit, repeats, text,
+                                             useLastText, column);
                alt.push_back (command);
 
             } else {
-               std::cerr << "Unknown command: " << name << " line ignored" << std::endl;
+               Global::report () << "Unknown command: " << name << " line ignored" << std::endl;
                clearSequence (seq);
                return nullptr;
             }
 
          } else {
-            std::cerr << "Unknown command: " << name << " line ignored" << std::endl;
+            Global::report () << "Unknown command: " << name << " line ignored" << std::endl;
             clearSequence (seq);
             return nullptr;
          }
 
       } else {
-         std::cerr << "Unknown command: " << x << " line ignored" << std::endl;
+         Global::report () << "Unknown command: " << x << " line ignored" << std::endl;
          clearSequence (seq);
          return nullptr;
       }
@@ -864,6 +1111,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
 
    last = ptr;
 
+   CommandParser::optimize (alt);
    seq.push_back (alt);
    alt.clear();
 
@@ -873,7 +1121,7 @@ CompoundCommands* CommandParser::parseLine (const std::string commandLine,
 
 //------------------------------------------------------------------------------
 // static
-char CommandParser::nextChar (const std::string commandLine, const int ptr)
+char CommandParser::nextChar (const std::string& commandLine, const int ptr)
 {
    const int len = commandLine.length();
    return (ptr < len) ? commandLine.at (ptr) : '\0';
@@ -881,7 +1129,7 @@ char CommandParser::nextChar (const std::string commandLine, const int ptr)
 
 //------------------------------------------------------------------------------
 // static
-char CommandParser::readChar (const std::string commandLine, int& ptr)
+char CommandParser::readChar (const std::string& commandLine, int& ptr)
 {
    const char x = nextChar (commandLine, ptr);
    ptr++;
@@ -890,7 +1138,7 @@ char CommandParser::readChar (const std::string commandLine, int& ptr)
 
 //------------------------------------------------------------------------------
 // static
-void CommandParser::skipSpaces (const std::string commandLine, int& ptr)
+void CommandParser::skipSpaces (const std::string& commandLine, int& ptr)
 {
    char n;
    n = nextChar (commandLine, ptr);
@@ -902,7 +1150,7 @@ void CommandParser::skipSpaces (const std::string commandLine, int& ptr)
 
 //------------------------------------------------------------------------------
 // static
-int CommandParser::getInt (const std::string commandLine, int& ptr)
+int CommandParser::getInt (const std::string& commandLine, int& ptr)
 {
    int result = magicNoInt;
    char x;
@@ -988,7 +1236,7 @@ static int hexPairToInt (const char h1, const char h2)
 //------------------------------------------------------------------------------
 // static
 std::string
-CommandParser::getStr (const std::string commandLine, int& ptr, bool& okay)
+CommandParser::getStr (const std::string& commandLine, int& ptr, bool& okay)
 {
    std::string result;
    okay = false;
@@ -1055,7 +1303,7 @@ CommandParser::getStr (const std::string commandLine, int& ptr, bool& okay)
 //------------------------------------------------------------------------------
 // static
 AbstractCommands::Modifiers
-CommandParser::getMod (const std::string commandLine, int& ptr)
+CommandParser::getMod (const std::string& commandLine, int& ptr)
 {
    AbstractCommands::Modifiers result = AbstractCommands::Normal;
 
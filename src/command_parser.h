@@ -13,10 +13,48 @@
 #define ACE_COMMAND_PARSER_H
 
 #include <iostream>
+#include <list>
 #include <string>
+#include <unordered_map>
 #include "commands.h"
 
-// All function (currently) static.
+// The parser's state for one session, i.e. the prepared macros, the parsed
+// command line cache and the optimizer rewrites log. Each session has its own
+// (see Session::getParserState), so parsing on different threads, each with
+// its own session, shares no parser state.
+//
+class ParserState
+{
+public:
+   explicit ParserState ();
+   ~ParserState ();       // deletes the cached commands
+
+private:
+   // Don't allow copying.
+   //
+   explicit ParserState (const ParserState&);
+   ParserState& operator= (const ParserState&);
+
+   // Parsed command line cache - most recently used at the front.
+   //
+   typedef std::pair <std::string, CompoundCommands*> CacheItem;
+   typedef std::list <CacheItem> CacheList;
+   typedef std::unordered_map <std::string, CacheList::iterator> CacheIndex;
+
+   CacheList cacheList;
+   CacheIndex cacheIndex;
+   int cacheVersion;          // session definitions version when cached
+
+   // Optimizer rewrites log - most recent at the back.
+   //
+   std::list <std::string> rewrites;
+   int rewriteCount;
+
+   friend class CommandParser;
+};
+
+// All function (currently) static. The state used is that of the current
+// session (see Global::session).
 // Make it a namespace ?
 //
 class CommandParser
@@ -36,7 +74,32 @@ public:
    // Returned object must be deleted to avoid memory loss.
    // Make static ??
    //
-   static CompoundCommands* parse (const std::string commandLine);
+   static CompoundCommands* parse (const std::string& commandLine);
+
+   // As above, but using the given session's definitions, as opposed to those
+   // of the current session (see Global::session).
+   //
+   static CompoundCommands* parse (const std::string& commandLine,
+                                   Session& session);
+
+   // Cached alternative to parse. Command lines tend to recur, so the most
+   // recently used parsed lines are kept, keyed by the command line text.
+   // The cache is cleared when a macro or the smart quote is redefined.
+   // Returns nullptr on parse failure. The returned object is owned by the
+   // session's cache, and remains valid until the next call to compile or
+   // clearCache with the same session, or until the session is deleted.
+   //
+   static const CompoundCommands* compile (const std::string& commandLine);
+   static void clearCache ();
+
+   // Outputs the most recent optimizer rewrites (see optimize), for %V4.
+   //
+   static void showRewrites (const ParserState& state, std::ostream& stream);
+
+   // Returns the command in command line form, e.g. M3 or I/abc/, as used
+   // for the optimizer rewrites log and the profile report.
+   //
+   static std::string source (const BasicCommands* command);
 
 private:
    // Don't allow a CommandParser object to be constructed.
@@ -46,19 +109,43 @@ private:
 
    // Returns nullptr on parse failure.
    //
-   static CompoundCommands* parseLine (const std::string commandLine,
+   static CompoundCommands* parseLine (const std::string& commandLine,
+                                       const int offset,
                                        int& last, int& brackets);
 
-   static char nextChar      (const std::string commandLine, const int ptr);
-   static char readChar      (const std::string commandLine, int& ptr);
-   static void skipSpaces    (const std::string commandLine, int& ptr);
-   static int  getInt        (const std::string commandLine, int& ptr);
+   static char nextChar      (const std::string& commandLine, const int ptr);
+   static char readChar      (const std::string& commandLine, int& ptr);
+   static void skipSpaces    (const std::string& commandLine, int& ptr);
+   static int  getInt        (const std::string& commandLine, int& ptr);
    static bool isQuote       (const char x);
    static bool isSmartQuote  (const char x);
-   static std::string getStr (const std::string commandLine, int& ptr, bool& okay);
-   static AbstractCommands::Modifiers getMod (const std::string commandLine, int& ptr);
+   static std::string getStr (const std::string& commandLine, int& ptr, bool& okay);
+   static AbstractCommands::Modifiers getMod (const std::string& commandLine, int& ptr);
+
+   // Peephole optimizer, applied to each alternative command sequence as it
+   // is parsed. Fuses runs of adjacent compatible basic commands, e.g. M M M
+   // becomes M3, see BasicCommands::fuse. Does nothing when optimize is off.
+   //
+   static void optimize (Alternatives& alt);
+
+   // Macro expansion. Returns false on recursive macro expansion.
+   //
+   struct MacroPass {
+      bool active;            // first pass, or the previous pass has replaced a call
+      bool isBetweenQuotes;
+      char quote;
+      char prevChar;
+   };
+
+   static bool expandMacros (const std::string& commandLine, std::string& workLine);
+   static bool expandChar (MacroPass passes [], const int pass, const char x,
+                           std::string& out);
+
+   // The current session's parser state.
+   //
+   static ParserState& state ();
 
-   friend class Global;
+   friend class Session;
 };
 
 #endif // ACE_COMMAND_PARSER_H
@@ -13,6 +13,10 @@
 #include "command_parser.h"
 #include "data_buffer.h"
 #include "global.h"
+#include "profile.h"
+#include "trace_log.h"
+#include <chrono>
+#include <climits>
 #include <iostream>
 
 //==============================================================================
@@ -37,6 +41,20 @@ std::string AbstractCommands::image () const
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+int AbstractCommands::getNumber () const
+{
+   return this->number;
+}
+
+//------------------------------------------------------------------------------
+//
+AbstractCommands::Modifiers AbstractCommands::getModifier () const
+{
+   return this->modifier;
+}
+
 //------------------------------------------------------------------------------
 //
 bool AbstractCommands::twizzle (const bool status) const
@@ -71,12 +89,33 @@ bool AbstractCommands::twizzle (const bool status) const
 //
 BasicCommands::BasicCommands (const Kinds kindIn, const Modifiers modifierIn,
                               const int limitIn, const int numberIn,
-                              const std::string textIn, const bool useLastTextIn) :
+                              const std::string textIn, const bool useLastTextIn,
+                              const int columnIn) :
    AbstractCommands (numberIn, modifierIn),
    kind (kindIn),
    limit (limitIn),
    useLastText (useLastTextIn),
-   text (textIn)
+   text (textIn),
+   headSize (textIn.length()),
+   tailSize (textIn.length()),
+   column (columnIn),
+   kernel (kernelOf (kindIn))
+{ }
+
+//------------------------------------------------------------------------------
+// private
+BasicCommands::BasicCommands (const std::string textIn,
+                              const size_t headSizeIn, const size_t tailSizeIn,
+                              const int columnIn) :
+   AbstractCommands (1, Normal),
+   kind (Insert),
+   limit (1),
+   useLastText (false),
+   text (textIn),
+   headSize (headSizeIn),
+   tailSize (tailSizeIn),
+   column (columnIn),
+   kernel (kernelOf (Insert))
 { }
 
 //------------------------------------------------------------------------------
@@ -90,6 +129,24 @@ BasicCommands::Kinds BasicCommands::getKind() const {
    return this->kind;
 }
 
+//------------------------------------------------------------------------------
+//
+const std::string& BasicCommands::getText () const {
+   return this->text;
+}
+
+//------------------------------------------------------------------------------
+//
+int BasicCommands::getColumn () const {
+   return this->column;
+}
+
+//------------------------------------------------------------------------------
+//
+BasicCommands::Kernel BasicCommands::getKernel () const {
+   return this->kernel;
+}
+
 //------------------------------------------------------------------------------
 // override
 std::string BasicCommands::image () const
@@ -102,7 +159,6 @@ std::string BasicCommands::image () const
       case Connect:
       case DeleteText:
       case Find:
-      case Insert:
       case Output:
       case Substitute:
       case Traverse:
@@ -115,7 +171,17 @@ std::string BasicCommands::image () const
       case TraverseBack:
       case UncoverBack:
       case VerifyBack:
-         result = CommandParser::name (this->kind) + " '" + this->useText + "'";
+         result = CommandParser::name (this->kind) + " '" + this->usedText (Global::session ()) + "'";
+         break;
+
+      // A fused insert can only fail as the first of the original inserts.
+      //
+      case Insert:
+         if (this->isFusedInsert ()) {
+            result = CommandParser::name (this->kind) + " '" + this->text.substr (0, this->headSize) + "'";
+         } else {
+            result = CommandParser::name (this->kind) + " '" + this->usedText (Global::session ()) + "'";
+         }
          break;
 
       // Everything else
@@ -129,230 +195,484 @@ std::string BasicCommands::image () const
 }
 
 //------------------------------------------------------------------------------
+// Returns the text used by the most recent execution of this command. If the
+// command used the last search/modify/filename text, then that is still the
+// current value if this was the last command executed.
 //
-bool BasicCommands::execute (DataBuffer& db)
+const std::string& BasicCommands::usedText (const Session& session) const
 {
-   bool result = false;
-
-   // Zero implies the current extended search limit.
-   const int useLimit  = this->limit    == 0     ? Global::getSearchMax() : this->limit;
-   const int useRepeat = this->modifier == AMTAP ? Global::getRepeatMax() : this->number;
+   if (!this->useLastText) return this->text;
 
    switch (this->kind) {
-      case Absorbe:
-         result = db.absorbe (useRepeat);
-         break;
-
-      case BreakLine:
-         result = db.breakLine (useRepeat);
-         break;
-
       case Connect:
-         this->useText = this->useLastText ? Global::getLastFilename() : this->text;
-         Global::setLastFilename (this->useText);
-         result = db.connect (useText);
-         break;
+      case Output:
+         return session.getLastFilename();
 
-      case DeleteText:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.deleteText (useLimit, useText, useRepeat);
-         break;
+      case Insert:
+      case InsertBack:
+      case Substitute:
+      case SubstituteBack:
+         return session.getLastModify();
 
-      case Erase:
-         result = db.erase (useRepeat);
-         break;
+      default:
+         return session.getLastSearch();
+   }
+}
 
-      case Find:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.find (useLimit, useText, useRepeat);
-         break;
+//------------------------------------------------------------------------------
+//
+bool BasicCommands::isFusedInsert () const
+{
+   return (this->headSize != this->text.length()) ||
+          (this->tailSize != this->text.length());
+}
 
+//------------------------------------------------------------------------------
+// override
+bool BasicCommands::isForwardOnly () const
+{
+   bool result;
+
+   switch (this->kind) {
+      // These either move back (more than within the current line),
+      // read the command stream, change how subsequent command lines are
+      // parsed, or discard the edit session's output.
+      //
       case Get:
-         result = db.get (useRepeat);
+      case AbsorbeBack:
+      case BreakLineBack:
+      case DeleteBack:
+      case FindBack:
+      case GetBack:
+      case JoinBack:
+      case KillBack:
+      case MoveBack:
+      case PrintBack:
+      case TraverseBack:
+      case UncoverBack:
+      case WriteBack:
+      case Abandon:
+      case DelimiterSmart:
+      case Intermediate:
+      case DefineX:
+      case DefineY:
+      case DefineZ:
+         result = false;
          break;
 
-      case UpperCase:
-         result = db.upperCase (useRepeat);
+      default:
+         result = true;
          break;
+   }
 
-      case Insert:
-         this->useText = this->useLastText ? Global::getLastModify() : this->text;
-         Global::setLastModify (this->useText);
-         result = db.insert (useText, useRepeat);
-         break;
+   return result;
+}
 
-      case Join:
-         result = db.join (useRepeat);
-         break;
+//------------------------------------------------------------------------------
+// override
+bool BasicCommands::isDynamic () const
+{
+   bool result;
 
-      case Kill:
-         result = db.kill (useRepeat);
+   switch (this->kind) {
+      case Get:
+      case GetBack:
+      case DelimiterSmart:
+      case DefineX:
+      case DefineY:
+      case DefineZ:
+         result = true;
          break;
 
-      case Left:
-         result = db.left (useRepeat);
+      default:
+         result = false;
          break;
+   }
 
-      case Move:
-         result = db.move (useRepeat);
-         break;
+   return result;
+}
 
-      case Now:
-         result = db.now (useRepeat);
-         break;
+//------------------------------------------------------------------------------
+// override
+bool BasicCommands::isExternal () const
+{
+   bool result;
 
+   switch (this->kind) {
+      case Connect:
       case Output:
-         this->useText = this->useLastText ? Global::getLastFilename() : this->text;
-         Global::setLastFilename (this->useText);
-         result = db.output (useText);
+      case Get:
+      case GetBack:
+      case Now:
+      case NowBack:
+      case Backup:
+      case Intermediate:
+         result = true;
          break;
 
-      case Print:
-         result = db.print (useRepeat);
+      default:
+         result = false;
          break;
+   }
 
-      case Quary:
-         result = db.quary (useRepeat);
-         break;
+   return result;
+}
 
-      case Right:
-         result = db.right (useRepeat);
-         break;
+//------------------------------------------------------------------------------
+// The kernel for the buffer (editing) command kind K, i.e. execute specialised
+// for one kind. Only instantiated via kernelOf.
+// private static
+template <BasicCommands::Kinds K>
+bool BasicCommands::run (const BasicCommands& command, DataBuffer& db)
+{
+   Session& session = db.getSession ();
+   bool result = false;
 
-      case Substitute:
-         this->useText = this->useLastText ? Global::getLastModify() : this->text;
-         Global::setLastModify (this->useText);
-         result = db.substitute (useText, useRepeat);
-         break;
+   // The actual text used for search, modify or filename - not copied.
+   //
+   const std::string& useText = command.usedText (session);
 
-      case Traverse:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.traverse (useLimit, useText, useRepeat);
-         break;
+   // Zero implies the current extended search limit.
+   const int useLimit  = command.limit    == 0     ? session.getSearchMax() : command.limit;
+
+   // Unless a repeat limit has been explicitly set, * commands are repeated,
+   // in batches of the default limit, until a batch fails or leaves both the
+   // contents and the cursor unchanged, as for compound command loops.
+   // Print and write act on the current line and then move, so a second batch
+   // would repeat the last line - these run to the end of the buffer in one.
+   // Insert, break and now can neither fail nor stop changing the contents,
+   // so these keep the default limit. The loop also stops on an interrupt.
+   //
+   const bool amtap = (command.modifier == AMTAP);
+   const bool unlimited = amtap && !session.isRepeatMaxSet ();
+   const bool listing = (K == Print) || (K == PrintBack) || (K == Write) || (K == WriteBack);
+   const bool endless = (K == Insert) || (K == InsertBack) || (K == BreakLine) ||
+                        (K == BreakLineBack) || (K == Now) || (K == NowBack);
+   const bool batched = unlimited && !listing && !endless;
+
+   int useRepeat = command.number;
+   if (unlimited && listing) {
+      useRepeat = INT_MAX;
+   } else if (amtap) {
+      useRepeat = session.getRepeatMax();
+   }
 
-      case Uncover:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.uncover (useLimit, useText, useRepeat);
-         break;
+   DataBuffer::Position before;
+   do {
+      // When streaming, allow lines well behind the cursor to be discarded.
+      //
+      db.retire ();
+      before = db.getPosition ();
+
+      switch (K) {
+         case Absorbe:
+            result = db.absorbe (useRepeat);
+            break;
+
+         case BreakLine:
+            result = db.breakLine (useRepeat);
+            break;
+
+         case Connect:
+            session.setLastFilename (useText);
+            result = db.connect (useText);
+            break;
+
+         case DeleteText:
+            session.setLastSearch (useText);
+            result = db.deleteText (useLimit, useText, useRepeat);
+            break;
+
+         case Erase:
+            result = db.erase (useRepeat);
+            break;
+
+         case Find:
+            session.setLastSearch (useText);
+            result = db.find (useLimit, useText, useRepeat);
+            break;
+
+         case UpperCase:
+            result = db.upperCase (useRepeat);
+            break;
+
+         case Insert:
+            session.setLastModify (useText);
+            result = db.insert (useText, useRepeat);
+
+            // A fused insert only fails if the first of the original inserts
+            // would have failed.
+            //
+            if (command.isFusedInsert ()) {
+               const std::string_view inserted (useText);
+               if (result) {
+                  session.setLastModify (inserted.substr (inserted.length() - command.tailSize));
+               } else {
+                  session.setLastModify (inserted.substr (0, command.headSize));
+               }
+            }
+            break;
+
+         case Join:
+            result = db.join (useRepeat);
+            break;
+
+         case Kill:
+            result = db.kill (useRepeat);
+            break;
+
+         case Left:
+            result = db.left (useRepeat);
+            break;
+
+         case Move:
+            result = db.move (useRepeat);
+            break;
+
+         case Now:
+            result = db.now (useRepeat);
+            break;
+
+         case Output:
+            session.setLastFilename (useText);
+            result = db.output (useText);
+            break;
+
+         case Print:
+            result = db.print (useRepeat);
+            break;
+
+         case Quary:
+            result = db.quary (useRepeat);
+            break;
+
+         case Right:
+            result = db.right (useRepeat);
+            break;
+
+         case Substitute:
+            session.setLastModify (useText);
+            result = db.substitute (useText, useRepeat);
+            break;
+
+         case Traverse:
+            session.setLastSearch (useText);
+            result = db.traverse (useLimit, useText, useRepeat);
+            break;
+
+         case Uncover:
+            session.setLastSearch (useText);
+            result = db.uncover (useLimit, useText, useRepeat);
+            break;
+
+         case Verify:
+            session.setLastSearch (useText);
+            result = db.verify (useText);
+            break;
+
+         case Write:
+            result = db.write (useRepeat);
+            break;
+
+
+            /// Reverse/backwards X- commands
+            ///
+         case AbsorbeBack:
+            result = db.absorbeBack (useRepeat);
+            break;
+
+         case BreakLineBack:
+            result = db.breakLineBack (useRepeat);
+            break;
+
+         case DeleteBack:
+            session.setLastSearch (useText);
+            result = db.deleteBack (useLimit, useText, useRepeat);
+            break;
+
+         case EraseBack:
+            result = db.eraseBack (useRepeat);
+            break;
+
+         case FindBack:
+            session.setLastSearch (useText);
+            result = db.findBack (useLimit, useText, useRepeat);
+            break;
+
+         case LowerCase:
+            result = db.lowerCase (useRepeat);
+            break;
+
+         case InsertBack:
+            session.setLastModify (useText);
+            result = db.insertBack (useText, useRepeat);
+            break;
+
+         case JoinBack:
+            result = db.joinBack (useRepeat);
+            break;
+
+         case KillBack:
+            result = db.killBack (useRepeat);
+            break;
+
+         case MoveBack:
+            result = db.moveBack (useRepeat);
+            break;
+
+         case NowBack:
+            result = db.nowBack (useRepeat);
+            break;
+
+         case PrintBack:
+            result = db.printBack (useRepeat);
+            break;
+
+         case QuaryBack:
+            result = db.quaryBack (useRepeat);
+            break;
+
+         case SubstituteBack:
+            session.setLastModify (useText);
+            result = db.substituteBack (useText, useRepeat);
+            break;
+
+         case TraverseBack:
+            session.setLastSearch (useText);
+            result = db.traverseBack (useLimit, useText, useRepeat);
+            break;
+
+         case UncoverBack:
+            session.setLastSearch (useText);
+            result = db.uncoverBack (useLimit, useText, useRepeat);
+            break;
+
+         case VerifyBack:
+            session.setLastSearch (useText);
+            result = db.verifyBack (useText);
+            break;
+
+         case WriteBack:
+            result = db.writeBack (useRepeat);
+            break;
+
+         default:
+            break;
+      }
+   } while (batched && result && !(db.getPosition () == before) &&
+            !session.getInterruptRequest ());
 
-      case Verify:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.verify (useText);
-         break;
+   // Adjust status for no fail or invert if needs be.
+   //
+   result = command.twizzle (result);
+   return result;
+}
 
-      case Write:
-         result = db.write (useRepeat);
-         break;
+//------------------------------------------------------------------------------
+// Returns the kernel for the kind, or nullptr for the special commands and
+// those that read the command input.
+// private static
+BasicCommands::Kernel BasicCommands::kernelOf (const Kinds kind)
+{
+   Kernel result = nullptr;
+
+   switch (kind) {
+      case Absorbe:         result = &BasicCommands::run <Absorbe>; break;
+      case BreakLine:       result = &BasicCommands::run <BreakLine>; break;
+      case Connect:         result = &BasicCommands::run <Connect>; break;
+      case DeleteText:      result = &BasicCommands::run <DeleteText>; break;
+      case Erase:           result = &BasicCommands::run <Erase>; break;
+      case Find:            result = &BasicCommands::run <Find>; break;
+      case UpperCase:       result = &BasicCommands::run <UpperCase>; break;
+      case Insert:          result = &BasicCommands::run <Insert>; break;
+      case Join:            result = &BasicCommands::run <Join>; break;
+      case Kill:            result = &BasicCommands::run <Kill>; break;
+      case Left:            result = &BasicCommands::run <Left>; break;
+      case Move:            result = &BasicCommands::run <Move>; break;
+      case Now:             result = &BasicCommands::run <Now>; break;
+      case Output:          result = &BasicCommands::run <Output>; break;
+      case Print:           result = &BasicCommands::run <Print>; break;
+      case Quary:           result = &BasicCommands::run <Quary>; break;
+      case Right:           result = &BasicCommands::run <Right>; break;
+      case Substitute:      result = &BasicCommands::run <Substitute>; break;
+      case Traverse:        result = &BasicCommands::run <Traverse>; break;
+      case Uncover:         result = &BasicCommands::run <Uncover>; break;
+      case Verify:          result = &BasicCommands::run <Verify>; break;
+      case Write:           result = &BasicCommands::run <Write>; break;
+      case AbsorbeBack:     result = &BasicCommands::run <AbsorbeBack>; break;
+      case BreakLineBack:   result = &BasicCommands::run <BreakLineBack>; break;
+      case DeleteBack:      result = &BasicCommands::run <DeleteBack>; break;
+      case EraseBack:       result = &BasicCommands::run <EraseBack>; break;
+      case FindBack:        result = &BasicCommands::run <FindBack>; break;
+      case LowerCase:       result = &BasicCommands::run <LowerCase>; break;
+      case InsertBack:      result = &BasicCommands::run <InsertBack>; break;
+      case JoinBack:        result = &BasicCommands::run <JoinBack>; break;
+      case KillBack:        result = &BasicCommands::run <KillBack>; break;
+      case MoveBack:        result = &BasicCommands::run <MoveBack>; break;
+      case NowBack:         result = &BasicCommands::run <NowBack>; break;
+      case PrintBack:       result = &BasicCommands::run <PrintBack>; break;
+      case QuaryBack:       result = &BasicCommands::run <QuaryBack>; break;
+      case SubstituteBack:  result = &BasicCommands::run <SubstituteBack>; break;
+      case TraverseBack:    result = &BasicCommands::run <TraverseBack>; break;
+      case UncoverBack:     result = &BasicCommands::run <UncoverBack>; break;
+      case VerifyBack:      result = &BasicCommands::run <VerifyBack>; break;
+      case WriteBack:       result = &BasicCommands::run <WriteBack>; break;
+      default:              result = nullptr; break;
+   }
 
+   return result;
+}
 
-         /// Reverse/backwards X- commands
-         ///
-      case AbsorbeBack:
-         result = db.absorbeBack (useRepeat);
-         break;
+//------------------------------------------------------------------------------
+//
+bool BasicCommands::execute (DataBuffer& db, ExecutionState&) const
+{
+   // Most commands have a pre-bound kernel.
+   //
+   if (this->kernel) return this->kernel (*this, db);
 
-      case BreakLineBack:
-         result = db.breakLineBack (useRepeat);
-         break;
+   Session& session = db.getSession ();
+   bool result = false;
 
-      case DeleteBack:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.deleteBack (useLimit, useText, useRepeat);
-         break;
+   // When streaming, allow lines well behind the cursor to be discarded.
+   //
+   db.retire ();
 
-      case EraseBack:
-         result = db.eraseBack (useRepeat);
-         break;
+   // As for the kernels, unless a repeat limit has been explicitly set, *
+   // commands are repeated in batches until a batch fails or has no effect.
+   //
+   const int useRepeat = this->modifier == AMTAP ? session.getRepeatMax() : this->number;
+   const bool unlimited = (this->modifier == AMTAP) && !session.isRepeatMaxSet ();
+   DataBuffer::Position before;
 
-      case FindBack:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.findBack (useLimit, useText, useRepeat);
+   switch (this->kind) {
+      // These read the command input, which may terminate the session.
+      //
+      case Get:
+         do {
+            before = db.getPosition ();
+            result = db.get (useRepeat);
+         } while (unlimited && result && !(db.getPosition () == before));
          break;
 
       case GetBack:
-         result = db.getBack (useRepeat);
-         break;
-
-      case LowerCase:
-         result = db.lowerCase (useRepeat);
-         break;
-
-      case InsertBack:
-         this->useText = this->useLastText ? Global::getLastModify() : this->text;
-         Global::setLastModify (this->useText);
-         result = db.insertBack (useText, useRepeat);
-         break;
-
-      case JoinBack:
-         result = db.joinBack (useRepeat);
-         break;
-
-      case KillBack:
-         result = db.killBack (useRepeat);
-         break;
-
-      case MoveBack:
-         result = db.moveBack (useRepeat);
-         break;
-
-      case NowBack:
-         result = db.nowBack (useRepeat);
-         break;
-
-      case PrintBack:
-         result = db.printBack (useRepeat);
-         break;
-
-      case QuaryBack:
-         result = db.quaryBack (useRepeat);
-         break;
-
-      case SubstituteBack:
-         this->useText = this->useLastText ? Global::getLastModify() : this->text;
-         Global::setLastModify (this->useText);
-         result = db.substituteBack (useText, useRepeat);
-         break;
-
-      case TraverseBack:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.traverseBack (useLimit, useText, useRepeat);
-         break;
-
-      case UncoverBack:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.uncoverBack (useLimit, useText, useRepeat);
-         break;
-
-      case VerifyBack:
-         this->useText = this->useLastText ? Global::getLastSearch() : this->text;
-         Global::setLastSearch (this->useText);
-         result = db.verifyBack (useText);
-         break;
-
-      case WriteBack:
-         result = db.writeBack (useRepeat);
+         do {
+            before = db.getPosition ();
+            result = db.getBack (useRepeat);
+         } while (unlimited && result && !(db.getPosition () == before));
          break;
 
 
          /// Special commands
          ///
       case Abandon:
-         Global::requestAbandon (this->limit);
+         session.requestAbandon (this->limit);
          result = true;
          break;
 
       case Backup:
-         if (Global::getTargetFilename() != DataBuffer::stdInOut()){
-            result = db.save(Global::getTargetFilename());
+         if (session.getTargetFilename() != DataBuffer::stdInOut()){
+            result = db.save(session.getTargetFilename());
          } else {
             // We can't backup to target in shell mode, or when writing directly
             // to standard out.
@@ -361,25 +681,25 @@ bool BasicCommands::execute (DataBuffer& db)
          break;
 
       case Close:
-         Global::requestClose (this->limit);
+         session.requestClose (this->limit);
          result = true;
          break;
 
       case DelimiterSmart:
-         result = Global::setSmartQuote (text.length() > 0 ? text[0] : ':');
+         result = session.setSmartQuote (text.length() > 0 ? text[0] : ':');
          break;
 
       case Exchange:
          {  // swap last found/last search
-            std::string tempStr = Global::getLastSearch();
-            Global::setLastSearch (Global::getLastModify());
-            Global::setLastModify (tempStr);
+            std::string tempStr = session.getLastSearch();
+            session.setLastSearch (session.getLastModify());
+            session.setLastModify (tempStr);
          }
          result = true;
          break;
 
       case Full:
-         Global::setMode (Global::Full);
+         session.setMode (Session::Full);
          result = true;
          break;
 
@@ -388,76 +708,92 @@ bool BasicCommands::execute (DataBuffer& db)
          break;
 
       case LimitSet:
-         Global::setSearchMax (this->limit);
+         session.setSearchMax (this->limit);
          result = true;
          break;
 
       case Monitor:
-         Global::setMode (Global::Monitor);
+         session.setMode (Session::Monitor);
          result = true;
          break;
 
       case Numbers:
-         Global::setShowLineNumbers (!Global::getShowLineNumbers());
+         session.setShowLineNumbers (!session.getShowLineNumbers());
          result = true;
          break;
 
       case Prompt:
-         Global::setPromptOn (!Global::getPromptOn());
+         session.setPromptOn (!session.getPromptOn());
          result = true;
          break;
 
       case Quiet:
-         Global::setMode (Global::Quiet);
+         session.setMode (Session::Quiet);
          result = true;
          break;
 
       case RepeatSet:
-         Global::setRepeatMax (this->limit);
+         session.setRepeatMax (this->limit);
          result = true;
          break;
 
       case SetCursorMark:
-         Global::setCursorMark (text.length() > 0 ? text[0] : '^');
+         session.setCursorMark (text.length() > 0 ? text[0] : '^');
          result = true;
          break;
 
       case TerminalMaxSet:
-         Global::setTerminalMax (this->limit);
+         session.setTerminalMax (this->limit);
+         result = true;
+         break;
+
+      case UsageProfile:
+         // Turns profiling on, or reports and resets the profile so far.
+         // %U0 reports and turns profiling off.
+         //
+         if (session.getProfile ()) {
+            session.getProfile ()->report (session.report ());
+            session.getProfile ()->reset ();
+            if (this->limit == 0) session.setProfiling (false);
+         } else if (this->limit != 0) {
+            session.setProfiling (true);
+         }
          result = true;
          break;
 
       case View:
-         Global::show (this->limit, std::cerr);
+         session.show (this->limit, session.report ());
+         if (this->limit >= 5) db.showCounters (session.report ());
+         if (this->limit >= 6) db.showMemory (session.report ());
          result = true;
          break;
 
       case DefineX:
          if (text.length() > 0) {
-            Global::setMacroX (text);
+            session.setMacroX (text);
          } else {
-            std::string line = Global::getLine (Global::getPromptOn() ? "X? " : NULL);
-            Global::setMacroX (line);
+            std::string line = session.getLine (session.getPromptOn() ? "X? " : NULL);
+            session.setMacroX (line);
          }
          result = true;
          break;
 
       case DefineY:
          if (text.length() > 0) {
-            Global::setMacroY (text);
+            session.setMacroY (text);
          } else {
-            std::string line = Global::getLine (Global::getPromptOn() ? "Y? " : NULL);
-            Global::setMacroY (line);
+            std::string line = session.getLine (session.getPromptOn() ? "Y? " : NULL);
+            session.setMacroY (line);
          }
          result = true;
          break;
 
       case DefineZ:
          if (text.length() > 0) {
-            Global::setMacroZ (text);
+            session.setMacroZ (text);
          } else {
-            std::string line = Global::getLine (Global::getPromptOn() ? "Z? " : NULL);
-            Global::setMacroZ (line);
+            std::string line = session.getLine (session.getPromptOn() ? "Z? " : NULL);
+            session.setMacroZ (line);
          }
          result = true;
          break;
@@ -474,6 +810,64 @@ bool BasicCommands::execute (DataBuffer& db)
    return result;
 }
 
+//------------------------------------------------------------------------------
+// static
+BasicCommands* BasicCommands::fuse (const BasicCommands* first,
+                                    const BasicCommands* second)
+{
+   if (!first || !second) return nullptr;
+   if (first->kind != second->kind) return nullptr;
+   if ((first->modifier != Normal) || (second->modifier != Normal)) return nullptr;
+
+   BasicCommands* result = nullptr;
+
+   switch (first->kind) {
+      // For each of these, Xn Xm is equivalent to X(n+m). The repeated
+      // operation stops at the first step that fails, and either way leaves
+      // the buffer as the pair of commands would have done.
+      //
+      // Not BreakLineBack: at the end of the buffer, B- adds a line and leaves
+      // the cursor on it, so a second B- splits that line, whereas B-2 adds
+      // two lines, leaving the cursor on the last.
+      //
+      case BreakLine:
+      case Erase:
+      case EraseBack:
+      case UpperCase:
+      case LowerCase:
+      case Join:
+      case JoinBack:
+      case Kill:
+      case KillBack:
+      case Left:
+      case Right:
+      case Move:
+      case MoveBack:
+         if (first->number > INT_MAX - second->number) break;
+         result = new BasicCommands (first->kind, Normal, first->limit,
+                                     first->number + second->number,
+                                     "", false, first->column);
+         break;
+
+      // Forward inserts simply concatenate. These only fail at the end of the
+      // buffer, i.e. when the first fails, and leave the buffer unchanged.
+      // Repeated and last (&) inserts are not fused.
+      //
+      case Insert:
+         if (first->useLastText || second->useLastText) break;
+         if ((first->number != 1) || (second->number != 1)) break;
+         result = new BasicCommands (first->text + second->text,
+                                     first->headSize, second->tailSize,
+                                     first->column);
+         break;
+
+      default:
+         break;
+   }
+
+   return result;
+}
+
 //==============================================================================
 // Sequences
 //==============================================================================
@@ -503,8 +897,6 @@ CompoundCommands::CompoundCommands (const Sequences sequenceIn,
                                     const Modifiers modifierIn) :
    AbstractCommands (numberIn, modifierIn)
 {
-   this->lastCommand = nullptr;
-   this->lastSuccessfullCommand = nullptr;
    this->sequence = sequenceIn;
 }
 
@@ -516,59 +908,158 @@ CompoundCommands::~CompoundCommands ()
 }
 
 //------------------------------------------------------------------------------
-//
-AbstractCommands* CompoundCommands::getLastCommand() const
+// override
+std::string CompoundCommands::image () const
 {
-   return this->lastCommand;
+   std::string result = "Compound";
+   return result;
 }
 
 //------------------------------------------------------------------------------
-//
-AbstractCommands* CompoundCommands::getLastSuccessfullCommand() const
+// override
+bool CompoundCommands::isForwardOnly () const
 {
-   return this->lastSuccessfullCommand;
+   for (Sequences::const_iterator si = this->sequence.begin ();
+        si != this->sequence.end (); ++si)
+   {
+      for (Alternatives::const_iterator ai = si->begin ();
+           ai != si->end (); ++ai)
+      {
+         if (!(*ai)->isForwardOnly ()) return false;
+      }
+   }
+
+   return true;
 }
 
 //------------------------------------------------------------------------------
 // override
-std::string CompoundCommands::image () const
+bool CompoundCommands::isDynamic () const
 {
-   std::string result = "Compound";
+   for (Sequences::const_iterator si = this->sequence.begin ();
+        si != this->sequence.end (); ++si)
+   {
+      for (Alternatives::const_iterator ai = si->begin ();
+           ai != si->end (); ++ai)
+      {
+         if ((*ai)->isDynamic ()) return true;
+      }
+   }
+
+   return false;
+}
+
+//------------------------------------------------------------------------------
+// override
+bool CompoundCommands::isExternal () const
+{
+   for (Sequences::const_iterator si = this->sequence.begin ();
+        si != this->sequence.end (); ++si)
+   {
+      for (Alternatives::const_iterator ai = si->begin ();
+           ai != si->end (); ++ai)
+      {
+         if ((*ai)->isExternal ()) return true;
+      }
+   }
+
+   return false;
+}
+
+//------------------------------------------------------------------------------
+// private static
+bool CompoundCommands::instrumented (const AbstractCommands* command, DataBuffer& db,
+                                     ExecutionState& state)
+{
+   typedef TraceLog::Clock Clock;
+
+   const BasicCommands* basic = dynamic_cast <const BasicCommands*> (command);
+   if (!basic) return command->execute (db, state);
+
+   const Session& session = db.getSession ();
+
+   // The cursor is located outside of the timed execution.
+   //
+   TraceLog::Cursor before = { 0, 0 };
+   if (session.getTraceLog ()) {
+      before.line = db.currentLineNo ();
+      before.col = db.getPosition ().col;
+   }
+
+   const Clock::time_point start = Clock::now ();
+   const bool result = command->execute (db, state);
+   const Clock::time_point finish = Clock::now ();
+
+   // The command may have been %U, which can turn profiling off.
+   //
+   Profile* profile = session.getProfile ();
+   if (profile) {
+      const long long ns =
+         std::chrono::duration_cast<std::chrono::nanoseconds> (finish - start).count ();
+      profile->record (basic, result, ns);
+   }
+
+   TraceLog* traceLog = session.getTraceLog ();
+   if (traceLog) {
+      TraceLog::Cursor after;
+      after.line = db.currentLineNo ();
+      after.col = db.getPosition ().col;
+      traceLog->record (basic, result, before, after, start, finish);
+   }
+
    return result;
 }
 
 //------------------------------------------------------------------------------
 //
-bool CompoundCommands::execute (DataBuffer& db)
+bool CompoundCommands::execute (DataBuffer& db, ExecutionState& state) const
 {
+   const Session& session = db.getSession ();
    bool result = true;
 
-   const int useRepeat = this->modifier == AMTAP ? Global::getRepeatMax() : this->number;
+   // Unless a repeat limit has been explicitly set, * loops only stop when
+   // they fail or, see below, stop making progress.
+   //
+   const bool amtap = (this->modifier == AMTAP);
+   const bool unlimited = amtap && !session.isRepeatMaxSet ();
+   const int useRepeat = amtap ? session.getRepeatMax() : this->number;
 
-   this->lastCommand = nullptr;
-   this->lastSuccessfullCommand = nullptr;
-   for (int j = 0; j < useRepeat; j++) {
+   state.lastCommand = nullptr;
+   state.lastSuccessfullCommand = nullptr;
+   int remaining = useRepeat;
+   while (unlimited || (remaining-- > 0)) {
+      const DataBuffer::Position before = db.getPosition ();
 
-      for (Sequences::iterator si = this->sequence.begin ();
+      for (Sequences::const_iterator si = this->sequence.begin ();
            si != this->sequence.end (); ++si)
       {
-         Alternatives alternative = *si;
+         const Alternatives& alternative = *si;
 
          result = true;  // hypothosize this alternative cmd seq will succeed.
-         for (Alternatives::iterator ai = alternative.begin ();
+         for (Alternatives::const_iterator ai = alternative.begin ();
               ai != alternative.end (); ++ai)
          {
-            AbstractCommands* command = *ai;
-            result = command->execute (db);
-            if (Global::getCloseRequested()) return true;
-            if (Global::getInterruptRequest()) return true;
+            const AbstractCommands* command = *ai;
+            const AbstractCommands* priorSuccessfull = state.lastSuccessfullCommand;
+
+            if (session.isInstrumented ()) {
+               result = CompoundCommands::instrumented (command, db, state);
+            } else {
+               result = command->execute (db, state);
+            }
+            if (session.getCloseRequested()) return true;
+            if (session.getInterruptRequest()) return true;
 
-            // Save the last executed basic command.
+            // Save the last executed basic command. A compound command has
+            // already updated the state with its own last commands, but the
+            // last successfull command only applies if it succeeded overall.
             //
-            CompoundCommands* cc = dynamic_cast <CompoundCommands*> (command);
-            this->lastCommand = cc ? cc->getLastCommand() : command;
-            if (result) {
-               this->lastSuccessfullCommand = cc ? cc->getLastSuccessfullCommand() : command;
+            const bool isCompound = dynamic_cast <const CompoundCommands*> (command) != nullptr;
+            if (isCompound) {
+               if (!result) state.lastSuccessfullCommand = priorSuccessfull;
+            } else {
+               state.lastCommand = command;
+               if (result) state.lastSuccessfullCommand = command;
             }
 
             if (!result) break;
@@ -582,6 +1073,11 @@ bool CompoundCommands::execute (DataBuffer& db)
       }
 
       if (!result) break;
+
+      // A * loop pass that leaves both the contents and the cursor unchanged
+      // is not making progress, so there is no point repeating it.
+      //
+      if (amtap && (db.getPosition () == before)) break;
    }
 
    // Adjust status for no fail and invert if needs be.
@@ -591,4 +1087,14 @@ bool CompoundCommands::execute (DataBuffer& db)
    return result;
 }
 
+//==============================================================================
+// ExecutionState
+//==============================================================================
+//
+ExecutionState::ExecutionState ()
+{
+   this->lastCommand = nullptr;
+   this->lastSuccessfullCommand = nullptr;
+}
+
 // end
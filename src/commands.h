@@ -14,8 +14,11 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 class DataBuffer;   // differed
+class ExecutionState;
+class Session;
 
 //------------------------------------------------------------------------------
 //
@@ -25,8 +28,8 @@ public:
    //
    enum Modifiers {
       Normal,  // No modification.
-      AMTAP,   // As many times as possible without failure.
-               // In practice limited to 10K to avoid infinite loops.
+      AMTAP,   // As many times as possible without failure, i.e. until
+               // failure or no progress, unless a limit is set by %R.
       NoFail,  // ? or @ qualifier
       Invert   // \ or ~ qualifier
    };
@@ -35,7 +38,31 @@ public:
    virtual ~AbstractCommands ();
 
    virtual std::string image () const;
-   virtual bool execute (DataBuffer& db) = 0;
+
+   int getNumber () const;
+   Modifiers getModifier () const;
+
+   // Commands are not modified by execution, so that a parsed command line
+   // may be cached and re-executed, and run by more than one thread at a
+   // time. Any per execution state is held in state.
+   //
+   virtual bool execute (DataBuffer& db, ExecutionState& state) const = 0;
+
+   // Indicates the command never moves back through the file, nor depends on
+   // or modifies macros or quotes, i.e. is suitable for streaming.
+   //
+   virtual bool isForwardOnly () const = 0;
+
+   // Indicates the command reads the command input (G, %X etc.) or changes
+   // how subsequent command lines are parsed (%X, %Y, %Z and %D), i.e. lines
+   // after this command can not be parsed in advance.
+   //
+   virtual bool isDynamic () const = 0;
+
+   // Indicates the command opens or saves files, reads the command input or
+   // the clock, i.e. its effect depends on more than the buffer and session.
+   //
+   virtual bool isExternal () const = 0;
 
 protected:
    bool twizzle (const bool status) const;
@@ -113,6 +140,7 @@ public:
       RepeatSet,
       SetCursorMark,
       TerminalMaxSet,
+      UsageProfile,
       View,
       DefineX,
       DefineY,
@@ -120,21 +148,69 @@ public:
       NUMBER_OF_KINDS   // must be last
    };
 
+   // The column is the command's position (from 1) in the compiled command
+   // line, i.e. after macro expansion, as used by the profile (%U).
+   //
    explicit BasicCommands (const Kinds kind, const Modifiers modifier,
                            const int limit,  const int number,
-                           const std::string text, const bool useLastText);
+                           const std::string text, const bool useLastText,
+                           const int column);
    virtual ~BasicCommands();
 
    Kinds getKind() const;
+   const std::string& getText () const;
+   int getColumn () const;
    std::string image () const;
-   bool execute (DataBuffer& db);
+   bool execute (DataBuffer& db, ExecutionState& state) const;
+   bool isForwardOnly () const;
+   bool isDynamic () const;
+   bool isExternal () const;
+
+   // Returns a single command equivalent to executing first then second, or
+   // nullptr if the two commands can not be fused. Only adjacent commands of
+   // the same kind without modifiers (?, \ or *) are candidates, e.g. M M2
+   // becomes M3 and I/a/ I/b/ becomes I/ab/. The fused command fails when,
+   // and leaves the buffer as, the original pair would have done.
+   // The returned object must be deleted to avoid memory loss.
+   //
+   static BasicCommands* fuse (const BasicCommands* first,
+                               const BasicCommands* second);
+
+   // A kernel is execute pre-bound to, and specialised for, one kind of
+   // command. All the buffer (editing) commands have a kernel, selected when
+   // the command is constructed. Returns nullptr for other commands.
+   //
+   typedef bool (*Kernel) (const BasicCommands& command, DataBuffer& db);
+   Kernel getKernel () const;
 
 private:
+   template <Kinds K>
+   static bool run (const BasicCommands& command, DataBuffer& db);
+   static Kernel kernelOf (const Kinds kind);
+
+   // Used by fuse for inserts - see headSize and tailSize.
+   //
+   explicit BasicCommands (const std::string text,
+                           const size_t headSize, const size_t tailSize,
+                           const int column);
+
+   const std::string& usedText (const Session& session) const;
+   bool isFusedInsert () const;
+
    const Kinds kind;
    const int limit;         // also exit code for %C and %A, verbosity fotr %V
    const bool useLastText;
    const std::string text;
-   std::string useText;     // actual text used for search, modify or filename.
+
+   // For a fused insert, the sizes of the first and last of the original
+   // insert texts, so that the last modify text is set as per the originals.
+   // Otherwise both are the text size.
+   //
+   const size_t headSize;
+   const size_t tailSize;
+
+   const int column;
+   const Kernel kernel;
 };
 
 //------------------------------------------------------------------------------
@@ -158,15 +234,32 @@ public:
    ~CompoundCommands ();
 
    std::string image () const;
-   bool execute (DataBuffer& db);
-
-   AbstractCommands* getLastCommand() const;  // can be nullptr
-   AbstractCommands* getLastSuccessfullCommand() const;  // can be nullptr
+   bool execute (DataBuffer& db, ExecutionState& state) const;
+   bool isForwardOnly () const;
+   bool isDynamic () const;
+   bool isExternal () const;
 
 private:
+   // Executes the command, and when a basic command, records it in the
+   // session's profile and/or trace log. Only used while profiling or tracing,
+   // so that the general execution path is not slowed down.
+   //
+   static bool instrumented (const AbstractCommands* command, DataBuffer& db,
+                             ExecutionState& state);
+
    Sequences sequence;
-   AbstractCommands* lastCommand;
-   AbstractCommands* lastSuccessfullCommand;
+};
+
+//------------------------------------------------------------------------------
+// Holds the state of a command line execution, as opposed to the commands
+// themselves.
+//
+class ExecutionState {
+public:
+   explicit ExecutionState ();
+
+   const AbstractCommands* lastCommand;              // can be nullptr
+   const AbstractCommands* lastSuccessfullCommand;   // can be nullptr
 };
 
 #endif // ACE_COMMANDS_H
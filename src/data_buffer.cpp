@@ -13,9 +13,12 @@
 #include "global.h"
 #include <iostream>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <vector>
 
 #define MIN(a, b)          ((a) <= (b) ? (a) : (b))
 #define MAX(a, b)          ((a) >= (b) ? (a) : (b))
@@ -23,14 +26,42 @@
 
 //------------------------------------------------------------------------------
 //
-DataBuffer::DataBuffer ()
+DataBuffer::DataBuffer () :
+   session (Global::session ())
+{
+   this->initialise ();
+}
+
+//------------------------------------------------------------------------------
+//
+DataBuffer::DataBuffer (Session& sessionIn) :
+   session (sessionIn)
+{
+   this->initialise ();
+}
+
+//------------------------------------------------------------------------------
+// Common constructor initialisation.
+//
+void DataBuffer::initialise ()
 {
    this->lineIter = this->data.begin ();
    this->colNo = 0;
+   this->version = 0;
+   this->numberedValid = false;
    this->changed = false;
 
+   this->compression = cpNone;
+
+   this->streaming = false;
+   this->window = 0;
+   this->retired = 0;
+   this->retireCheck = 0;
+
    this->lastSearchType = stVoid;
    this->lastSearchText = "";
+
+   this->resetCounters ();
 }
 
 //------------------------------------------------------------------------------
@@ -38,8 +69,17 @@ DataBuffer::DataBuffer ()
 DataBuffer::~DataBuffer ()
 {
    this->data.clear();
-   this->inputStream.close();
-   this->outputStream.close();
+   this->inputReader.close();
+   this->outputWriter.close();   // flushes any buffered output
+   this->streamReader.close();
+   this->streamWriter.close();
+}
+
+//------------------------------------------------------------------------------
+//
+Session& DataBuffer::getSession () const
+{
+   return this->session;
 }
 
 //------------------------------------------------------------------------------
@@ -51,48 +91,53 @@ std::string DataBuffer::stdInOut ()
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::load (const std::string filename)
+bool DataBuffer::load (const std::string& filename)
 {
    bool result;
 
+   this->countRemoved (this->data.size());
    this->data.clear();
+   this->version++;
+   this->forgetLineNo ();
+
+   // Read the file in large blocks and split into lines, as opposed
+   // to reading line by line. Compressed files are decoded on the fly.
+   //
+   LineReader src;
 
    if (filename == DataBuffer::stdInOut()) {
       // Use standard input to read "file" data
       //
-      result = true;
-      while (true) {
-         std::string line;
-         std::getline (std::cin, line);
-         if (std::cin.eof ()) break;
-         this->data.push_back (line);
-      }
-
+      result = src.openStandardInput ();
    } else {
-      std::ifstream src (filename);
-      result = src.is_open ();
-      if (result) {
-         while (true) {
-            std::string line;
-            std::getline (src, line);
-            if (src.eof ()) {
-               if (line.size() > 0) {
-                  // We have a file where last line has a missing \n
-                  // Let's convert to a properly formatted file
-                  //
-                  this->data.push_back (line);
-               }
-               break;
-            }
-            this->data.push_back (line);
-         }
-         src.close();
+      result = src.open (filename);
+   }
 
-      } else {
-         std::string message;
-         message = "ace: load: " + filename;
-         perror (message.c_str());
+   if (!result) {
+      const int error = errno;
+      this->session.report () << "ace: load: " << filename << ": "
+                              << strerror (error) << std::endl;
+   }
+
+   if (result) {
+      // Note: a last line with a missing \n is treated as a complete line,
+      // i.e. we convert to a properly formatted file.
+      //
+      src.getLines (this->data, INT_MAX);
+      this->countAdded (this->data);
+
+      if (src.hasFailed ()) {
+         this->session.report () << "ace: load: " << filename
+                                 << ": read error or invalid compressed data" << std::endl;
+         result = false;
       }
+
+      // Remember how the file was compressed, so that we can save it
+      // the same way.
+      //
+      this->loadedName = filename;
+      this->compression = src.getCompression ();
+      src.close();
    }
 
    // Move to the begining of the file.
@@ -105,70 +150,289 @@ bool DataBuffer::load (const std::string filename)
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::save (const std::string filename)
+void DataBuffer::loadText (const char* text, const size_t size)
 {
-   const int last = this->data.size();
+   this->countRemoved (this->data.size());
+   this->data.clear();
+   this->version++;
+   this->forgetLineNo ();
+
+   const char* start = text;
+   const char* end = text + size;
+   while (start < end) {
+      const char* eol = static_cast<const char*> (memchr (start, '\n', end - start));
+      if (!eol) eol = end;
+      this->data.push_back (std::string (start, eol - start));
+      this->countAdded (this->data.back ());
+      start = eol + 1;
+   }
 
-   bool result;
+   this->loadedName = "";
+   this->compression = cpNone;
+
+   // Move to the begining of the file.
+   //
+   this->lineIter = this->data.begin();
+   this->colNo = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::loadLines (StringList& lines)
+{
+   this->countRemoved (this->data.size());
+   this->data.clear();
+   this->version++;
+   this->forgetLineNo ();
+   this->countAdded (lines);
+   this->data.splice (this->data.end(), lines);
+
+   this->loadedName = "";
+   this->compression = cpNone;
+
+   this->lineIter = this->data.begin();
+   this->colNo = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+const DataBuffer::StringList& DataBuffer::getLines () const
+{
+   return this->data;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::saveText (std::string& text) const
+{
+   size_t size = 0;
+   for (StringList::const_iterator it = this->data.begin(); it != this->data.end(); ++it) {
+      size += it->length() + 1;
+   }
 
-   // Using a local buffer improves the output speed significantly.
+   text.clear();
+   text.reserve (size);
+   for (StringList::const_iterator it = this->data.begin(); it != this->data.end(); ++it) {
+      text.append (*it);
+      text.push_back ('\n');
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBuffer::loadStream (const int windowIn)
+{
+   this->countRemoved (this->data.size());
+   this->data.clear();
+   this->version++;
+   this->forgetLineNo ();
+
+   this->streaming = true;
+   this->window = windowIn >= 1 ? windowIn : 1;
+   this->retired = 0;
+   this->retireCheck = 0;
+
+   // Compressed input is re-compressed on output.
    //
-   std::string buffer;
+   if (!this->streamReader.openStandardInput () ||
+       !this->streamWriter.openStandardOutput (this->streamReader.getCompression ())) {
+      const int error = errno;
+      this->session.report () << "ace: load: -: " << strerror (error) << std::endl;
+      return false;
+   }
 
-   if (filename == DataBuffer::stdInOut()) {
-      // Use standard output to write "file" data
-      //
-      result = true;
-      for (Iterator it = data.begin (); it != data.end (); ++it) {
-         std::string line = *it;
+   // Move to the begining of the file, reading the first lines if any.
+   //
+   this->lineIter = this->data.begin();
+   this->colNo = 0;
+   this->atEnd (this->lineIter);
 
-         buffer.append (line);
-         buffer.append ("\n");   // Linux specific
+   return true;
+}
 
-         if (buffer.length() >= 8192) {
-            std::cout << buffer;
-            buffer.clear();
-         }
-      }
+//------------------------------------------------------------------------------
+//
+bool DataBuffer::isStreaming () const
+{
+   return this->streaming;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::retire ()
+{
+   if (!this->streaming) return;
+
+   // Only worth checking once we have accumulated a fair number of lines.
+   //
+   if (this->data.size() <= this->retireCheck) return;
+
+   // Find the first line to keep, i.e. window lines behind the cursor.
+   //
+   Iterator keep = this->lineIter;
+   for (int j = 0; j < this->window; j++) {
+      if (keep == this->data.begin ()) break;
+      keep--;
+   }
+
+   std::vector<const std::string*> lines;
+   for (Iterator it = this->data.begin (); it != keep; ++it) {
+      lines.push_back (&(*it));
+   }
+   this->streamWriter.putLines (lines);
+   this->retired += lines.size();
+   this->countRemoved (lines.size());
+
+   this->data.erase (this->data.begin (), keep);
+   this->version++;
+   this->forgetLineNo ();
+
+   // No need to look again until we have another window's worth of lines.
+   //
+   this->retireCheck = this->data.size() + this->window;
+}
+
+//------------------------------------------------------------------------------
+//
+bool DataBuffer::atEnd (Iterator& iter)
+{
+   if (iter != this->data.end ()) return false;
+   if (!this->streaming) return true;
+
+   // Read the next batch of lines from standard input.
+   //
+   static const int batchSize = 256;
+
+   StringList batch;
+   if (this->streamReader.getLines (batch, batchSize) == 0) {
+      return true;   // really at the end
+   }
+
+   const bool lineIterAtEnd = (this->lineIter == this->data.end ());
+   const Iterator first = batch.begin ();
+   this->countAdded (batch);
+   if (this->numberedValid && (this->numberedIter == this->data.end ())) {
+      this->numberedIndex += batch.size ();
+   }
+   this->data.splice (this->data.end (), batch);
+   this->version++;
+
+   iter = first;
+   if (lineIterAtEnd) {
+      this->lineIter = first;
+   }
+
+   return false;
+}
 
-      if (buffer.length() > 0) {
-         std::cout << buffer;
-         buffer = "";
+//------------------------------------------------------------------------------
+//
+bool DataBuffer::saveStream ()
+{
+   // Write out what remains of the data, and then copy over whatever
+   // remains of the input.
+   //
+   long last = this->retired + this->data.size();
+
+   bool result = true;
+   for (Iterator it = data.begin (); it != data.end (); ++it) {
+      result = this->streamWriter.putLine (*it) && result;
+   }
+
+   static const int batchSize = 4096;
+   while (true) {
+      StringList batch;
+      const int n = this->streamReader.getLines (batch, batchSize);
+      for (Iterator it = batch.begin (); it != batch.end (); ++it) {
+         result = this->streamWriter.putLine (*it) && result;
       }
+      last += n;
+      if (n < batchSize) break;
+   }
 
-      std::cerr << "Output complete, " << last
-                << " lines written to standard output." << std::endl;
+   result = this->streamWriter.close() && result;
+   this->streamReader.close();
 
-   } else {
-      std::ofstream dest (filename);
-      result = dest.is_open();
-      if (result) {
+   this->session.report () << "Output complete, " << last
+                           << " lines written to standard output." << std::endl;
+
+   return result;
+}
 
-         for (Iterator it = data.begin (); it != data.end (); ++it) {
-            std::string line = *it;
+//------------------------------------------------------------------------------
+//
+bool DataBuffer::save (const std::string& filename, const SaveMode mode)
+{
+   const int last = this->data.size();
 
-            buffer.append (line);
-            buffer.append ("\n");   // Linux specific
+   bool result;
 
-            if (buffer.length() >= 8192) {
-               dest << buffer;
-               buffer = "";
-            }
-         }
+   this->recoveryName.clear();
 
-         if (buffer.length() > 0) {
-            dest << buffer;
-            buffer.clear();
-         }
+   if (this->streaming && (filename == DataBuffer::stdInOut())) {
+      // Write out what remains of the data and then the rest of standard
+      // input, which has not been read yet.
+      //
+      return this->saveStream ();
+   }
+
+   // Saving back to where we loaded from uses the same compression as the
+   // original, otherwise the compression is determined by the file name.
+   //
+   const Compressions saveCompression = (filename == this->loadedName)
+                                      ? this->compression
+                                      : LineWriter::compressionOf (filename);
+
+   // Write in large blocks as opposed to line by line.
+   //
+   LineWriter dest;
+
+   if (filename == DataBuffer::stdInOut()) {
+      // Use standard output to write "file" data. Ensure anything already
+      // sent to std::cout goes out first.
+      //
+      std::cout.flush ();
+      result = dest.openStandardOutput (saveCompression);
+   } else {
+      // Reserved save - we need the size up front to reserve the space.
+      //
+      off_t size = 0;
+      for (Iterator it = data.begin (); it != data.end (); ++it) {
+         size += it->length() + 1;
+      }
+      result = dest.openForSave (filename, saveCompression, size, mode == Replace);
+   }
 
-         dest.close ();
-         std::cerr << "Output complete, " << last
-                   << " lines written to: " << filename << std::endl;
+   if (result) {
+      std::vector<const std::string*> lines;
+      lines.reserve (1024);
+      for (Iterator it = data.begin (); it != data.end (); ++it) {
+         lines.push_back (&(*it));
+         if (lines.size() >= 1024) {
+            result = dest.putLines (lines) && result;
+            lines.clear();
+         }
+      }
+      result = dest.putLines (lines) && result;
+      result = dest.close () && result;
+   }
 
+   if (result) {
+      this->session.report () << "Output complete, " << last;
+      if (filename == DataBuffer::stdInOut()) {
+         this->session.report () << " lines written to standard output." << std::endl;
       } else {
-         std::string message;
-         message = "ace: save: " + filename;
-         perror (message.c_str());
+         this->session.report () << " lines written to: " << filename << std::endl;
+      }
+   } else {
+      const int error = errno;
+      this->session.report () << "ace: save: " << filename << ": "
+                              << strerror (error) << std::endl;
+
+      this->recoveryName = dest.getRecoveryName ();
+      if (!this->recoveryName.empty()) {
+         this->session.report () << "Output complete, " << last
+                                 << " lines written to: " << this->recoveryName << std::endl;
       }
    }
 
@@ -177,17 +441,38 @@ bool DataBuffer::save (const std::string filename)
 
 //------------------------------------------------------------------------------
 //
-void DataBuffer::appendLine (const std::string line)
+const std::string& DataBuffer::getRecoveryName () const
+{
+   return this->recoveryName;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::appendLine (const std::string& line)
 {
    this->data.push_back (line);
+   this->version++;
+   if (this->numberedValid && (this->numberedIter == this->data.end ())) {
+      this->numberedIndex++;
+   }
+   this->counters.lineCopies++;
+   this->countAdded (this->data.back ());
 }
 
 //------------------------------------------------------------------------------
 // insert line just before the current line.
 //
-void DataBuffer::insertLine (const std::string line)
+void DataBuffer::insertLine (const std::string& line)
 {
-   this->data.insert (this->lineIter, line);
+   const Iterator added = this->data.insert (this->lineIter, line);
+   this->version++;
+   if (this->numberedValid && (this->numberedIter == this->lineIter)) {
+      this->numberedIndex++;
+   } else {
+      this->forgetLineNo ();
+   }
+   this->counters.lineCopies++;
+   this->countAdded (*added);
 }
 
 //------------------------------------------------------------------------------
@@ -198,48 +483,251 @@ void DataBuffer::removeLine (Iterator& iter)
    if (iter != this->data.end()) {
       Iterator temp = iter;
       iter++;
+      if (this->numberedValid && (this->numberedIter == temp)) {
+         this->numberedIter = iter;   // same index
+      } else {
+         this->forgetLineNo ();
+      }
       this->data.erase (temp);
+      this->version++;
+      this->countRemoved (1);
    }
 }
 
 //------------------------------------------------------------------------------
 // replace the current line
 //
-void DataBuffer::replaceLine (const std::string line)
+void DataBuffer::replaceLine (const std::string& line)
 {
-   if (this->lineIter != this->data.end()) {
+   if ((this->lineIter != this->data.end()) && (*this->lineIter != line)) {
+      const size_t capacity = this->lineIter->capacity ();
       *this->lineIter = line;
+      this->version++;
+      this->counters.lineCopies++;
+      if (this->lineIter->capacity () != capacity) this->counters.allocations++;
    }
 }
 
 //------------------------------------------------------------------------------
 //
-std::string DataBuffer::currentLine() const
+const std::string& DataBuffer::currentLine() const
 {
-   std::string result;
+   static const std::string empty;
 
    if (this->lineIter != this->data.end()) {
-      result = *this->lineIter;
+      return *this->lineIter;
    }
 
-   return result;
+   return empty;
+}
+
+//------------------------------------------------------------------------------
+// The current line, which must exist, for modification in place.
+//
+std::string& DataBuffer::editLine ()
+{
+   this->version++;
+   return *this->lineIter;
 }
 
 //------------------------------------------------------------------------------
 //
 int DataBuffer::currentLineNo() const
 {
-   int result = 1;
-   Iterator t = this->lineIter;
+   bool found = false;
+
+   if (this->numberedValid) {
+      // Search both ways from the line last numbered.
+      //
+      Iterator ahead = this->numberedIter;
+      Iterator behind = this->numberedIter;
+      int distance = 0;
+      while (true) {
+         if (ahead == this->lineIter) {
+            this->numberedIndex += distance;
+            found = true;
+            break;
+         }
+         if (behind == this->lineIter) {
+            this->numberedIndex -= distance;
+            found = true;
+            break;
+         }
+
+         bool moved = false;
+         if (ahead != this->data.end ()) {
+            ahead++;
+            moved = true;
+         }
+         if (behind != this->data.begin ()) {
+            behind--;
+            moved = true;
+         }
+         if (!moved) break;
+         distance++;
+      }
+   }
+
+   if (!found) {
+      int index = 0;
+      Iterator t = this->lineIter;
+      while (t != this->data.begin ()) {
+         t--;
+         index++;
+      }
+      this->numberedIndex = index;
+   }
+
+   this->numberedIter = this->lineIter;
+   this->numberedValid = true;
+
+   return 1 + this->retired + this->numberedIndex;
+}
+
+//------------------------------------------------------------------------------
+// private
+void DataBuffer::forgetLineNo ()
+{
+   this->numberedValid = false;
+}
+
+//------------------------------------------------------------------------------
+//
+DataBuffer::Position DataBuffer::getPosition () const
+{
+   Position result;
+
+   result.version = this->version;
+   result.line = (this->lineIter != this->data.end ()) ? &(*this->lineIter) : nullptr;
+   result.col = this->colNo;
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+const DataBuffer::Counters& DataBuffer::getCounters () const
+{
+   return this->counters;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::resetCounters ()
+{
+   this->counters.linesScanned = 0;
+   this->counters.bytesCompared = 0;
+   this->counters.lineCopies = 0;
+   this->counters.allocations = 0;
+   this->counters.linesAllocated = 0;
+   this->counters.linesFreed = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::showCounters (std::ostream& stream) const
+{
+   stream << "Lines Scanned:   " << this->counters.linesScanned << std::endl;
+   stream << "Bytes Compared:  " << this->counters.bytesCompared << std::endl;
+   stream << "Line Copies:     " << this->counters.lineCopies << std::endl;
+   stream << "Allocations:     " << this->counters.allocations << std::endl;
+   stream << "Lines Allocated: " << this->counters.linesAllocated << std::endl;
+   stream << "Lines Freed:     " << this->counters.linesFreed << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// The heap's rounding up of an allocation of size bytes, for a glibc style
+// malloc, i.e. a size word plus alignment to two words, with a minimum chunk.
+//
+static unsigned long arenaWaste (const size_t size)
+{
+   static const size_t word = sizeof (size_t);
+   static const size_t minimum = 4 * word;
+
+   size_t chunk = (size + word + 2 * word - 1) & ~(2 * word - 1);
+   if (chunk < minimum) chunk = minimum;
+   return chunk - size;
+}
+
+//------------------------------------------------------------------------------
+//
+DataBuffer::Memory DataBuffer::getMemory () const
+{
+   static const size_t internalCapacity = std::string ().capacity ();
+   static const size_t nodeSize = 2 * sizeof (void*) + sizeof (std::string);
+
+   Memory result;
+   result.lines = 0;
+   result.payload = 0;
+   result.container = 0;
+   result.slack = 0;
+   result.arena = 0;
+
+   for (StringList::const_iterator it = this->data.begin (); it != this->data.end (); ++it) {
+      const size_t length = it->length ();
+      const size_t capacity = it->capacity ();
+
+      result.lines++;
+      result.payload += length;
+      result.arena += arenaWaste (nodeSize);
 
-   while (t != this->data.begin ()) {
-      t--;
-      result++;
+      if (capacity > internalCapacity) {
+         // Text on the heap, including the terminating null.
+         //
+         result.container += nodeSize;
+         result.slack += capacity + 1 - length;
+         result.arena += arenaWaste (capacity + 1);
+      } else {
+         result.container += nodeSize - length;
+      }
    }
 
+   result.total = result.payload + result.container + result.slack + result.arena;
    return result;
 }
 
+//------------------------------------------------------------------------------
+//
+void DataBuffer::showMemory (std::ostream& stream) const
+{
+   const Memory memory = this->getMemory ();
+
+   stream << "Memory Lines:     " << memory.lines << std::endl;
+   stream << "Memory Payload:   " << memory.payload << std::endl;
+   stream << "Memory Container: " << memory.container << std::endl;
+   stream << "Memory Slack:     " << memory.slack << std::endl;
+   stream << "Memory Arena:     " << memory.arena << std::endl;
+   stream << "Memory Total:     " << memory.total << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// A line's text is only allocated on the heap when too long for the string's
+// internal buffer, i.e. when it has more capacity than an empty string.
+//
+void DataBuffer::countAdded (const std::string& line)
+{
+   static const size_t internalCapacity = std::string ().capacity ();
+
+   this->counters.linesAllocated++;
+   this->counters.allocations += (line.capacity () > internalCapacity) ? 2 : 1;
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::countAdded (const StringList& lines)
+{
+   for (StringList::const_iterator it = lines.begin (); it != lines.end (); ++it) {
+      this->countAdded (*it);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void DataBuffer::countRemoved (const size_t number)
+{
+   this->counters.linesFreed += number;
+}
+
 //------------------------------------------------------------------------------
 //
 void DataBuffer::clearChanged ()
@@ -263,18 +751,34 @@ bool DataBuffer::hasChanged () const
    return this->changed;
 }
 
+//------------------------------------------------------------------------------
+// The number of bytes of the line searched for text from position from, given
+// the search result pos, as counted by the bytesCompared counter.
+//
+static unsigned long searched (const std::string& line, const size_t from,
+                               const std::string::size_type pos,
+                               const size_t textLength)
+{
+   if (pos != std::string::npos) return pos + textLength - from;
+   return (from < line.length()) ? line.length() - from : 0;
+}
+
 //------------------------------------------------------------------------------
 // Used by find, delete, traverse and uncover
 //
-bool DataBuffer::locate (const int searchLimit, const std::string text,
+bool DataBuffer::locate (const int searchLimit, const std::string_view text,
                          const int skip)
 {
-   if (this->lineIter == this->data.end ()) {
+   if (this->atEnd (this->lineIter)) {
       return false;
    }
 
-   std::string line = this->currentLine();
-   std::string::size_type pos = line.find (text, this->colNo + skip);
+   // Search the lines in place.
+   //
+   const std::string* line = &this->currentLine();
+   std::string::size_type pos = line->find (text, this->colNo + skip);
+   unsigned long scanned = 1;
+   unsigned long bytes = searched (*line, this->colNo + skip, pos, text.length());
 
    int searchLineCount = 1;
    while ((pos == std::string::npos) && (searchLineCount < searchLimit)) {
@@ -283,15 +787,20 @@ bool DataBuffer::locate (const int searchLimit, const std::string text,
       this->setChanged ();
       searchLineCount++;
 
-      if (this->lineIter == this->data.end ()) {
+      if (this->atEnd (this->lineIter)) {
          pos = std::string::npos;
          break;
       }
 
-      line = this->currentLine();
-      pos = line.find (text, this->colNo);
+      line = &this->currentLine();
+      pos = line->find (text, this->colNo);
+      scanned++;
+      bytes += searched (*line, this->colNo, pos, text.length());
    }
 
+   this->counters.linesScanned += scanned;
+   this->counters.bytesCompared += bytes;
+
    bool result;
    if (pos != std::string::npos) {
       // found
@@ -308,15 +817,28 @@ bool DataBuffer::locate (const int searchLimit, const std::string text,
    return result;
 }
 
+//------------------------------------------------------------------------------
+// As searched, for a backwards search from searchFrom (the last position at
+// which the text may start).
+//
+static unsigned long backSearched (const int searchFrom,
+                                   const std::string::size_type pos,
+                                   const int textLength)
+{
+   if (searchFrom < 0) return 0;
+   if (pos != std::string::npos) return searchFrom - pos + textLength;
+   return searchFrom + textLength;
+}
+
 //------------------------------------------------------------------------------
 // Used by findBack, deleteBack, traverseBack and uncoverBack
 //
-bool DataBuffer::locateBack (const int searchLimit, const std::string text,
+bool DataBuffer::locateBack (const int searchLimit, const std::string_view text,
                              const int skip)
 {
    const int textLen = int(text.length());
 
-   std::string line = this->currentLine();
+   const std::string* line = &this->currentLine();
 
    // Although rfind searches backwards, it still looks forward from the given
    // position. Also must check if this takes us to before the start of the line.
@@ -325,10 +847,12 @@ bool DataBuffer::locateBack (const int searchLimit, const std::string text,
 
    std::string::size_type pos;
    if (searchFrom >= 0) {
-      pos = line.rfind (text, searchFrom);
+      pos = line->rfind (text, searchFrom);
    } else {
       pos = std::string::npos;  // not found postion
    }
+   unsigned long scanned = 1;
+   unsigned long bytes = backSearched (searchFrom, pos, textLen);
 
    int searchLineCount = 1;
    while ((pos == std::string::npos) && (searchLineCount < searchLimit)) {
@@ -338,19 +862,24 @@ bool DataBuffer::locateBack (const int searchLimit, const std::string text,
       }
 
       this->lineIter--;
-      line = this->currentLine();
-      this->colNo = line.length();
+      line = &this->currentLine();
+      this->colNo = line->length();
       this->setChanged ();
       searchLineCount++;
 
       searchFrom = this->colNo - textLen;
       if (searchFrom >= 0) {
-         pos = line.rfind (text, searchFrom);
+         pos = line->rfind (text, searchFrom);
       } else {
          pos = std::string::npos;  // not found postion
       }
+      scanned++;
+      bytes += backSearched (searchFrom, pos, textLen);
    }
 
+   this->counters.linesScanned += scanned;
+   this->counters.bytesCompared += bytes;
+
    bool result;
    if (pos != std::string::npos) {
       // found
@@ -371,26 +900,45 @@ bool DataBuffer::locateBack (const int searchLimit, const std::string text,
 //
 bool DataBuffer::absorbeDirection (const Direction direction, const int number)
 {
-   if (!this->inputStream.is_open()) return false;
+   if (!this->inputReader.isOpen()) return false;
 
-   bool result = true;
-   for (int j = 0; j < number; j++) {
-      std::string line;
-      std::getline (this->inputStream, line);
-      if (this->inputStream.good()) {
-         this->insertLine (line);
-         if (direction == Reverse) {
-            this->lineIter--;
-         }
-         this->colNo = 0;
-         this->setChanged ();
+   // Read all the required lines in one go, and then splice the whole
+   // batch into the data buffer.
+   //
+   StringList batch;
+   const int count = this->inputReader.getLines (batch, number);
+
+   if (count > 0) {
+      this->countAdded (batch);
+      if (this->numberedValid && (this->numberedIter == this->lineIter)) {
+         this->numberedIndex += count;
       } else {
-         // end of file.
+         this->forgetLineNo ();
+      }
+      if (direction == Forward) {
+         // Lines inserted before the current line, which remains current.
          //
-         this->inputStream.close ();
-         result = false;
-         break;
+         this->data.splice (this->lineIter, batch);
+      } else {
+         // Each line is inserted before the current line, and the inserted
+         // line becomes the current line, i.e. the lines end up in reverse
+         // order and the cursor is on the last line absorbed.
+         //
+         batch.reverse ();
+         const Iterator first = batch.begin ();
+         this->data.splice (this->lineIter, batch);
+         this->lineIter = first;
       }
+      this->version++;
+      this->colNo = 0;
+      this->setChanged ();
+   }
+
+   const bool result = (count == number);
+   if (!result) {
+      // end of file.
+      //
+      this->inputReader.close ();
    }
 
    return result;
@@ -418,7 +966,7 @@ bool DataBuffer::breakDirection (const Direction direction, const int number)
 
    if (this->lineIter != this->data.end ()) {
       for (int j = 0; j < number; j++) {
-         const std::string line = this->currentLine ();
+         const std::string& line = this->currentLine ();
          // Split current line into two parts.
          const std::string part1 = line.substr (0, this->colNo);
          const std::string part2 = line.substr (this->colNo);
@@ -432,8 +980,7 @@ bool DataBuffer::breakDirection (const Direction direction, const int number)
          } else {
             this->lineIter--;
             this->lineIter--;
-            const std::string line2 = this->currentLine ();
-            this->colNo = line2.length();
+            this->colNo = this->currentLine ().length();
          }
          this->setChanged ();
       }
@@ -471,17 +1018,14 @@ bool DataBuffer::breakLineBack (const int number)
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::connect (const std::string filename)
+bool DataBuffer::connect (const std::string& filename)
 {
    bool result;
 
-   if (this->inputStream.is_open()) {
-      this->inputStream.close();
-   }
+   this->inputReader.close();
 
    if (!filename.empty()) {
-      this->inputStream.open (filename);
-      result = this->inputStream.is_open();
+      result = this->inputReader.open (filename);
    } else {
       result = true;  // just closing the file - always successfull.
    }
@@ -491,17 +1035,16 @@ bool DataBuffer::connect (const std::string filename)
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::output (const std::string filename)
+bool DataBuffer::output (const std::string& filename)
 {
    bool result;
 
-   if (this->outputStream.is_open()) {
-      this->outputStream.close();
-   }
+   // Closing flushes any output buffered for the previous file.
+   //
+   this->outputWriter.close();
 
    if (!filename.empty()) {
-      this->outputStream.open(filename);
-      result = this->outputStream.is_open();
+      result = this->outputWriter.open (filename, LineWriter::compressionOf (filename));
    } else {
       result = true;  // just closing the file - always successfull.
    }
@@ -511,7 +1054,7 @@ bool DataBuffer::output (const std::string filename)
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::deleteText (const int limit, const std::string text, const int number)
+bool DataBuffer::deleteText (const int limit, const std::string_view text, const int number)
 {
    bool result = true;
 
@@ -521,9 +1064,7 @@ bool DataBuffer::deleteText (const int limit, const std::string text, const int
       result = this->locate (limit, text, 0);
       if (!result) break;
 
-      std::string line = this->currentLine();
-      line.erase (this->colNo, len);
-      this->replaceLine (line);
+      if (len > 0) this->editLine ().erase (this->colNo, len);
       this->setChanged ();
    }
 
@@ -532,7 +1073,7 @@ bool DataBuffer::deleteText (const int limit, const std::string text, const int
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::deleteBack (const int limit, const std::string text, const int number)
+bool DataBuffer::deleteBack (const int limit, const std::string_view text, const int number)
 {
    bool result = true;
 
@@ -542,9 +1083,7 @@ bool DataBuffer::deleteBack (const int limit, const std::string text, const int
       result = this->locateBack (limit, text, 0);
       if (!result) break;
 
-      std::string line = this->currentLine();
-      line.erase (this->colNo, len);
-      this->replaceLine (line);
+      if (len > 0) this->editLine ().erase (this->colNo, len);
       this->setChanged ();
    }
 
@@ -557,12 +1096,12 @@ bool DataBuffer::erase (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   std::string line = this->currentLine();
-   const int len = line.length();
+   const int len = this->currentLine().length();
 
    int eraseSize = MIN (number, len - this->colNo);
-   line.erase (this->colNo, eraseSize);
-   this->replaceLine (line);
+   if (eraseSize > 0) {
+      this->editLine ().erase (this->colNo, eraseSize);
+   }
    this->setChanged ();
 
    return (eraseSize == number);
@@ -574,13 +1113,12 @@ bool DataBuffer::eraseBack (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   std::string line = this->currentLine();
-
    int eraseSize = MIN (number, this->colNo);
 
    this->colNo -= eraseSize;
-   line.erase (this->colNo, eraseSize);
-   this->replaceLine (line);
+   if (eraseSize > 0) {
+      this->editLine ().erase (this->colNo, eraseSize);
+   }
    this->setChanged ();
 
    return (eraseSize == number);
@@ -590,15 +1128,15 @@ bool DataBuffer::eraseBack (const int number)
 //
 bool DataBuffer::getDirection (const Direction direction, const int number)
 {
-   const Global::GetLineFuncPtr getLine = Global::getGetLineFunc ();
+   const Session::GetLineFuncPtr getLine = this->session.getGetLineFunc ();
    if (!getLine) {
-      std::cerr << "get_line function undefined" << std::endl;
+      this->session.report () << "get_line function undefined" << std::endl;
       return false;
    }
 
    bool result = true;
    for (int j = 0; j < number; j++) {
-      std::string line = getLine (Global::getPromptOn() ? ":" : NULL);
+      std::string line = getLine (this->session.getPromptOn() ? ":" : NULL);
       if (line == ":") {
          result = false;
          break;
@@ -635,18 +1173,23 @@ bool DataBuffer::upperCase (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   std::string line = this->currentLine();
+   std::string& line = *this->lineIter;
    const int len = line.length();
 
    const bool result = this->colNo + number <= len;
    const int size = MIN (number, len - this->colNo);
 
+   // Modify in place, and only count as a change if a character changed.
+   //
    for (int j = this->colNo; j < this->colNo + size; j++) {
-      char c = line.at(j);
-      line.at(j) = toupper(c);
+      const char c = line.at(j);
+      const char r = toupper(c);
+      if (r != c) {
+         line.at(j) = r;
+         this->version++;
+      }
    }
 
-   this->replaceLine (line);
    this->colNo += size;
    this->setChanged ();
 
@@ -659,18 +1202,23 @@ bool DataBuffer::lowerCase (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   std::string line = this->currentLine();
+   std::string& line = *this->lineIter;
    const int len = line.length();
 
    const bool result = this->colNo + number <= len;
    const int size = MIN (number, len - this->colNo);
 
+   // Modify in place, and only count as a change if a character changed.
+   //
    for (int j = this->colNo; j < this->colNo + size; j++) {
-      char c = line.at(j);
-      line.at(j) = tolower(c);
+      const char c = line.at(j);
+      const char r = tolower(c);
+      if (r != c) {
+         line.at(j) = r;
+         this->version++;
+      }
    }
 
-   this->replaceLine (line);
    this->colNo += size;
    this->setChanged ();
 
@@ -680,21 +1228,24 @@ bool DataBuffer::lowerCase (const int number)
 //------------------------------------------------------------------------------
 //
 bool DataBuffer::insertDirection  (const Direction direction,
-                                   const std::string text, const int number)
+                                   const std::string_view text, const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
    if (text.length() == 0) return true;
 
-   std::string line = this->currentLine();
-   for (int j = 0; j < number; j++) {
-      line.insert(this->colNo, text);
-      if (direction == Forward) {
-         this->colNo += text.length();
+   if (number > 0 && !text.empty ()) {
+      std::string& line = this->editLine ();
+      const size_t capacity = line.capacity ();
+      for (int j = 0; j < number; j++) {
+         line.insert(this->colNo, text);
+         if (direction == Forward) {
+            this->colNo += text.length();
+         }
       }
+      if (line.capacity () != capacity) this->counters.allocations++;
    }
 
-   this->replaceLine (line);
    this->setChanged ();
 
    return true;
@@ -702,14 +1253,14 @@ bool DataBuffer::insertDirection  (const Direction direction,
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::insert (const std::string text, const int number)
+bool DataBuffer::insert (const std::string_view text, const int number)
 {
    return this->insertDirection (Forward, text, number);
 }
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::insertBack (const std::string text, const int number)
+bool DataBuffer::insertBack (const std::string_view text, const int number)
 {
    return this->insertDirection (Reverse, text, number);
 }
@@ -732,18 +1283,21 @@ bool DataBuffer::join (const int number)
       // Unlike ecce, we don't allow last line join with **END** that
       // removes the newline at end of file.
       //
-      if (nextLine == this->data.end ()) {
+      if (this->atEnd (nextLine)) {
          result = false;
          break;
       }
 
-      const std::string part1 = this->currentLine ();
-      const std::string part2 = *nextLine;
+      // Append in place, as opposed to building a new line, so that J* on a
+      // long run of lines is not quadratic.
+      //
+      std::string& line = this->editLine ();
+      const size_t capacity = line.capacity ();
+      this->colNo = line.length();
+      line.append (*nextLine);
+      if (line.capacity () != capacity) this->counters.allocations++;
 
-      const std::string line = part1 + part2;
-      this->replaceLine (line);
       this->removeLine (nextLine);
-      this->colNo = part1.length();
       this->setChanged ();
    }
 
@@ -766,13 +1320,17 @@ bool DataBuffer::joinBack (const int number)
       Iterator prevLine = this->lineIter;
       prevLine--;
 
-      const std::string part1 = *prevLine;
-      const std::string part2 = this->currentLine ();
-
-      const std::string line = part1 + part2;
-      this->replaceLine (line);
-      this->removeLine (prevLine);
-      this->colNo = part1.length();
+      // As for join, the current line is appended to the previous line in
+      // place, which then becomes the current line.
+      //
+      const size_t capacity = prevLine->capacity ();
+      const int length = prevLine->length();
+      prevLine->append (this->currentLine ());
+      if (prevLine->capacity () != capacity) this->counters.allocations++;
+
+      this->removeLine (this->lineIter);
+      this->lineIter = prevLine;
+      this->colNo = length;
       this->setChanged ();
    }
 
@@ -792,6 +1350,7 @@ bool DataBuffer::kill (const int number)
       }
 
       this->removeLine (this->lineIter);  // effectively does a lineIter++
+      this->atEnd (this->lineIter);       // ensure next line read if streaming
       this->colNo = 0;
       this->setChanged ();
    }
@@ -844,8 +1403,7 @@ bool DataBuffer::right (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   const std::string line = this->currentLine ();
-   const int len = line.length();
+   const int len = this->currentLine ().length();
 
    int deltaCol = MIN (number, (len - this->colNo));
    this->colNo += deltaCol;
@@ -867,6 +1425,7 @@ bool DataBuffer::move (const int number)
          break;
       }
       this->lineIter++;
+      this->atEnd (this->lineIter);   // ensure next line read if streaming
       this->colNo = 0;
       this->setChanged ();
    }
@@ -936,58 +1495,62 @@ bool DataBuffer::nowBack (const int number)
 }
 
 //------------------------------------------------------------------------------
-// Replace control and non displayable characters.
-// Note: this function creates a new string.
+// Writes up to n characters of text, starting at pos, to the stream, showing
+// control characters as coloured escapes. Runs of regular characters are
+// written directly from the line, so printing needs no temporary strings.
 //
-static std::string replace_control_chars (const std::string& text)
+static void put_text (std::ostream& stream, const std::string& text,
+                      const size_t pos, const size_t n)
 {
    static const char hex [17] = "0123456789abcdef";
    static const char* blue = "\033[36;1m";
    static const char* reset = "\033[00m";
 
-   std::string result;
+   const size_t finish = MIN (text.size(), pos + n);
+   size_t plain = pos;   // start of the pending run of regular characters
 
-   for (size_t j = 0 ; j < text.size(); j++) {
+   for (size_t j = pos ; j < finish; j++) {
       const char c = text[j];
       const unsigned char uc = c;
 
+      if ((uc >= 0x20) && (uc < 0x7f)) {
+         // Just a regular character.
+         //
+         continue;
+      }
+
+      stream.write (text.data() + plain, j - plain);
+      plain = j + 1;
+
       // Do specials to \0, \t, \n and \r.
+      char special [5] = "";
       if (c == '\0') {
-         result += blue;
-         result += "\\0";
-         result += reset;
+         strcpy (special, "\\0");
       } else if (c == '\t') {
-         result += blue;
-         result += "\\t";
-         result += reset;
+         strcpy (special, "\\t");
       } else if (c == '\n') {
-         result += blue;
-         result += "\\n";
-         result += reset;
+         strcpy (special, "\\n");
       } else if (c == '\r') {
-         result += blue;
-         result += "\\r";
-         result += reset;
-      } else if ((uc < 0x20) || (uc >= 0x7f)) {
-         result += blue;
-         result += "\\x";
-         result.push_back (hex [uc / 16]);
-         result.push_back (hex [uc % 16]);
-         result += reset;
+         strcpy (special, "\\r");
       } else {
-         // Just a regular character.
-         //
-         result.push_back (c);
+         special [0] = '\\';
+         special [1] = 'x';
+         special [2] = hex [uc / 16];
+         special [3] = hex [uc % 16];
+         special [4] = '\0';
       }
+      stream << blue << special << reset;
    }
 
-   return result;
+   stream.write (text.data() + plain, finish - plain);
 }
 
 //------------------------------------------------------------------------------
 //
 bool DataBuffer::printDirection (const Direction direction, const int number)
 {
+   std::ostream& report = this->session.report ();
+
    // These colour code may be Linux specific....
    //
    static const char* red    = "\033[31;1m";   // cursor '^'
@@ -1001,15 +1564,15 @@ bool DataBuffer::printDirection (const Direction direction, const int number)
 
    // Colourise the cursor and end of line
    //
-   const std::string cm  = std::string(red) + Global::getCursorMark() + reset;
+   const char mark = this->session.getCursorMark();
 
-   std::string eol = "";
+   char eol [20] = "";
 
    // Setup the format string for consistant line number widths.
    //
    char format [32];
 
-   if (Global::getShowLineNumbers()) {
+   if (this->session.getShowLineNumbers()) {
       const int n = this->data.size();
 
       // Determine the required line number width.
@@ -1029,7 +1592,7 @@ bool DataBuffer::printDirection (const Direction direction, const int number)
       // Colourise the line numbers - yellow not so good on a white screen.
       //
       snprintf (format, sizeof (format), "%%%dd ", m);
-      eol = navy + std::string (".") + reset;
+      snprintf (eol, sizeof (eol), "%s.%s", navy, reset);
    }
 
    int lineNo = this->currentLineNo();
@@ -1045,28 +1608,31 @@ bool DataBuffer::printDirection (const Direction direction, const int number)
          if (!result) break;
       }
 
-      std::string lineno = "";
+      // Colourised line number, formatted in place as std::string would
+      // otherwise allocate for every line printed.
+      //
+      char lineno [40] = "";
       int lnbLength = 0;
-      if (Global::getShowLineNumbers()) {
+      if (this->session.getShowLineNumbers()) {
          char lnb [8] = "";
          snprintf (lnb, sizeof (lnb), format, lineNo);
          lnbLength = strlen(lnb);
-         lineno = yellow + std::string (lnb) + reset;
+         snprintf (lineno, sizeof (lineno), "%s%s%s", yellow, lnb, reset);
       }
 
       if (this->lineIter == this->data.end ()){
          // Colourise the **END**
          //
-         std::cerr << lineno << green << "**END**" << reset << std::endl;
+         report << lineno << green << "**END**" << reset << std::endl;
 
       } else {
-         const std::string line = this->currentLine ();
+         const std::string& line = this->currentLine ();
          const int lineLen = line.length();
 
          // Characters per line: subtract the line number length and
          // another 1 for the cursor.
          //
-         int cpl = Global::getTerminalMax() - lnbLength - 1;
+         int cpl = this->session.getTerminalMax() - lnbLength - 1;
 
          int numSubLines = (lineLen + cpl - 1) / cpl;   // round up
          if (numSubLines == 0) {
@@ -1085,14 +1651,17 @@ bool DataBuffer::printDirection (const Direction direction, const int number)
                // Yes: need the cursor. Cursor shown and end of sub-line rather
                // than at the start of the next sub-line.
                //
-               const std::string part1 = replace_control_chars (line.substr (first, this->colNo - first));
-               const std::string part2 = replace_control_chars (line.substr (this->colNo, last - this->colNo));
-               std::cerr << lineno << part1 << cm << part2 << eol << std::endl;
+               report << lineno;
+               put_text (report, line, first, this->colNo - first);
+               report << red << mark << reset;
+               put_text (report, line, this->colNo, last - this->colNo);
+               report << eol << std::endl;
             } else {
                // No need for the cursor.
                //
-               const std::string part = replace_control_chars (line.substr (first, cpl));
-               std::cerr << lineno << part << eol << std::endl;
+               report << lineno;
+               put_text (report, line, first, cpl);
+               report << eol << std::endl;
             }
          }
       }
@@ -1123,13 +1692,13 @@ bool DataBuffer::quary (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   const std::string line = this->currentLine ();
+   const std::string& line = this->currentLine ();
    const int len = line.length();
 
    const bool result = this->colNo + number <= len;
    const int size = MIN (number, len - this->colNo);
 
-   Global::setLastModify (line.substr (this->colNo, size));
+   this->session.setLastModify (std::string_view (line).substr (this->colNo, size));
 
    return result;
 }
@@ -1140,11 +1709,11 @@ bool DataBuffer::quaryBack (const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   const std::string line = this->currentLine();
+   const std::string& line = this->currentLine();
    const bool result = this->colNo >= number;
    const int size = MIN (number, this->colNo);
 
-   Global::setLastModify (line.substr (this->colNo - size, size));
+   this->session.setLastModify (std::string_view (line).substr (this->colNo - size, size));
 
    return result;
 }
@@ -1152,13 +1721,13 @@ bool DataBuffer::quaryBack (const int number)
 //------------------------------------------------------------------------------
 //
 bool DataBuffer::substituteDirection (const Direction direction,
-                                      const std::string text,
+                                      const std::string_view text,
                                       const int number)
 {
    if (this->lineIter == this->data.end ()) return false;
    if (this->lastSearchType == stVoid) return false;
 
-   const std::string line = this->currentLine ();
+   const std::string& line = this->currentLine ();
 
    const std::string::size_type replaceLen = this->lastSearchText.length ();
 
@@ -1170,27 +1739,38 @@ bool DataBuffer::substituteDirection (const Direction direction,
          (this->lastSearchType == stVerifyBack)  ||
          (this->lastSearchType == stTraverseBack);
 
+   // Note: replaceLen is unsigned.
+   //
    if (isLeft) {
-      this->colNo = MAX (0, this->colNo - replaceLen);
+      this->colNo = MAX (0, this->colNo - int (replaceLen));
    }
 
    // We should not need this MIN check here, but does no harm.
    //
    const int from = MIN (line.length(), this->colNo + replaceLen);
+   const size_t oldLength = from - this->colNo;
+   const size_t newLength = text.length() * MAX (number, 0);
 
-   const std::string part1 = line.substr (0, this->colNo);
-   const std::string part2 = line.substr (from);  // to end of the line
-
-   // Replicated substituted text.
+   // Replace with the replicated text in place, unless the line already
+   // holds exactly that text.
    //
-   std::string subText = "";
-   for (int j = 0; j < number; j++) {
-      subText.append (text);
+   bool same = (oldLength == newLength);
+   for (int j = 0; same && j < number; j++) {
+      same = (line.compare (this->colNo + j * text.length(), text.length(), text) == 0);
+   }
+
+   if (!same) {
+      std::string& edit = this->editLine ();
+      const size_t capacity = edit.capacity ();
+      edit.erase (this->colNo, oldLength);
+      for (int j = 0; j < number; j++) {
+         edit.insert (this->colNo + j * text.length(), text);
+      }
+      if (edit.capacity () != capacity) this->counters.allocations++;
    }
 
-   this->replaceLine (part1 + subText + part2);
    if (direction == Forward) {
-      this->colNo += subText.length();
+      this->colNo += newLength;
    }
 
    this->setChanged ();
@@ -1200,14 +1780,14 @@ bool DataBuffer::substituteDirection (const Direction direction,
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::substitute (const std::string text, const int number)
+bool DataBuffer::substitute (const std::string_view text, const int number)
 {
    return this->substituteDirection (Forward, text, number);
 }
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::substituteBack (const std::string text, const int number)
+bool DataBuffer::substituteBack (const std::string_view text, const int number)
 {
    return this->substituteDirection (Reverse, text, number);
 }
@@ -1216,7 +1796,7 @@ bool DataBuffer::substituteBack (const std::string text, const int number)
 // search type commands
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::find (const int limit, const std::string text, const int number)
+bool DataBuffer::find (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was a find and
    // we are finding the same text.
@@ -1238,7 +1818,7 @@ bool DataBuffer::find (const int limit, const std::string text, const int number
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::findBack (const int limit, const std::string text, const int number)
+bool DataBuffer::findBack (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was a findBack and
    // we are finding the same text.
@@ -1266,7 +1846,7 @@ bool DataBuffer::findBack (const int limit, const std::string text, const int nu
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::traverse (const int limit, const std::string text, const int number)
+bool DataBuffer::traverse (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was a traverse and
    // we are finding the same text.
@@ -1291,7 +1871,7 @@ bool DataBuffer::traverse (const int limit, const std::string text, const int nu
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::traverseBack (const int limit, const std::string text, const int number)
+bool DataBuffer::traverseBack (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was a traverseBack and
    // we are finding the same text.
@@ -1320,7 +1900,7 @@ bool DataBuffer::traverseBack (const int limit, const std::string text, const in
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::uncover (const int limit, const std::string text, const int number)
+bool DataBuffer::uncover (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was a uncover and
    // we are finding the same text.
@@ -1334,21 +1914,20 @@ bool DataBuffer::uncover (const int limit, const std::string text, const int num
       const Iterator lineWhereWeWere = this->lineIter;
       const int colWhereWeWere = this->colNo;
 
-      const std::string part1 = this->currentLine ().substr(0, colWhereWeWere);
-
       result = this->locate (limit, text, skip);
       if (!result) break;
 
       if (this->lineIter == lineWhereWeWere) {
          // Found text on the same line.
          //
-         std::string line = this->currentLine();
-         line.erase (colWhereWeWere, this->colNo - colWhereWeWere);
-         this->replaceLine (line);
+         if (this->colNo > colWhereWeWere) {
+            this->editLine ().erase (colWhereWeWere, this->colNo - colWhereWeWere);
+         }
          this->colNo = colWhereWeWere;
          this->setChanged ();
 
       } else {
+         const std::string part1 = lineWhereWeWere->substr(0, colWhereWeWere);
          const std::string part2 = this->currentLine ().substr(this->colNo);
 
          for (Iterator u = lineWhereWeWere; u != this->lineIter;) {
@@ -1371,7 +1950,7 @@ bool DataBuffer::uncover (const int limit, const std::string text, const int num
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::uncoverBack (const int limit, const std::string text, const int number)
+bool DataBuffer::uncoverBack (const int limit, const std::string_view text, const int number)
 {
    // Set skip 1 if the last command was an uncoverBack and
    // we are finding the same text.
@@ -1384,8 +1963,6 @@ bool DataBuffer::uncoverBack (const int limit, const std::string text, const int
       const Iterator lineWhereWeWere = this->lineIter;
       const int colWhereWeWere = this->colNo;
 
-      const std::string part2 = this->currentLine ().substr(this->colNo);
-
       result = this->locateBack (limit, text, skip);
       if (!result) break;
 
@@ -1393,15 +1970,18 @@ bool DataBuffer::uncoverBack (const int limit, const std::string text, const int
       this->colNo += text.length();
 
       if (this->lineIter == lineWhereWeWere) {
-         // Found text on the same line.
+         // Found text on the same line. This may be the end itself, e.g. an
+         // empty text after an earlier uncover back from the end.
          //
-         std::string line = this->currentLine();
-         line.erase (this->colNo, colWhereWeWere - this->colNo);
-         this->replaceLine (line);
+         if ((colWhereWeWere > this->colNo) && (this->lineIter != this->data.end ())) {
+            this->editLine ().erase (this->colNo, colWhereWeWere - this->colNo);
+         }
          this->setChanged ();
 
       } else {
          const std::string part1 = this->currentLine ().substr(0, this->colNo);
+         const std::string part2 = (lineWhereWeWere != this->data.end ()) ?
+                                   lineWhereWeWere->substr(colWhereWeWere) : "";
 
          while (this->lineIter != lineWhereWeWere) {
             this->removeLine (this->lineIter);  // removeLine does lineIter++
@@ -1422,19 +2002,18 @@ bool DataBuffer::uncoverBack (const int limit, const std::string text, const int
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::verify (const std::string text)
+bool DataBuffer::verify (const std::string_view text)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   const std::string line = this->currentLine();
+   const std::string& line = this->currentLine();
 
    const int tlen = text.length();
    const int amount = line.length() - this->colNo;
    if (tlen > amount) return false;
 
-   const std::string extract = line.substr (this->colNo, tlen);
-
-   bool result = (extract == text);
+   this->counters.bytesCompared += tlen;
+   bool result = (line.compare (this->colNo, tlen, text) == 0);
    if (result) {
       this->lastSearchType = stVerify;
       this->lastSearchText = text;
@@ -1445,19 +2024,18 @@ bool DataBuffer::verify (const std::string text)
 
 //------------------------------------------------------------------------------
 //
-bool DataBuffer::verifyBack (const std::string text)
+bool DataBuffer::verifyBack (const std::string_view text)
 {
    if (this->lineIter == this->data.end ()) return false;
 
-   const std::string line = this->currentLine();
+   const std::string& line = this->currentLine();
 
    const int tlen = text.length();
    const int amount = this->colNo;
    if (tlen > amount) return false;
 
-   const std::string extract = line.substr (this->colNo - tlen, tlen);
-
-   bool result = (extract == text);
+   this->counters.bytesCompared += tlen;
+   bool result = (line.compare (this->colNo - tlen, tlen, text) == 0);
    if (result) {
       this->lastSearchType = stVerifyBack;
       this->lastSearchText = text;
@@ -1470,9 +2048,17 @@ bool DataBuffer::verifyBack (const std::string text)
 //
 bool DataBuffer::writeDirection (const Direction direction, const int number)
 {
-   if (!this->outputStream.is_open()) return false;
+   if (!this->outputWriter.isOpen()) return false;
+
+   // Gather up the lines and write them in batches rather than line by line.
+   // The move/moveBack calls do not modify the lines themselves, so the
+   // gathered line references remain valid.
+   //
+   static const size_t batchSize = 1024;
+   std::vector<const std::string*> lines;
 
    bool result = true;
+   bool okay = true;
    for (int j = 0; j < number; j++) {
       if (j >= 1) {
          if (direction == Forward) {
@@ -1485,12 +2071,19 @@ bool DataBuffer::writeDirection (const Direction direction, const int number)
       }
 
       if (this->lineIter != this->data.end ()) {
-         const std::string line = this->currentLine ();
-         this->outputStream << line << std::endl;
+         lines.push_back (&(*this->lineIter));
+         if (lines.size() >= batchSize) {
+            okay = this->outputWriter.putLines (lines) && okay;
+            lines.clear();
+         }
       }
    }
 
-   return result;
+   if (lines.size() > 0) {
+      okay = this->outputWriter.putLines (lines) && okay;
+   }
+
+   return result && okay;
 }
 
 //------------------------------------------------------------------------------
@@ -14,7 +14,9 @@
 
 #include <list>
 #include <string>
-#include <fstream>
+#include <string_view>
+#include "line_io.h"
+#include "session.h"
 
 class DataBuffer
 {
@@ -24,16 +26,121 @@ public:
       Reverse       // Aka backwards
    };
 
+   // Save modes - see LineWriter::openForSave.
+   //
+   enum SaveMode {
+      InPlace,      // preserves the inode
+      Replace       // write temporary file and rename
+   };
+
+   // The buffer is associated with the given session, or by default the
+   // current session (see Global::session), which commands executed on the
+   // buffer then use.
+   //
    explicit DataBuffer();
+   explicit DataBuffer(Session& session);
    ~DataBuffer();
 
+   Session& getSession () const;
+
    // For load/save, a file name of "-" interpreted as stdin or stdout
    // If filename is really "-", then user must use "./-" or similar trick.
    //
    static std::string stdInOut ();
 
-   bool load (const std::string filename);
-   bool save (const std::string filename);
+   bool load (const std::string& filename);
+   bool save (const std::string& filename, const SaveMode mode = InPlace);
+
+   // If save fails, but a complete copy of the data was nevertheless
+   // written to another file, returns the name of that file.
+   //
+   const std::string& getRecoveryName () const;
+
+   typedef std::list<std::string> StringList;
+
+   // In memory alternatives to load and save. loadText splits the text into
+   // lines as load does, i.e. a last line with a missing newline is treated as
+   // a complete line. loadLines takes the lines as is, without copying, and
+   // leaves lines empty. getLines provides read only access to the contents,
+   // and saveText replaces text with the contents as saved by save.
+   //
+   void loadText (const char* text, const size_t size);
+   void loadLines (StringList& lines);
+   const StringList& getLines () const;
+   void saveText (std::string& text) const;
+
+   // Streaming (shell mode) alternative to load ("-"). Lines are read from
+   // standard input as and when the cursor advances, and lines more than
+   // window lines behind the cursor are written to standard output and
+   // discarded by retire. Commands that move back more than window lines
+   // just find the start of the (remaining) data.
+   //
+   bool loadStream (const int window);
+   bool isStreaming () const;
+
+   // Only called between commands, i.e. when no other iterators are in use.
+   //
+   void retire ();
+
+   // A cheap snapshot of the contents version and the cursor location, used
+   // to detect * loops that are no longer making progress. The version is
+   // incremented whenever a line is added, removed or actually modified.
+   //
+   struct Position {
+      unsigned long version;
+      const std::string* line;   // nullptr at the end
+      int col;
+
+      bool operator== (const Position& other) const {
+         // The line is only compared when the versions match, i.e. when the
+         // line is known not to have been removed.
+         return (this->version == other.version) &&
+                (this->line == other.line) && (this->col == other.col);
+      }
+   };
+
+   Position getPosition () const;
+
+   // The current line number. This walks from the line last numbered, so is
+   // cheap when the cursor has only moved a short distance.
+   //
+   int currentLineNo() const;
+
+   // Hot path counters, i.e. the work done by the commands executed on this
+   // buffer, to help explain why a command or script is slow. Only counts
+   // the buffer's own work - not the parser, nor line input/output buffers.
+   //
+   struct Counters {
+      unsigned long linesScanned;     // lines visited by searches
+      unsigned long bytesCompared;    // bytes searched or verified
+      unsigned long lineCopies;       // line texts copied into the buffer
+      unsigned long allocations;      // line node and text heap allocations
+      unsigned long linesAllocated;   // lines added to the buffer
+      unsigned long linesFreed;       // lines removed from the buffer
+   };
+
+   const Counters& getCounters () const;
+   void resetCounters ();
+   void showCounters (std::ostream& stream) const;   // for %V5
+
+   // The memory used by the lines, in bytes, as total = payload + container +
+   // slack + arena. The container overhead is the list nodes (including each
+   // string object) less any text held within the string object itself. The
+   // slack is unused capacity of text held on the heap, and the arena waste
+   // is the heap's rounding up of each allocation, which is estimated for a
+   // glibc style malloc. Calculated on request, as this visits every line.
+   //
+   struct Memory {
+      unsigned long lines;
+      unsigned long payload;     // text bytes, i.e. sum of line lengths
+      unsigned long container;
+      unsigned long slack;
+      unsigned long arena;
+      unsigned long total;
+   };
+
+   Memory getMemory () const;
+   void showMemory (std::ostream& stream) const;     // for %V6
 
    void clearChanged ();
    void setChanged ();
@@ -55,76 +162,102 @@ public:
    //
    bool absorbe (const int number);
    bool breakLine (const int number);
-   bool connect (const std::string filename);
-   bool deleteText (const int limit, const std::string text, const int number);
+   bool connect (const std::string& filename);
+   bool deleteText (const int limit, const std::string_view text, const int number);
    bool erase (const int number);
-   bool find (const int limit, const std::string text, const int number);
+   bool find (const int limit, const std::string_view text, const int number);
    bool get (const int number);
    bool upperCase (const int number);
-   bool insert (const std::string text, const int number);
+   bool insert (const std::string_view text, const int number);
    bool join (const int number);
    bool kill (const int number);
    bool left (const int number);
    bool move (const int number);
    bool now (const int number);
-   bool output (const std::string filename);
+   bool output (const std::string& filename);
    bool print (const int number);
    bool quary (const int number);
    bool right (const int number);
-   bool substitute (const std::string text, const int number);
-   bool traverse (const int limit, const std::string text, const int number);
-   bool uncover (const int limit, const std::string text, const int number);
-   bool verify (const std::string text);
+   bool substitute (const std::string_view text, const int number);
+   bool traverse (const int limit, const std::string_view text, const int number);
+   bool uncover (const int limit, const std::string_view text, const int number);
+   bool verify (const std::string_view text);
    bool write (const int number);
 
    // Reverse/backwards commands.
    //
    bool absorbeBack (const int number);
    bool breakLineBack (const int number);
-   bool deleteBack (const int limit, const std::string text, const int number);
+   bool deleteBack (const int limit, const std::string_view text, const int number);
    bool eraseBack (const int number);
-   bool findBack (const int limit, const std::string text, const int number);
+   bool findBack (const int limit, const std::string_view text, const int number);
    bool getBack (const int number);
    bool lowerCase (const int number);
-   bool insertBack (const std::string text, const int number);
+   bool insertBack (const std::string_view text, const int number);
    bool joinBack (const int number);
    bool killBack (const int number);
    bool moveBack (const int number);
    bool nowBack (const int number);
    bool printBack (const int number);
    bool quaryBack (const int number);
-   bool substituteBack (const std::string text, const int number);
-   bool traverseBack (const int limit, const std::string text, const int number);
-   bool uncoverBack (const int limit, const std::string text, const int number);
-   bool verifyBack (const std::string text);
+   bool substituteBack (const std::string_view text, const int number);
+   bool traverseBack (const int limit, const std::string_view text, const int number);
+   bool uncoverBack (const int limit, const std::string_view text, const int number);
+   bool verifyBack (const std::string_view text);
    bool writeBack (const int number);
 
 private:
-   typedef std::list<std::string> StringList;
+   // Don't allow copying.
+   //
+   explicit DataBuffer (const DataBuffer&);
+   DataBuffer& operator= (const DataBuffer&);
+
+   void initialise ();
+
    typedef StringList::iterator   Iterator;
 
    // These operate on data (StringList).
    // Apart from removeLine, all operate on the current line
-   // They do not update colNo.
+   // They do not update colNo. See also editLine.
    // Make inline?
    //
-   void appendLine (const std::string line);   // to end of file
-   void insertLine (const std::string line);   // before current line
+   void appendLine (const std::string& line);   // to end of file
+   void insertLine (const std::string& line);   // before current line
    void removeLine (Iterator& iter);
-   void replaceLine (const std::string line);  // replace current line
+   void replaceLine (const std::string& line);  // replace current line
+
+   // Count lines added to and removed from the data, and the heap
+   // allocations for the added lines.
+   //
+   void countAdded (const std::string& line);
+   void countAdded (const StringList& lines);
+   void countRemoved (const size_t number);
+
+   void forgetLineNo ();
+
+   // Writes out the remaining lines when streaming.
+   //
+   bool saveStream ();
 
    // Returns the current line (or empty line).
    //
-   std::string currentLine() const;
+   const std::string& currentLine() const;
 
-   // finds the current line number.
+   // Returns the current line, which must exist, for in place modification.
+   // Counts as a change to the contents - see getPosition.
    //
-   int currentLineNo() const;
+   std::string& editLine ();
+
+   // Returns true if iter is at the end of the data. When streaming, more
+   // lines are read when needed, in which case iter (and lineIter if also at
+   // the end) are updated to refer to the first new line.
+   //
+   bool atEnd (Iterator& iter);
 
    // Basic search functions.
    //
-   bool locate     (const int searchLimit, const std::string text, const int skip);
-   bool locateBack (const int searchLimit, const std::string text, const int skip);
+   bool locate     (const int searchLimit, const std::string_view text, const int skip);
+   bool locateBack (const int searchLimit, const std::string_view text, const int skip);
 
    // Combined functionality where forward and reverse version of the command
    // are similar.
@@ -133,20 +266,43 @@ private:
    bool breakDirection      (const Direction direction, const int number);
    bool getDirection        (const Direction direction, const int number);
    bool insertDirection     (const Direction direction,
-                             const std::string text, const int number);
+                             const std::string_view text, const int number);
    bool nowDirection        (const Direction direction, const int number);
    bool printDirection      (const Direction direction, const int number);
    bool substituteDirection (const Direction direction,
-                             const std::string text, const int number);
+                             const std::string_view text, const int number);
    bool writeDirection      (const Direction direction, const int number);
 
    StringList data;
 
    Iterator lineIter;    // 0 .. m  where m is current number of lines
    int colNo;            // 0 .. n  where n is line length
+   unsigned long version;   // see getPosition
 
-   std::ifstream inputStream;    // connect and absorbe
-   std::ofstream outputStream;   // output and write
+   // The line last numbered by currentLineNo and its index, i.e. excluding
+   // retired lines. Kept up to date by insertions and removals at that line,
+   // and otherwise forgotten.
+   //
+   mutable Iterator numberedIter;
+   mutable int numberedIndex;
+   mutable bool numberedValid;
+   Counters counters;
+
+   std::string loadedName;       // as passed to load
+   std::string recoveryName;     // as set by save
+   Compressions compression;     // compression of the loaded file
+
+   LineReader inputReader;       // connect and absorbe
+   LineWriter outputWriter;      // output and write
+
+   // Streaming state.
+   //
+   bool streaming;
+   int window;                   // lines retained behind the cursor
+   long retired;                 // number of lines written and discarded
+   size_t retireCheck;           // retire only when data size exceeds this
+   LineReader streamReader;
+   LineWriter streamWriter;
 
    bool changed;         // indicates some print worthy change has occured.
 
@@ -167,6 +323,8 @@ private:
 
    SearchType  lastSearchType;
    std::string lastSearchText;   // this is not neccesarily Global::setLastSearch
+
+   Session& session;
 };
 
 #endif // ACE_DATA_BUFFER_H
@@ -0,0 +1,156 @@
+/* editor.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "editor.h"
+#include "command_parser.h"
+#include "global.h"
+
+//------------------------------------------------------------------------------
+//
+Editor::Editor () :
+   ownSession (new Session ()),
+   session (*ownSession),
+   buffer (*ownSession)
+{
+}
+
+//------------------------------------------------------------------------------
+//
+Editor::Editor (Session& sessionIn) :
+   ownSession (nullptr),
+   session (sessionIn),
+   buffer (sessionIn)
+{
+}
+
+//------------------------------------------------------------------------------
+//
+Editor::~Editor ()
+{
+   // The buffer is destroyed after this, but does not use the session
+   // when destroyed.
+   //
+   delete this->ownSession;
+}
+
+//------------------------------------------------------------------------------
+//
+Session& Editor::getSession () const
+{
+   return this->session;
+}
+
+//------------------------------------------------------------------------------
+//
+DataBuffer& Editor::getBuffer ()
+{
+   return this->buffer;
+}
+
+//------------------------------------------------------------------------------
+//
+void Editor::load (const std::string& text)
+{
+   this->buffer.loadText (text.data(), text.length());
+}
+
+//------------------------------------------------------------------------------
+//
+void Editor::load (const char* text, const size_t size)
+{
+   this->buffer.loadText (text, size);
+}
+
+//------------------------------------------------------------------------------
+//
+void Editor::load (DataBuffer::StringList& lines)
+{
+   this->buffer.loadLines (lines);
+}
+
+//------------------------------------------------------------------------------
+//
+const DataBuffer::StringList& Editor::getLines () const
+{
+   return this->buffer.getLines ();
+}
+
+//------------------------------------------------------------------------------
+//
+void Editor::save (std::string& text) const
+{
+   this->buffer.saveText (text);
+}
+
+//------------------------------------------------------------------------------
+//
+CompoundCommands* Editor::compile (const std::string& commandLine) const
+{
+   return CommandParser::parse (commandLine, this->session);
+}
+
+//------------------------------------------------------------------------------
+//
+bool Editor::run (const CompoundCommands& commands)
+{
+   ExecutionState state;
+   return this->run (commands, state);
+}
+
+//------------------------------------------------------------------------------
+// The session is made the current session while running, so that anything
+// that uses the current session, e.g. a failed command's image, uses this
+// editor's session.
+//
+bool Editor::run (const CompoundCommands& commands, ExecutionState& state)
+{
+   Session& saved = Global::session ();
+   Global::setSession (&this->session);
+
+   this->buffer.clearChanged ();   // clear the "dirty" flag.
+   this->session.clearInterruptRequest ();
+   this->session.setExecutionInProgress ();
+   const bool result = commands.execute (this->buffer, state);
+   this->session.clearExecutionInProgress ();
+
+   this->failure.clear ();
+   if (!result) {
+      const AbstractCommands* lastCommand = state.lastCommand;
+      this->failure = lastCommand ? lastCommand->image() : "None";
+   }
+
+   Global::setSession (&saved);
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Editor::run (const std::string& commandLine)
+{
+   CompoundCommands* commands = this->compile (commandLine);
+   if (!commands) {
+      this->failure = "Parse failure: " + commandLine;
+      return false;
+   }
+
+   const bool result = this->run (*commands);
+   delete commands;
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Editor::getFailure () const
+{
+   return this->failure;
+}
+
+// end
@@ -0,0 +1,91 @@
+/* editor.h
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef ACE_EDITOR_H
+#define ACE_EDITOR_H
+
+#include <string>
+#include "commands.h"
+#include "data_buffer.h"
+#include "session.h"
+
+// The entry point for using ace in process (libace), as opposed to running
+// the ace program: an edit session and the buffer being edited. Command lines
+// are compiled once, and may then be run any number of times, on any editor.
+//
+// Example:
+//
+//    Editor editor;
+//    editor.load (text);
+//    if (editor.run ("(f/old/ s/new/)*")) {
+//       editor.save (text);
+//    }
+//
+// Each editor is independent, so different editors may be used on different
+// threads, provided that each has its own session. The parser keeps its state
+// per session, so editors on different threads may compile at the same time.
+// Compiled command lines are not modified when run, and so may be run by
+// editors on different threads at the same time.
+//
+class Editor
+{
+public:
+   // The editor uses the given session, or by default, its own session.
+   //
+   explicit Editor ();
+   explicit Editor (Session& session);
+   ~Editor ();
+
+   Session& getSession () const;
+   DataBuffer& getBuffer ();
+
+   // Replaces the buffer contents, see DataBuffer::loadText and loadLines.
+   // The cursor is placed at the start of the buffer.
+   //
+   void load (const std::string& text);
+   void load (const char* text, const size_t size);
+   void load (DataBuffer::StringList& lines);
+
+   // The buffer contents, as lines without copying, or as text.
+   //
+   const DataBuffer::StringList& getLines () const;
+   void save (std::string& text) const;
+
+   // Parses a command line using this editor's session (macros etc.).
+   // Returns nullptr on parse failure. The returned object must be deleted.
+   //
+   CompoundCommands* compile (const std::string& commandLine) const;
+
+   // Runs compiled commands on the buffer. Returns the command status, and
+   // on failure, getFailure provides an image of the failed command.
+   //
+   bool run (const CompoundCommands& commands);
+   bool run (const CompoundCommands& commands, ExecutionState& state);
+
+   // Compiles and runs a command line. Returns false on parse failure.
+   //
+   bool run (const std::string& commandLine);
+
+   const std::string& getFailure () const;
+
+private:
+   // Don't allow copying.
+   //
+   explicit Editor (const Editor&);
+   Editor& operator= (const Editor&);
+
+   Session* ownSession;   // when not using a given session
+   Session& session;
+   DataBuffer buffer;
+   std::string failure;
+};
+
+#endif // ACE_EDITOR_H
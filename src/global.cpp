@@ -14,43 +14,13 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
 #include <iostream>
 
-#include "command_parser.h"
-
 // all static
 //
-Global::GetLineFuncPtr Global::getLineFunc = nullptr;
-
-std::string Global::targetFilename = "";
-
-bool Global::interruptRequest = false;
-bool Global::executeInProgress = false;
-
-bool Global::closeRequest     = false;
-bool Global::abandonRequest   = false;
-int Global::exitCode          = 0;
-
-std::string Global::macroX   = "";
-std::string Global::macroY   = "";
-std::string Global::macroZ   = "";
-
-std::string Global::lastModify   = "";
-std::string Global::lastSearch   = "";
-std::string Global::lastFilename = "";
-
-char Global::cursorMark      = '^';
-char Global::smartQuote      = ':';
-
-Global::Modes Global::mode     = Global::Monitor;
-bool          Global::promptOn = true;
-bool          Global::lineNumbers = false;
-
-int Global::searchMax = 100000;
-int Global::repeatMax = 50000;
-int Global::terminalMax = 160;
-
-static const std::string modeImages [3] = { "Monitor", "Full", "Quiet" };
+Session Global::defaultSession;
+thread_local Session* Global::current = &Global::defaultSession;
 
 //==============================================================================
 //
@@ -62,85 +32,74 @@ Global::Global() { }
 //
 Global::~Global() { }
 
+//------------------------------------------------------------------------------
+//
+Session& Global::session ()
+{
+   return *Global::current;
+}
+
+//------------------------------------------------------------------------------
+//
+void Global::setSession (Session* session)
+{
+   Global::current = session ? session : &Global::defaultSession;
+}
+
 //------------------------------------------------------------------------------
 //
 void Global::setGetLineFunction (GetLineFuncPtr getLineFuncIn)
 {
-   Global::getLineFunc = getLineFuncIn;
+   Global::session ().setGetLineFunction (getLineFuncIn);
 }
 
 //------------------------------------------------------------------------------
 //
 Global::GetLineFuncPtr Global::getGetLineFunc ()
 {
-   return Global::getLineFunc;
+   return Global::session ().getGetLineFunc ();
 }
 
 //------------------------------------------------------------------------------
 //
 std::string Global::getLine (const char* prompt)
 {
-   if (!Global::getLineFunc) {
-      std::cerr << "get_line function undefined" << std::endl;
-      return "%c\n";
-   }
+   return Global::session ().getLine (prompt);
+}
 
-   return (*Global::getLineFunc) (prompt);
+//------------------------------------------------------------------------------
+//
+std::ostream& Global::report ()
+{
+   return Global::session ().report ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::show (const int detail, std::ostream& stream)
 {
-   // Include version ??
-   // Just do the lot ??
-
-   if (detail >= 0) {
-      stream << "Macro X = \"" << Global::macroX << '"' << std::endl;
-      stream << "Macro Y = \"" << Global::macroY << '"' << std::endl;
-      stream << "Macro Z = \"" << Global::macroZ << '"' << std::endl;
-   }
-
-   if (detail >= 1) {
-      stream << "Last Search: \"" << Global::lastSearch   << '"' << std::endl;
-      stream << "Last Modify: \"" << Global::lastModify   << '"' << std::endl;
-      stream << "Last File:   \"" << Global::lastFilename << '"' << std::endl;
-   }
-
-   if (detail >= 2) {
-      stream << "Monitor Mode: " << modeImages [Global::mode] << std::endl;
-      stream << "Line Numbers: " << (Global::lineNumbers ? "On" : "Off") << std::endl;
-      stream << "Prompting: "    << (Global::promptOn ? "On" : "Off") << std::endl;
-      stream << "Cursor: '"      << Global::cursorMark << "'" << std::endl;
-      stream << "Smart Quote: '" << Global::smartQuote << "'" << std::endl;
-   }
-
-   if (detail >= 3) {
-      stream << "Repeat Limit: " << Global::repeatMax << std::endl;
-      stream << "Search Limit: " << Global::searchMax << std::endl;
-      stream << "Terminal Max: " << Global::terminalMax << std::endl;
-   }
+   Global::session ().show (detail, stream);
 }
 
 //------------------------------------------------------------------------------
 //
-void Global::setTargetFilename (const std::string filename)
+void Global::setTargetFilename (const std::string& filename)
 {
-   Global::targetFilename = filename;
+   Global::session ().setTargetFilename (filename);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getTargetFilename ()
+const std::string& Global::getTargetFilename ()
 {
-   return Global::targetFilename;
+   return Global::session ().getTargetFilename ();
 }
 
 //------------------------------------------------------------------------------
 //
 std::string Global::getTemporaryFilename ()
 {
-   static int count = 0;
+   static std::atomic<int> count (0);
 
    char tempName [64];
 
@@ -164,283 +123,336 @@ std::string Global::getTemporaryFilename ()
 //
 void Global::setExecutionInProgress()
 {
-   Global::executeInProgress = true;
+   Global::session ().setExecutionInProgress ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::clearExecutionInProgress()
 {
-   Global::executeInProgress = false;
+   Global::session ().clearExecutionInProgress ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setInterruptRequest ()
 {
-   if (Global::executeInProgress) {
-      std::cerr << "\nSIGINT received - quiting current command sequence.\n";
-   }
-   Global::interruptRequest = true;
+   Global::session ().setInterruptRequest ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::clearInterruptRequest ()
 {
-   Global::interruptRequest = false;
+   Global::session ().clearInterruptRequest ();
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::getInterruptRequest ()
 {
-   return Global::interruptRequest;
+   return Global::session ().getInterruptRequest ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::requestClose (const int exitCodeIn)
 {
-   Global::closeRequest = true;
-   Global::exitCode = exitCodeIn;
+   Global::session ().requestClose (exitCodeIn);
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::getCloseRequested ()
 {
-   return Global::closeRequest;
+   return Global::session ().getCloseRequested ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::requestAbandon (const int exitCodeIn)
 {
-   Global::closeRequest = true;    // implicit
-   Global::abandonRequest = true;
-   Global::exitCode = exitCodeIn;
+   Global::session ().requestAbandon (exitCodeIn);
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::getAbandonRequested ()
 {
-   return Global::abandonRequest;
+   return Global::session ().getAbandonRequested ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setExitCode (const int exitCodeIn)
 {
-   Global::exitCode = exitCodeIn;
+   Global::session ().setExitCode (exitCodeIn);
 }
 
 //------------------------------------------------------------------------------
 //
 int Global::getExitCode ()
 {
-   return Global::exitCode;
+   return Global::session ().getExitCode ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setMacroX (const std::string& text)
 {
-   Global::macroX = text;
+   Global::session ().setMacroX (text);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getMacroX ()
+const std::string& Global::getMacroX ()
 {
-   return Global::macroX;
+   return Global::session ().getMacroX ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setMacroY (const std::string& text)
 {
-   Global::macroY = text;
+   Global::session ().setMacroY (text);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getMacroY ()
+const std::string& Global::getMacroY ()
 {
-   return Global::macroY;
+   return Global::session ().getMacroY ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setMacroZ (const std::string& text)
 {
-   Global::macroZ = text;
+   Global::session ().setMacroZ (text);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getMacroZ ()
+const std::string& Global::getMacroZ ()
 {
-   return Global::macroZ;
+   return Global::session ().getMacroZ ();
+}
+
+//------------------------------------------------------------------------------
+//
+int Global::getDefinitionsVersion ()
+{
+   return Global::session ().getDefinitionsVersion ();
+}
+
+//------------------------------------------------------------------------------
+//
+void Global::setOptimize (const bool isOn)
+{
+   Global::session ().setOptimize (isOn);
+}
+
+//------------------------------------------------------------------------------
+//
+bool Global::getOptimize ()
+{
+   return Global::session ().getOptimize ();
+}
+
+//------------------------------------------------------------------------------
+//
+void Global::setProfiling (const bool isOn)
+{
+   Global::session ().setProfiling (isOn);
+}
+
+//------------------------------------------------------------------------------
+//
+Profile* Global::getProfile ()
+{
+   return Global::session ().getProfile ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool Global::openTrace (const std::string& filename)
+{
+   return Global::session ().openTrace (filename);
+}
+
+//------------------------------------------------------------------------------
+//
+void Global::closeTrace ()
+{
+   Global::session ().closeTrace ();
+}
+
+//------------------------------------------------------------------------------
+//
+TraceLog* Global::getTraceLog ()
+{
+   return Global::session ().getTraceLog ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setMode (const Modes modeIn)
 {
-   Global::mode = modeIn;
+   Global::session ().setMode (modeIn);
 }
 
 //------------------------------------------------------------------------------
 //
 Global::Modes Global::getMode ()
 {
-   return Global::mode;
+   return Global::session ().getMode ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setShowLineNumbers (const bool showLineNumbersIn)
 {
-   Global::lineNumbers = showLineNumbersIn;
+   Global::session ().setShowLineNumbers (showLineNumbersIn);
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::getShowLineNumbers ()
 {
-   return Global::lineNumbers;
+   return Global::session ().getShowLineNumbers ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setPromptOn (const bool isOn)
 {
-   Global::promptOn = isOn;
+   Global::session ().setPromptOn (isOn);
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::getPromptOn ()
 {
-   return Global::promptOn;
+   return Global::session ().getPromptOn ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setSearchMax (const int max)
 {
-   Global::searchMax = (max >= 1) ? max : 1;
+   Global::session ().setSearchMax (max);
 }
 
 //------------------------------------------------------------------------------
 //
 int Global::getSearchMax ()
 {
-   return Global::searchMax;
+   return Global::session ().getSearchMax ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setRepeatMax (const int max)
 {
-   Global::repeatMax = (max >= 1) ? max : 1;
+   Global::session ().setRepeatMax (max);
 }
 
 //------------------------------------------------------------------------------
 //
 int Global::getRepeatMax ()
 {
-   return Global::repeatMax;
+   return Global::session ().getRepeatMax ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool Global::isRepeatMaxSet ()
+{
+   return Global::session ().isRepeatMaxSet ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setCursorMark (const char mark)
 {
-   Global::cursorMark = mark;
+   Global::session ().setCursorMark (mark);
 }
 
 //------------------------------------------------------------------------------
 //
 char Global::getCursorMark ()
 {
-   return Global::cursorMark;
+   return Global::session ().getCursorMark ();
 }
 
 //------------------------------------------------------------------------------
 //
 bool Global::setSmartQuote (const char quote)
 {
-   if (CommandParser::isQuote(quote)) {
-      Global::smartQuote = quote;
-      return true;
-   }
-   return false;
+   return Global::session ().setSmartQuote (quote);
 }
 
 //------------------------------------------------------------------------------
 //
 char Global::getSmartQuote ()
 {
-   return Global::smartQuote;
+   return Global::session ().getSmartQuote ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setTerminalMax (const int max)
 {
-   Global::terminalMax = (max >= 32) ? max : 32;
+   Global::session ().setTerminalMax (max);
 }
 
 //------------------------------------------------------------------------------
 //
 int Global::getTerminalMax ()
 {
-   return Global::terminalMax;
+   return Global::session ().getTerminalMax ();
 }
 
 //------------------------------------------------------------------------------
 //
-void Global::setLastSearch (const std::string& text)
+void Global::setLastSearch (const std::string_view text)
 {
-   Global::lastSearch = text;
+   Global::session ().setLastSearch (text);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getLastSearch ()
+const std::string& Global::getLastSearch ()
 {
-   return Global::lastSearch;
+   return Global::session ().getLastSearch ();
 }
 
 //------------------------------------------------------------------------------
 //
-void Global::setLastModify (const std::string& text)
+void Global::setLastModify (const std::string_view text)
 {
-   Global::lastModify = text;
+   Global::session ().setLastModify (text);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getLastModify ()
+const std::string& Global::getLastModify ()
 {
-   return Global::lastModify;
+   return Global::session ().getLastModify ();
 }
 
 //------------------------------------------------------------------------------
 //
 void Global::setLastFilename (const std::string& filename)
 {
-   Global::lastFilename = filename;
+   Global::session ().setLastFilename (filename);
 }
 
 //------------------------------------------------------------------------------
 //
-std::string Global::getLastFilename ()
+const std::string& Global::getLastFilename ()
 {
-   return Global::lastFilename;
+   return Global::session ().getLastFilename ();
 }
 
 // end
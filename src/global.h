@@ -13,27 +13,44 @@
 #define ACE_GLOBAL_H
 
 #include <string>
-
+#include <string_view>
+#include "session.h"
+
+// Provides access to the current session, and for convenience, static
+// functions that operate on the current session. The current session is per
+// thread, and is by default the one process wide default session, so threads
+// that edit or parse at the same time must each set their own session.
+//
 class Global
 {
 public:
-   enum Modes {
-      Monitor = 0,
-      Full,
-      Quiet
-   };
+   typedef Session::Modes Modes;
+   static const Modes Monitor = Session::Monitor;
+   static const Modes Full    = Session::Full;
+   static const Modes Quiet   = Session::Quiet;
+
+   typedef Session::GetLineFuncPtr GetLineFuncPtr;
 
-   typedef std::string (*GetLineFuncPtr) (const char* prompt);
+   // Returns the calling thread's current session.
+   //
+   static Session& session ();
+
+   // Sets the calling thread's current session, nullptr reverts to the
+   // default session. The session must outlive its use as current session.
+   //
+   static void setSession (Session* session);
 
    static void setGetLineFunction (GetLineFuncPtr getLineFunc);
    static GetLineFuncPtr getGetLineFunc ();
 
    static std::string getLine (const char* prompt);
 
+   static std::ostream& report ();
+
    static void show (const int detail, std::ostream& stream);
 
-   static void setTargetFilename (const std::string filename);
-   static std::string getTargetFilename ();
+   static void setTargetFilename (const std::string& filename);
+   static const std::string& getTargetFilename ();
 
    // More a utility than a global, however ...
    static std::string getTemporaryFilename ();
@@ -55,13 +72,31 @@ public:
    static int  getExitCode ();
 
    static void setMacroX (const std::string& text);
-   static std::string getMacroX ();
+   static const std::string& getMacroX ();
 
    static void setMacroY (const std::string& text);
-   static std::string getMacroY ();
+   static const std::string& getMacroY ();
 
    static void setMacroZ (const std::string& text);
-   static std::string getMacroZ ();
+   static const std::string& getMacroZ ();
+
+   // Changes whenever a macro, the smart quote or the optimize setting
+   // changes, i.e. whenever a command line might parse differently.
+   //
+   static int getDefinitionsVersion ();
+
+   // When on (the default), adjacent commands are fused when parsed, see
+   // Session::setOptimize.
+   //
+   static void setOptimize (const bool isOn);
+   static bool getOptimize ();
+
+   static void setProfiling (const bool isOn);
+   static Profile* getProfile ();
+
+   static bool openTrace (const std::string& filename);
+   static void closeTrace ();
+   static TraceLog* getTraceLog ();
 
    static void setMode (const Modes mode);
    static Modes getMode ();
@@ -75,8 +110,14 @@ public:
    static void setSearchMax (const int max);
    static int getSearchMax ();
 
+   // The repeat limit for * commands. Unless the limit has been explicitly set
+   // (%R), X* and (...)* loops are not limited, and stop when they fail or no
+   // longer make progress, except for I*, I-*, B*, B-*, N* and N-*, which can
+   // do neither, and so are limited by the default.
+   //
    static void setRepeatMax (const int max);
    static int getRepeatMax ();
+   static bool isRepeatMaxSet ();
 
    static void setCursorMark (const char mark);
    static char getCursorMark ();
@@ -87,45 +128,21 @@ public:
    static void setTerminalMax (const int max);
    static int getTerminalMax ();
 
-   static void setLastSearch (const std::string& text);
-   static std::string getLastSearch ();
+   static void setLastSearch (const std::string_view text);
+   static const std::string& getLastSearch ();
 
-   static void setLastModify (const std::string& text);
-   static std::string getLastModify ();
+   static void setLastModify (const std::string_view text);
+   static const std::string& getLastModify ();
 
    static void setLastFilename (const std::string& filename);
-   static std::string getLastFilename ();
+   static const std::string& getLastFilename ();
 
 private:
    Global();
    ~Global();
 
-   static GetLineFuncPtr getLineFunc;
-   static std::string targetFilename;
-
-   static bool interruptRequest;
-   static bool executeInProgress;
-   static bool closeRequest;
-   static bool abandonRequest;
-   static int exitCode;
-
-   static std::string macroX;
-   static std::string macroY;
-   static std::string macroZ;
-
-   static std::string lastModify;
-   static std::string lastSearch;
-   static std::string lastFilename;
-
-   static Modes mode;
-   static bool promptOn;
-   static bool lineNumbers;
-   static char cursorMark;
-   static char smartQuote;
-
-   static int searchMax;
-   static int repeatMax;
-   static int terminalMax;
+   static Session defaultSession;
+   static thread_local Session* current;
 };
 
 #endif // ACE_GLOBAL_H
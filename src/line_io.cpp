@@ -0,0 +1,1331 @@
+/* line_io.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "line_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef ACE_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ACE_USE_ZSTD
+#include <zstd.h>
+#endif
+
+// Buffer size - lines are accumulated until we have at least this much.
+//
+static const size_t bufferSize = 65536;
+
+// Input block size.
+//
+static const size_t blockSize = 262144;
+
+// Maximum number of iovec elements per writev call.
+//
+static const int maxIov = IOV_MAX;
+
+//==============================================================================
+// Decoders
+//==============================================================================
+// Base decoder class - manages the compressed input.
+//
+class LineReader::Decoder
+{
+public:
+   explicit Decoder (const int fd, const char* initial, const size_t size);
+   virtual ~Decoder ();
+
+   // Decodes up to size bytes into out. Returns the number of bytes decoded,
+   // 0 at the end of the data or -1 if the data is invalid or truncated.
+   //
+   ssize_t decode (char* out, const size_t size);
+
+   static Decoder* create (const Compressions compression, const int fd,
+                           const char* initial, const size_t size);
+
+protected:
+   // Decodes from input into out, updating inputPos and produced.
+   // Returns false on error.
+   //
+   virtual bool step (char* out, const size_t size, size_t& produced) = 0;
+
+   std::vector<char> input;
+   size_t inputPos;
+   size_t inputLen;
+   bool complete;        // set when at the end of a gzip member or zstd frame
+
+private:
+   void fill ();
+
+   int fd;
+   bool inputEnd;
+};
+
+//------------------------------------------------------------------------------
+//
+LineReader::Decoder::Decoder (const int fdIn, const char* initial, const size_t size)
+{
+   this->fd = fdIn;
+   this->input.resize (size > blockSize ? size : blockSize);
+   memcpy (this->input.data(), initial, size);
+   this->inputPos = 0;
+   this->inputLen = size;
+   this->inputEnd = false;
+   this->complete = false;
+}
+
+//------------------------------------------------------------------------------
+//
+LineReader::Decoder::~Decoder () { }
+
+//------------------------------------------------------------------------------
+//
+void LineReader::Decoder::fill ()
+{
+   ssize_t n;
+   do {
+      n = ::read (this->fd, this->input.data(), this->input.size());
+   } while ((n < 0) && (errno == EINTR));
+
+   this->inputPos = 0;
+   this->inputLen = n > 0 ? n : 0;
+   this->inputEnd = (n <= 0);
+}
+
+//------------------------------------------------------------------------------
+//
+ssize_t LineReader::Decoder::decode (char* out, const size_t size)
+{
+   size_t produced = 0;
+   while (produced == 0) {
+      if ((this->inputPos >= this->inputLen) && !this->inputEnd) {
+         this->fill ();
+      }
+
+      // Note: we call step even when there is no more input, as the
+      // decoder may still hold data from the previous call.
+      //
+      if (!this->step (out, size, produced)) return -1;
+
+      if ((produced == 0) && (this->inputPos >= this->inputLen) && this->inputEnd) {
+         // No more input - if not at the end of a member/frame then the
+         // data has been truncated.
+         //
+         return this->complete ? 0 : -1;
+      }
+   }
+
+   return produced;
+}
+
+#ifdef ACE_USE_ZLIB
+//------------------------------------------------------------------------------
+// gzip decoder. Concatenated gzip members are decoded as a single stream,
+// as per gunzip.
+//
+class GzipDecoder : public LineReader::Decoder
+{
+public:
+   explicit GzipDecoder (const int fd, const char* initial, const size_t size);
+   ~GzipDecoder ();
+   bool isOkay () const;
+
+protected:
+   bool step (char* out, const size_t size, size_t& produced);   // override
+
+private:
+   z_stream zs;
+   bool okay;
+};
+
+//------------------------------------------------------------------------------
+//
+GzipDecoder::GzipDecoder (const int fd, const char* initial, const size_t size) :
+   LineReader::Decoder (fd, initial, size)
+{
+   memset (&this->zs, 0, sizeof (this->zs));
+   this->okay = inflateInit2 (&this->zs, 16 + MAX_WBITS) == Z_OK;   // gzip only
+}
+
+//------------------------------------------------------------------------------
+//
+GzipDecoder::~GzipDecoder ()
+{
+   if (this->okay) inflateEnd (&this->zs);
+}
+
+//------------------------------------------------------------------------------
+//
+bool GzipDecoder::isOkay () const
+{
+   return this->okay;
+}
+
+//------------------------------------------------------------------------------
+//
+bool GzipDecoder::step (char* out, const size_t size, size_t& produced)
+{
+   this->zs.next_in = reinterpret_cast<Bytef*> (this->input.data() + this->inputPos);
+   this->zs.avail_in = this->inputLen - this->inputPos;
+   this->zs.next_out = reinterpret_cast<Bytef*> (out);
+   this->zs.avail_out = size;
+
+   const int status = inflate (&this->zs, Z_NO_FLUSH);
+
+   this->inputPos = this->inputLen - this->zs.avail_in;
+   produced = size - this->zs.avail_out;
+
+   switch (status) {
+      case Z_STREAM_END:
+         // Ready for the next member, if any.
+         //
+         this->complete = true;
+         inflateReset (&this->zs);
+         return true;
+
+      case Z_OK:
+         this->complete = false;
+         return true;
+
+      case Z_BUF_ERROR:   // no progress possible - need more input
+         return true;
+
+      default:
+         return false;
+   }
+}
+#endif  // ACE_USE_ZLIB
+
+#ifdef ACE_USE_ZSTD
+//------------------------------------------------------------------------------
+// zstd decoder. Multiple frames are decoded as a single stream.
+//
+class ZstdDecoder : public LineReader::Decoder
+{
+public:
+   explicit ZstdDecoder (const int fd, const char* initial, const size_t size);
+   ~ZstdDecoder ();
+   bool isOkay () const;
+
+protected:
+   bool step (char* out, const size_t size, size_t& produced);   // override
+
+private:
+   ZSTD_DCtx* dctx;
+};
+
+//------------------------------------------------------------------------------
+//
+ZstdDecoder::ZstdDecoder (const int fd, const char* initial, const size_t size) :
+   LineReader::Decoder (fd, initial, size)
+{
+   this->dctx = ZSTD_createDCtx ();
+}
+
+//------------------------------------------------------------------------------
+//
+ZstdDecoder::~ZstdDecoder ()
+{
+   if (this->dctx) ZSTD_freeDCtx (this->dctx);
+}
+
+//------------------------------------------------------------------------------
+//
+bool ZstdDecoder::isOkay () const
+{
+   return this->dctx != NULL;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ZstdDecoder::step (char* out, const size_t size, size_t& produced)
+{
+   ZSTD_inBuffer in = { this->input.data() + this->inputPos, this->inputLen - this->inputPos, 0 };
+   ZSTD_outBuffer to = { out, size, 0 };
+
+   const size_t status = ZSTD_decompressStream (this->dctx, &to, &in);
+   if (ZSTD_isError (status)) return false;
+
+   this->inputPos += in.pos;
+   produced = to.pos;
+
+   // A zero status indicates the end of a frame, and all data flushed.
+   //
+   if (status == 0) {
+      this->complete = true;
+   } else if ((in.pos > 0) || (to.pos > 0)) {
+      this->complete = false;
+   }
+   return true;
+}
+#endif  // ACE_USE_ZSTD
+
+//------------------------------------------------------------------------------
+// static
+LineReader::Decoder* LineReader::Decoder::create (const Compressions compression,
+                                                  const int fd,
+                                                  const char* initial,
+                                                  const size_t size)
+{
+   switch (compression) {
+#ifdef ACE_USE_ZLIB
+      case cpGzip:
+         {
+            GzipDecoder* decoder = new GzipDecoder (fd, initial, size);
+            if (decoder->isOkay ()) return decoder;
+            delete decoder;
+         }
+         break;
+#endif
+#ifdef ACE_USE_ZSTD
+      case cpZstd:
+         {
+            ZstdDecoder* decoder = new ZstdDecoder (fd, initial, size);
+            if (decoder->isOkay ()) return decoder;
+            delete decoder;
+         }
+         break;
+#endif
+      default:
+         break;
+   }
+
+   return NULL;
+}
+
+//==============================================================================
+// LineReader
+//==============================================================================
+//
+LineReader::LineReader ()
+{
+   this->fd = -1;
+   this->ownsFd = false;
+   this->endOfFile = true;
+   this->failed = false;
+   this->compression = cpNone;
+   this->decoder = NULL;
+   this->blockPos = 0;
+   this->blockLen = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+LineReader::~LineReader ()
+{
+   this->close ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineReader::open (const std::string& filename)
+{
+   this->close ();
+
+   this->fd = ::open (filename.c_str(), O_RDONLY);
+   this->ownsFd = true;
+   this->endOfFile = (this->fd < 0);
+   if (this->fd < 0) return false;
+
+   return this->detect ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineReader::openStandardInput ()
+{
+   this->close ();
+
+   this->fd = STDIN_FILENO;
+   this->ownsFd = false;
+   this->endOfFile = false;
+
+   return this->detect ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineReader::isOpen () const
+{
+   return this->fd >= 0;
+}
+
+//------------------------------------------------------------------------------
+//
+Compressions LineReader::getCompression () const
+{
+   return this->compression;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineReader::hasFailed () const
+{
+   return this->failed;
+}
+
+//------------------------------------------------------------------------------
+//
+void LineReader::close ()
+{
+   if ((this->fd >= 0) && this->ownsFd) {
+      ::close (this->fd);
+   }
+   delete this->decoder;
+   this->decoder = NULL;
+   this->compression = cpNone;
+   this->fd = -1;
+   this->ownsFd = false;
+   this->endOfFile = true;
+   this->failed = false;
+   this->blockPos = 0;
+   this->blockLen = 0;
+   this->partial.clear();
+}
+
+//------------------------------------------------------------------------------
+// Reads the first few bytes and checks for a compressed file magic number.
+// If found, the bytes read so far are handed over to the decoder.
+//
+bool LineReader::detect ()
+{
+   static const unsigned char gzipMagic [] = { 0x1F, 0x8B };
+   static const unsigned char zstdMagic [] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+   this->failed = false;
+   this->compression = cpNone;
+
+   if (this->block.size() < blockSize) {
+      this->block.resize (blockSize);
+   }
+
+   // Allow for short reads, e.g. from a pipe.
+   //
+   size_t len = 0;
+   while (len < sizeof (zstdMagic)) {
+      const ssize_t n = ::read (this->fd, &this->block [len], blockSize - len);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         this->failed = true;
+      }
+      if (n <= 0) break;
+      len += n;
+   }
+
+   this->blockPos = 0;
+   this->blockLen = len;
+   this->endOfFile = (len == 0);
+
+   const unsigned char* start = reinterpret_cast<const unsigned char*> (&this->block [0]);
+   if ((len >= sizeof (gzipMagic)) && (memcmp (start, gzipMagic, sizeof (gzipMagic)) == 0)) {
+      this->compression = cpGzip;
+   } else if ((len >= sizeof (zstdMagic)) && (memcmp (start, zstdMagic, sizeof (zstdMagic)) == 0)) {
+      this->compression = cpZstd;
+   }
+
+   if (this->compression == cpNone) return true;
+
+   this->decoder = Decoder::create (this->compression, this->fd, &this->block [0], len);
+   this->blockLen = 0;
+   if (!this->decoder) {
+      this->close ();
+      errno = ENOTSUP;
+      return false;
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineReader::readBlock ()
+{
+   if (this->endOfFile) return false;
+
+   if (this->block.size() < blockSize) {
+      this->block.resize (blockSize);
+   }
+
+   ssize_t n;
+   if (this->decoder) {
+      n = this->decoder->decode (&this->block [0], blockSize);
+   } else {
+      do {
+         n = ::read (this->fd, &this->block [0], blockSize);
+      } while ((n < 0) && (errno == EINTR));
+   }
+
+   if (n <= 0) {
+      // End of file, or a read error - either way there is no more data.
+      //
+      this->failed = (n < 0);
+      this->endOfFile = true;
+      this->blockPos = 0;
+      this->blockLen = 0;
+      return false;
+   }
+
+   this->blockPos = 0;
+   this->blockLen = n;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+int LineReader::getLines (std::list<std::string>& lines, const int maxLines)
+{
+   if (this->fd < 0) return 0;
+
+   int result = 0;
+   while (result < maxLines) {
+      if ((this->blockPos >= this->blockLen) && !this->readBlock ()) {
+         // No more data - flush out any unterminated last line.
+         //
+         if (this->partial.length() > 0) {
+            lines.push_back (this->partial);
+            this->partial.clear();
+            result++;
+         }
+         break;
+      }
+
+      const char* start = &this->block [this->blockPos];
+      const size_t available = this->blockLen - this->blockPos;
+      const char* eol = static_cast<const char*> (memchr (start, '\n', available));
+
+      if (eol) {
+         const size_t len = eol - start;
+         if (this->partial.length() > 0) {
+            this->partial.append (start, len);
+            lines.push_back (this->partial);
+            this->partial.clear();
+         } else {
+            lines.push_back (std::string (start, len));
+         }
+         this->blockPos += len + 1;
+         result++;
+
+      } else {
+         // Line continues into the next block.
+         //
+         this->partial.append (start, available);
+         this->blockPos = this->blockLen;
+      }
+   }
+
+   return result;
+}
+
+//==============================================================================
+// Encoders
+//==============================================================================
+// Base encoder class.
+//
+class LineWriter::Encoder
+{
+public:
+   explicit Encoder ();
+   virtual ~Encoder ();
+
+   // Compresses size bytes of data, appending the compressed data to out.
+   // When finish is set, the compressed stream is completed.
+   // Returns false on error.
+   //
+   virtual bool encode (const char* data, const size_t size,
+                        const bool finish, std::string& out) = 0;
+
+   static Encoder* create (const Compressions compression);
+
+protected:
+   std::vector<char> chunk;    // compressed output work area
+};
+
+//------------------------------------------------------------------------------
+//
+LineWriter::Encoder::Encoder ()
+{
+   this->chunk.resize (bufferSize);
+}
+
+//------------------------------------------------------------------------------
+//
+LineWriter::Encoder::~Encoder () { }
+
+#ifdef ACE_USE_ZLIB
+//------------------------------------------------------------------------------
+// gzip encoder. Note: zlib itself is single threaded.
+//
+class GzipEncoder : public LineWriter::Encoder
+{
+public:
+   explicit GzipEncoder ();
+   ~GzipEncoder ();
+   bool isOkay () const;
+
+   bool encode (const char* data, const size_t size,
+                const bool finish, std::string& out);     // override
+
+private:
+   z_stream zs;
+   bool okay;
+};
+
+//------------------------------------------------------------------------------
+//
+GzipEncoder::GzipEncoder () : LineWriter::Encoder ()
+{
+   memset (&this->zs, 0, sizeof (this->zs));
+   this->okay = deflateInit2 (&this->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+//------------------------------------------------------------------------------
+//
+GzipEncoder::~GzipEncoder ()
+{
+   if (this->okay) deflateEnd (&this->zs);
+}
+
+//------------------------------------------------------------------------------
+//
+bool GzipEncoder::isOkay () const
+{
+   return this->okay;
+}
+
+//------------------------------------------------------------------------------
+//
+bool GzipEncoder::encode (const char* data, const size_t size,
+                          const bool finish, std::string& out)
+{
+   this->zs.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (data));
+   this->zs.avail_in = size;
+
+   while (true) {
+      this->zs.next_out = reinterpret_cast<Bytef*> (this->chunk.data());
+      this->zs.avail_out = this->chunk.size();
+
+      const int status = deflate (&this->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+      if ((status != Z_OK) && (status != Z_STREAM_END) && (status != Z_BUF_ERROR)) {
+         return false;
+      }
+
+      out.append (this->chunk.data(), this->chunk.size() - this->zs.avail_out);
+
+      if (finish) {
+         if (status == Z_STREAM_END) break;
+      } else {
+         if ((this->zs.avail_in == 0) && (this->zs.avail_out > 0)) break;
+      }
+   }
+
+   return true;
+}
+#endif  // ACE_USE_ZLIB
+
+#ifdef ACE_USE_ZSTD
+//------------------------------------------------------------------------------
+// zstd encoder. Uses one worker thread per processor when the library has
+// been built with multi-threading support, otherwise single threaded.
+//
+class ZstdEncoder : public LineWriter::Encoder
+{
+public:
+   explicit ZstdEncoder ();
+   ~ZstdEncoder ();
+   bool isOkay () const;
+
+   bool encode (const char* data, const size_t size,
+                const bool finish, std::string& out);     // override
+
+private:
+   ZSTD_CCtx* cctx;
+};
+
+//------------------------------------------------------------------------------
+//
+ZstdEncoder::ZstdEncoder () : LineWriter::Encoder ()
+{
+   this->cctx = ZSTD_createCCtx ();
+   if (this->cctx) {
+      ZSTD_CCtx_setParameter (this->cctx, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+
+      // This fails harmlessly if the library is single threaded.
+      //
+      const long processors = sysconf (_SC_NPROCESSORS_ONLN);
+      if (processors > 1) {
+         ZSTD_CCtx_setParameter (this->cctx, ZSTD_c_nbWorkers, int (processors));
+      }
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+ZstdEncoder::~ZstdEncoder ()
+{
+   if (this->cctx) ZSTD_freeCCtx (this->cctx);
+}
+
+//------------------------------------------------------------------------------
+//
+bool ZstdEncoder::isOkay () const
+{
+   return this->cctx != NULL;
+}
+
+//------------------------------------------------------------------------------
+//
+bool ZstdEncoder::encode (const char* data, const size_t size,
+                          const bool finish, std::string& out)
+{
+   ZSTD_inBuffer in = { data, size, 0 };
+
+   while (true) {
+      ZSTD_outBuffer to = { this->chunk.data(), this->chunk.size(), 0 };
+
+      const size_t remaining = ZSTD_compressStream2 (this->cctx, &to, &in,
+                                                     finish ? ZSTD_e_end : ZSTD_e_continue);
+      if (ZSTD_isError (remaining)) return false;
+
+      out.append (this->chunk.data(), to.pos);
+
+      if (finish) {
+         if (remaining == 0) break;
+      } else {
+         if (in.pos >= in.size) break;
+      }
+   }
+
+   return true;
+}
+#endif  // ACE_USE_ZSTD
+
+//------------------------------------------------------------------------------
+// static
+LineWriter::Encoder* LineWriter::Encoder::create (const Compressions compression)
+{
+   switch (compression) {
+#ifdef ACE_USE_ZLIB
+      case cpGzip:
+         {
+            GzipEncoder* encoder = new GzipEncoder ();
+            if (encoder->isOkay ()) return encoder;
+            delete encoder;
+         }
+         break;
+#endif
+#ifdef ACE_USE_ZSTD
+      case cpZstd:
+         {
+            ZstdEncoder* encoder = new ZstdEncoder ();
+            if (encoder->isOkay ()) return encoder;
+            delete encoder;
+         }
+         break;
+#endif
+      default:
+         break;
+   }
+
+   return NULL;
+}
+
+//==============================================================================
+// LineWriter
+//==============================================================================
+//
+LineWriter::LineWriter ()
+{
+   this->fd = -1;
+   this->ownsFd = false;
+   this->encoder = NULL;
+   this->forSave = false;
+   this->failed = false;
+   this->written = 0;
+   this->spillFd = -1;
+   this->spilled = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+LineWriter::~LineWriter ()
+{
+   this->close ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::open (const std::string& filename, const Compressions compression)
+{
+   this->close ();
+
+   // Check the compression first - we don't want to truncate the file
+   // if we can't write it.
+   //
+   if (!this->setup (compression)) return false;
+
+   this->fd = ::open (filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   this->ownsFd = true;
+   if (this->fd >= 0) {
+      this->buffer.reserve (bufferSize);
+   } else {
+      delete this->encoder;
+      this->encoder = NULL;
+   }
+
+   return this->fd >= 0;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::openStandardOutput (const Compressions compression)
+{
+   this->close ();
+
+   if (!this->setup (compression)) return false;
+
+   this->fd = STDOUT_FILENO;
+   this->ownsFd = false;
+   this->buffer.reserve (bufferSize);
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::openForSave (const std::string& filenameIn,
+                              const Compressions compression,
+                              const off_t size, const bool replace)
+{
+   this->close ();
+   this->recoveryName.clear();
+
+   if (!this->setup (compression)) return false;
+
+   struct stat info;
+   const bool exists = (lstat (filenameIn.c_str(), &info) == 0);
+
+   // Don't replace symbolic links or hard linked files - that would break
+   // the link. Such files are overwritten in place.
+   //
+   const bool canReplace = replace && exists &&
+                           S_ISREG (info.st_mode) && (info.st_nlink == 1);
+
+   if (canReplace) {
+      // The temporary file must be in the same directory (file system) so
+      // that the rename is atomic.
+      //
+      const size_t slash = filenameIn.rfind ('/');
+      const size_t start = (slash == std::string::npos) ? 0 : slash + 1;
+      const std::string pattern = filenameIn.substr (0, start) + "." +
+                                  filenameIn.substr (start) + ".XXXXXX";
+
+      std::vector<char> work (pattern.begin(), pattern.end());
+      work.push_back ('\0');
+      this->fd = mkstemp (work.data());
+      if (this->fd >= 0) {
+         this->tempName = work.data();
+
+         // Retain the original's permissions and, if we can, ownership.
+         //
+         fchmod (this->fd, info.st_mode & 07777);
+         if (fchown (this->fd, info.st_uid, info.st_gid) != 0) {
+            // Not permitted - not an error.
+         }
+      }
+   } else {
+      // Note: no O_TRUNC - the file is truncated to size on close.
+      //
+      this->fd = ::open (filenameIn.c_str(), O_WRONLY | O_CREAT, 0666);
+   }
+
+   if (this->fd < 0) {
+      delete this->encoder;
+      this->encoder = NULL;
+      return false;
+   }
+
+   this->ownsFd = true;
+   this->forSave = true;
+   this->failed = false;
+   this->written = 0;
+   this->filename = filenameIn;
+   this->buffer.reserve (bufferSize);
+
+   // The compressed size is not known until close, so when overwriting in
+   // place the compressed data is spilled to a temporary file until then.
+   // A replacement is written directly, as the target is not touched until
+   // the rename.
+   //
+   bool ready;
+   if (!this->encoder) {
+      ready = this->reserve (size);
+   } else if (this->tempName.empty()) {
+      ready = this->openSpill ();
+   } else {
+      ready = true;
+   }
+
+   if (!ready) {
+      const int error = errno;
+
+      ::close (this->fd);
+      if (!this->tempName.empty()) {
+         unlink (this->tempName.c_str());
+      } else if (!exists) {
+         unlink (this->filename.c_str());
+      }
+
+      this->fd = -1;
+      this->ownsFd = false;
+      this->forSave = false;
+      this->tempName.clear();
+      errno = error;
+      return false;
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& LineWriter::getRecoveryName () const
+{
+   return this->recoveryName;
+}
+
+//------------------------------------------------------------------------------
+// Opens an anonymous temporary file, in TMPDIR or /tmp, that holds the
+// compressed data until the size is known.
+//
+bool LineWriter::openSpill ()
+{
+   const char* dir = getenv ("TMPDIR");
+   if (!dir || !dir [0]) dir = "/tmp";
+
+   this->spilled = 0;
+   this->spillFd = ::open (dir, O_TMPFILE | O_RDWR, 0600);
+   if (this->spillFd >= 0) return true;
+
+   // O_TMPFILE not supported by the file system - use a named file that is
+   // immediately unlinked instead.
+   //
+   const std::string pattern = std::string (dir) + "/ace.spill_XXXXXX";
+   std::vector<char> work (pattern.begin(), pattern.end());
+   work.push_back ('\0');
+   this->spillFd = mkstemp (work.data());
+   if (this->spillFd < 0) return false;
+
+   unlink (work.data());
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// Copies the spilled compressed data to the file, having first reserved the
+// space for it, and closes the spill file.
+//
+bool LineWriter::copySpill ()
+{
+   bool result = this->reserve (this->spilled);
+
+   off_t offset = 0;
+   while (result && (offset < this->spilled)) {
+      const ssize_t n = sendfile (this->fd, this->spillFd, &offset,
+                                  this->spilled - offset);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         this->failed = true;
+         result = false;
+      } else if (n == 0) {
+         errno = EIO;   // spill file shorter than expected
+         this->failed = true;
+         result = false;
+      } else {
+         this->written += n;
+      }
+   }
+
+   const int error = errno;
+   ::close (this->spillFd);
+   this->spillFd = -1;
+   this->spilled = 0;
+   errno = error;
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// Allocates the disk space up front, so that we find out now if there is not
+// enough space rather than part way through. KEEP_SIZE means the file size,
+// and hence any existing content, is unaffected.
+//
+bool LineWriter::reserve (const off_t size)
+{
+   if (size <= 0) return true;
+
+   if (fallocate (this->fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0) return true;
+
+   if ((errno == ENOSPC) || (errno == EDQUOT) || (errno == EFBIG)) return false;
+
+   if (errno != EOPNOTSUPP) return true;   // e.g. not a regular file
+
+   // The file system does not support fallocate - check the free space
+   // instead. Any existing blocks are re-used when overwriting in place.
+   //
+   struct stat info;
+   struct statvfs fs;
+   if ((fstat (this->fd, &info) != 0) || (fstatvfs (this->fd, &fs) != 0)) {
+      return true;   // can't tell - just go for it
+   }
+
+   const off_t needed = size - info.st_size;
+   const off_t available = off_t (fs.f_bavail) * off_t (fs.f_frsize);
+   if ((needed > 0) && (available < needed)) {
+      errno = ENOSPC;
+      return false;
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::setup (const Compressions compression)
+{
+   this->failed = false;
+   this->written = 0;
+
+   if (compression == cpNone) return true;
+
+   this->encoder = Encoder::create (compression);
+   if (!this->encoder) {
+      errno = ENOTSUP;
+      return false;
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+// static
+Compressions LineWriter::compressionOf (const std::string& filename)
+{
+   static const std::string gzipSuffix = ".gz";
+   static const std::string zstdSuffix = ".zst";
+
+   const size_t len = filename.length();
+
+   if ((len > gzipSuffix.length()) &&
+       (filename.compare (len - gzipSuffix.length(), gzipSuffix.length(), gzipSuffix) == 0)) {
+      return cpGzip;
+   }
+
+   if ((len > zstdSuffix.length()) &&
+       (filename.compare (len - zstdSuffix.length(), zstdSuffix.length(), zstdSuffix) == 0)) {
+      return cpZstd;
+   }
+
+   return cpNone;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::isOpen () const
+{
+   return this->fd >= 0;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::putLine (const std::string& line)
+{
+   if (this->fd < 0) return false;
+
+   bool result = true;
+   if (this->buffer.length() + line.length() >= bufferSize) {
+      result = this->flush ();
+   }
+
+   this->buffer.append (line);
+   this->buffer.push_back ('\n');   // Linux specific
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::putLines (const std::vector<const std::string*>& lines)
+{
+   if (this->fd < 0) return false;
+
+   size_t total = 0;
+   for (size_t j = 0; j < lines.size(); j++) {
+      total += lines [j]->length() + 1;
+   }
+
+   // Small batches are just copied into the buffer. When compressing
+   // everything goes via the buffer.
+   //
+   if (this->encoder) {
+      bool result = true;
+      for (size_t j = 0; j < lines.size(); j++) {
+         this->buffer.append (*lines [j]);
+         this->buffer.push_back ('\n');
+         if (this->buffer.length() >= bufferSize) {
+            result = this->flush () && result;
+         }
+      }
+      return result;
+   }
+
+   if (this->buffer.length() + total < bufferSize) {
+      for (size_t j = 0; j < lines.size(); j++) {
+         this->buffer.append (*lines [j]);
+         this->buffer.push_back ('\n');
+      }
+      return true;
+   }
+
+   // Otherwise gather write: any buffered data followed by each line and
+   // its terminating \n, without copying the line data.
+   //
+   static const char newLine = '\n';
+
+   std::vector<struct iovec> iov;
+   iov.reserve (2 * lines.size() + 1);
+
+   if (this->buffer.length() > 0) {
+      struct iovec item;
+      item.iov_base = const_cast<char*> (this->buffer.data());
+      item.iov_len = this->buffer.length();
+      iov.push_back (item);
+   }
+
+   for (size_t j = 0; j < lines.size(); j++) {
+      struct iovec item;
+      if (lines [j]->length() > 0) {
+         item.iov_base = const_cast<char*> (lines [j]->data());
+         item.iov_len = lines [j]->length();
+         iov.push_back (item);
+      }
+      item.iov_base = const_cast<char*> (&newLine);
+      item.iov_len = 1;
+      iov.push_back (item);
+   }
+
+   bool result = true;
+   size_t first = 0;
+   while (first < iov.size()) {
+      const int count = int (iov.size() - first) < maxIov ? int (iov.size() - first) : maxIov;
+      const ssize_t n = ::writev (this->fd, &iov [first], count);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         this->failed = true;
+         result = false;
+         break;
+      }
+      this->written += n;
+
+      // Skip over what has been written, allowing for a partial write.
+      //
+      size_t done = n;
+      while ((first < iov.size()) && (done >= iov [first].iov_len)) {
+         done -= iov [first].iov_len;
+         first++;
+      }
+      if (done > 0) {
+         iov [first].iov_base = static_cast<char*> (iov [first].iov_base) + done;
+         iov [first].iov_len -= done;
+      }
+   }
+
+   this->buffer.clear();
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::flush ()
+{
+   return this->flushBuffer (false);
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::close ()
+{
+   if (this->fd < 0) return true;   // nothing to do
+
+   if (this->forSave) return this->closeForSave ();
+
+   bool result = this->flushBuffer (true);
+   if (this->ownsFd) {
+      if (::close (this->fd) != 0) result = false;
+   }
+   this->fd = -1;
+   this->ownsFd = false;
+   delete this->encoder;
+   this->encoder = NULL;
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::closeForSave ()
+{
+   bool result = this->flushBuffer (true);
+
+   // We now know the compressed size - reserve the space before writing
+   // anything to the file.
+   //
+   if (this->spillFd >= 0) {
+      if (result) {
+         result = this->copySpill ();
+      } else {
+         ::close (this->spillFd);
+         this->spillFd = -1;
+      }
+   }
+   result = result && !this->failed;
+
+   // Discard any old data beyond the end of the new data.
+   //
+   struct stat info;
+   if (result && (fstat (this->fd, &info) == 0) &&
+       S_ISREG (info.st_mode) && (info.st_size > this->written)) {
+      result = (ftruncate (this->fd, this->written) == 0);
+   }
+
+   // One sync for the lot. EINVAL/EROFS indicate a special file (e.g. a
+   // device) for which syncing is not applicable.
+   //
+   if (result && (fdatasync (this->fd) != 0) &&
+       (errno != EINVAL) && (errno != EROFS)) {
+      result = false;
+   }
+
+   int error = errno;
+   if (::close (this->fd) != 0) {
+      error = errno;
+      result = false;
+   }
+
+   if (!this->tempName.empty()) {
+      if (!result) {
+         unlink (this->tempName.c_str());
+
+      } else if (rename (this->tempName.c_str(), this->filename.c_str()) == 0) {
+         // Make the rename itself durable.
+         //
+         const size_t slash = this->filename.rfind ('/');
+         const std::string dir = (slash == std::string::npos)
+                               ? "." : this->filename.substr (0, slash + 1);
+         const int dirFd = ::open (dir.c_str(), O_RDONLY | O_DIRECTORY);
+         if (dirFd >= 0) {
+            fsync (dirFd);
+            ::close (dirFd);
+         }
+
+      } else {
+         // The data is all there - keep it rather than writing it again.
+         //
+         error = errno;
+         result = false;
+         this->recoveryName = this->tempName;
+      }
+   }
+
+   this->fd = -1;
+   this->ownsFd = false;
+   this->forSave = false;
+   this->tempName.clear();
+   delete this->encoder;
+   this->encoder = NULL;
+
+   errno = error;
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::flushBuffer (const bool finish)
+{
+   if (this->fd < 0) return false;
+
+   bool result;
+   if (this->spillFd >= 0) {
+      // Deferred until close.
+      //
+      std::string compressed;
+      result = this->encoder->encode (this->buffer.data(), this->buffer.length(),
+                                      finish, compressed);
+      result = this->writeSpill (compressed.data(), compressed.length()) && result;
+   } else if (this->encoder) {
+      std::string compressed;
+      result = this->encoder->encode (this->buffer.data(), this->buffer.length(),
+                                      finish, compressed);
+      result = this->writeAll (compressed.data(), compressed.length()) && result;
+   } else {
+      result = this->writeAll (this->buffer.data(), this->buffer.length());
+   }
+   this->buffer.clear();
+   return result;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::writeAll (const char* data, const size_t size)
+{
+   size_t done = 0;
+   while (done < size) {
+      const ssize_t n = ::write (this->fd, data + done, size - done);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         this->failed = true;
+         return false;
+      }
+      done += n;
+      this->written += n;
+   }
+
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+bool LineWriter::writeSpill (const char* data, const size_t size)
+{
+   size_t done = 0;
+   while (done < size) {
+      const ssize_t n = ::write (this->spillFd, data + done, size - done);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         this->failed = true;
+         return false;
+      }
+      done += n;
+      this->spilled += n;
+   }
+
+   return true;
+}
+
+// end
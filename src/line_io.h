@@ -0,0 +1,178 @@
+/* line_io.h
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef ACE_LINE_IO_H
+#define ACE_LINE_IO_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------
+// Supported file compression formats. Compressed input is recognised by its
+// magic number, i.e. irrespective of the file name. Support for each format
+// is optional, see ACE_USE_ZLIB and ACE_USE_ZSTD in the Makefile.
+//
+enum Compressions {
+   cpNone,
+   cpGzip,
+   cpZstd
+};
+
+//------------------------------------------------------------------------------
+// Buffered line input. The file is read in large blocks and split into lines
+// using memchr, rather than using std::getline line by line. Any data beyond
+// the lines requested is held over for the next getLines call.
+// Compressed input is decoded on the fly, block by block.
+//
+class LineReader
+{
+public:
+   explicit LineReader ();
+   ~LineReader ();
+
+   bool open (const std::string& filename);
+   bool openStandardInput ();
+   bool isOpen () const;
+   void close ();
+
+   // Open fails, with errno set to ENOTSUP, if the input is compressed using
+   // a format that is not supported by this build.
+   //
+   Compressions getCompression () const;
+
+   // Indicates a read error or invalid/truncated compressed data.
+   //
+   bool hasFailed () const;
+
+   // Reads up to maxLines lines, appending them to lines. The \n is removed.
+   // A last line with a missing \n is treated as a complete line.
+   // Returns the number of lines read. A value less than maxLines indicates
+   // the end of the file (or a read error) has been reached.
+   //
+   int getLines (std::list<std::string>& lines, const int maxLines);
+
+   class Decoder;   // internal - defined in line_io.cpp
+
+private:
+   // Don't allow a LineReader object to be copied.
+   //
+   LineReader (const LineReader&);
+   LineReader& operator= (const LineReader&);
+
+   bool detect ();       // sets up compression and decoder
+   bool readBlock ();    // false when no more data
+
+   int fd;
+   bool ownsFd;          // i.e. not standard input
+   bool endOfFile;
+   bool failed;
+   Compressions compression;
+   Decoder* decoder;     // only when compressed
+   std::vector<char> block;
+   size_t blockPos;      // next unused character in block
+   size_t blockLen;      // number of valid characters in block
+   std::string partial;  // incomplete line spanning blocks
+};
+
+//------------------------------------------------------------------------------
+// Buffered line output. Lines are accumulated in a local buffer and written
+// out in large blocks rather than line by line. Larger batches of lines are
+// written using a gather write (writev), which avoids copying the line data.
+// The buffer is flushed when full, on flush and on close.
+// When compressing, the buffer is compressed as and when it is flushed.
+//
+class LineWriter
+{
+public:
+   explicit LineWriter ();
+   ~LineWriter ();
+
+   // Open fails, with errno set to ENOTSUP, if the compression format is
+   // not supported by this build.
+   //
+   bool open (const std::string& filename, const Compressions compression = cpNone);
+   bool openStandardOutput (const Compressions compression = cpNone);
+
+   // Alternative to open used to save files. The disk space for size bytes
+   // (the uncompressed size) is allocated up front, so a lack of space is
+   // reported before the file is modified. Compressed data is spilled to an
+   // anonymous temporary file, and only copied to the file on close, when
+   // the actual size is known.
+   // By default the file is overwritten in place, which preserves the inode,
+   // and truncated to the new size on close. This is not crash safe: a crash
+   // or write error part way through leaves the new data followed by the
+   // tail of the old. When replace is set, and the file is an existing
+   // regular file that is not hard linked, the data is written to a
+   // temporary file in the same directory, which is renamed over the
+   // original by close, so the file is either the old or the new contents.
+   // In both cases close syncs the data to disk, once.
+   //
+   bool openForSave (const std::string& filename, const Compressions compression,
+                     const off_t size, const bool replace);
+
+   // If close fails in replace mode after all the data has been written,
+   // e.g. the rename fails, the temporary file is kept and its name is
+   // returned here, otherwise returns an empty string.
+   //
+   const std::string& getRecoveryName () const;
+
+   bool isOpen () const;
+
+   // Returns the compression implied by the filename extension, i.e. cpGzip
+   // for ".gz" and cpZstd for ".zst", otherwise cpNone.
+   //
+   static Compressions compressionOf (const std::string& filename);
+
+   // Each line is terminated with a \n.
+   //
+   bool putLine (const std::string& line);
+   bool putLines (const std::vector<const std::string*>& lines);
+
+   bool flush ();
+   bool close ();   // implicit flush
+
+   class Encoder;   // internal - defined in line_io.cpp
+
+private:
+   // Don't allow a LineWriter object to be copied.
+   //
+   LineWriter (const LineWriter&);
+   LineWriter& operator= (const LineWriter&);
+
+   bool setup (const Compressions compression);
+   bool reserve (const off_t size);
+   bool flushBuffer (const bool finish);
+   bool writeAll (const char* data, const size_t size);
+   bool closeForSave ();
+   bool openSpill ();
+   bool writeSpill (const char* data, const size_t size);
+   bool copySpill ();
+
+   int fd;
+   bool ownsFd;          // i.e. not standard output
+   std::string buffer;
+   Encoder* encoder;     // only when compressing
+
+   // Safe save state.
+   //
+   bool forSave;
+   bool failed;          // any write failed
+   off_t written;        // bytes written so far
+   int spillFd;          // deferred compressed output, in place only
+   off_t spilled;        // bytes written to the spill file
+   std::string filename;
+   std::string tempName; // replace mode only
+   std::string recoveryName;
+};
+
+#endif // ACE_LINE_IO_H
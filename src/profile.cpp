@@ -0,0 +1,177 @@
+/* profile.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "profile.h"
+#include <algorithm>
+#include <stdio.h>
+
+#include "command_parser.h"
+
+//------------------------------------------------------------------------------
+//
+Profile::Profile ()
+{
+   this->reset ();
+}
+
+//------------------------------------------------------------------------------
+//
+Profile::~Profile () { }
+
+//------------------------------------------------------------------------------
+// private static
+void Profile::clear (Counts& counts)
+{
+   counts.calls = 0;
+   counts.successes = 0;
+   counts.failures = 0;
+   counts.nanoSeconds = 0;
+}
+
+//------------------------------------------------------------------------------
+// private static
+void Profile::add (Counts& counts, const bool status, const long long nanoSeconds)
+{
+   counts.calls++;
+   if (status) {
+      counts.successes++;
+   } else {
+      counts.failures++;
+   }
+   counts.nanoSeconds += nanoSeconds;
+}
+
+//------------------------------------------------------------------------------
+//
+void Profile::reset ()
+{
+   for (int j = 0; j < BasicCommands::NUMBER_OF_KINDS; j++) {
+      Profile::clear (this->kinds [j]);
+   }
+   Profile::clear (this->total);
+   this->siteIndex.clear ();
+   this->sites.clear ();
+}
+
+//------------------------------------------------------------------------------
+//
+void Profile::record (const BasicCommands* command, const bool status,
+                      const long long nanoSeconds)
+{
+   const BasicCommands::Kinds kind = command->getKind ();
+   Profile::add (this->kinds [kind], status, nanoSeconds);
+   Profile::add (this->total, status, nanoSeconds);
+
+   SiteIndex::iterator found = this->siteIndex.find (command);
+   if ((found == this->siteIndex.end ()) ||
+       (this->sites [found->second].kind != kind) ||
+       (this->sites [found->second].column != command->getColumn ()))
+   {
+      Site site;
+      site.kind = kind;
+      site.column = command->getColumn ();
+      site.label = CommandParser::source (command);
+      switch (command->getModifier ()) {
+         case AbstractCommands::NoFail: site.label += '?';  break;
+         case AbstractCommands::Invert: site.label += '\\'; break;
+         default: break;
+      }
+      Profile::clear (site.counts);
+
+      this->siteIndex [command] = this->sites.size ();
+      this->sites.push_back (site);
+      found = this->siteIndex.find (command);
+   }
+
+   Profile::add (this->sites [found->second].counts, status, nanoSeconds);
+}
+
+//------------------------------------------------------------------------------
+// private static
+void Profile::heading (const char* title, std::ostream& stream)
+{
+   char item [120];
+   snprintf (item, sizeof (item), "%-24s %10s %10s %10s %12s %10s",
+             title, "Calls", "Succeeded", "Failed", "Total ms", "ns/call");
+   stream << item << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// private static
+void Profile::line (const std::string& name, const Counts& counts,
+                    std::ostream& stream)
+{
+   const double perCall = counts.calls > 0 ? double (counts.nanoSeconds) / counts.calls : 0.0;
+
+   char item [120];
+   snprintf (item, sizeof (item), "%-24s %10lld %10lld %10lld %12.3f %10.1f",
+             name.c_str (), counts.calls, counts.successes, counts.failures,
+             counts.nanoSeconds / 1.0e6, perCall);
+   stream << item << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//
+void Profile::summary (std::ostream& stream) const
+{
+   char item [80];
+   snprintf (item, sizeof (item), "%lld commands, %lld failed, %.3f ms",
+             this->total.calls, this->total.failures,
+             this->total.nanoSeconds / 1.0e6);
+   stream << item;
+}
+
+//------------------------------------------------------------------------------
+//
+void Profile::report (std::ostream& stream) const
+{
+   stream << "Profile: ";
+   this->summary (stream);
+   stream << std::endl;
+
+   if (this->total.calls == 0) return;
+
+   // Sort kinds by total time, most expensive first, i.e. by ascending
+   // negated time. Ties are left in kind order.
+   //
+   typedef std::pair <long long, size_t> Order;
+   std::vector<Order> kindOrder;
+   for (int j = 0; j < BasicCommands::NUMBER_OF_KINDS; j++) {
+      if (this->kinds [j].calls > 0) {
+         kindOrder.push_back (Order (-this->kinds [j].nanoSeconds, j));
+      }
+   }
+   std::sort (kindOrder.begin (), kindOrder.end ());
+
+   Profile::heading ("Command", stream);
+   for (size_t j = 0; j < kindOrder.size (); j++) {
+      const BasicCommands::Kinds kind = BasicCommands::Kinds (kindOrder [j].second);
+      Profile::line (CommandParser::name (kind), this->kinds [kind], stream);
+   }
+
+   // Likewise sites.
+   //
+   std::vector<Order> siteOrder;
+   for (size_t j = 0; j < this->sites.size (); j++) {
+      siteOrder.push_back (Order (-this->sites [j].counts.nanoSeconds, j));
+   }
+   std::sort (siteOrder.begin (), siteOrder.end ());
+
+   stream << std::endl;
+   Profile::heading ("Column: Command", stream);
+   for (size_t j = 0; j < siteOrder.size (); j++) {
+      const Site& site = this->sites [siteOrder [j].second];
+      Profile::line (std::to_string (site.column) + ": " + site.label,
+                     site.counts, stream);
+   }
+}
+
+// end
@@ -0,0 +1,87 @@
+/* profile.h
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef ACE_PROFILE_H
+#define ACE_PROFILE_H
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "commands.h"
+
+// Per command execution profile, i.e. the number of calls, successes and
+// failures, and the accumulated execution time, both per command kind and
+// per command site (a command at a given column of a compiled command line).
+// A session only has a profile while profiling is on (%U or --profile), so
+// when off, the only overhead is a null pointer check per command.
+//
+class Profile
+{
+public:
+   explicit Profile ();
+   ~Profile ();
+
+   // Records one execution of the command. The status is that returned by
+   // the command, i.e. after any modifier has been applied.
+   //
+   void record (const BasicCommands* command, const bool status,
+                const long long nanoSeconds);
+
+   // Outputs the profile, kinds and sites each sorted by total time.
+   //
+   void report (std::ostream& stream) const;
+
+   // A one line summary, for %V.
+   //
+   void summary (std::ostream& stream) const;
+
+   void reset ();
+
+private:
+   // Don't allow copying.
+   //
+   explicit Profile (const Profile&);
+   Profile& operator= (const Profile&);
+
+   struct Counts {
+      long long calls;
+      long long successes;
+      long long failures;
+      long long nanoSeconds;
+   };
+
+   // The label is made when the site is first executed. Commands are keyed
+   // by address, so the kind and column are also checked, in case a deleted
+   // command line's address has been reused.
+   //
+   struct Site {
+      BasicCommands::Kinds kind;
+      int column;
+      std::string label;
+      Counts counts;
+   };
+
+   static void clear (Counts& counts);
+   static void add (Counts& counts, const bool status, const long long nanoSeconds);
+   static void heading (const char* title, std::ostream& stream);
+   static void line (const std::string& name, const Counts& counts,
+                     std::ostream& stream);
+
+   Counts kinds [BasicCommands::NUMBER_OF_KINDS];
+   Counts total;
+
+   typedef std::unordered_map <const BasicCommands*, size_t> SiteIndex;
+   SiteIndex siteIndex;
+   std::vector<Site> sites;
+};
+
+#endif // ACE_PROFILE_H
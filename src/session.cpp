@@ -0,0 +1,579 @@
+/* session.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "session.h"
+#include <atomic>
+#include <iostream>
+
+#include "command_parser.h"
+#include "profile.h"
+#include "trace_log.h"
+
+// The last allocated definitions version - shared by all sessions so that
+// versions from different sessions never match.
+//
+static std::atomic<int> definitionsCount (0);
+
+static const std::string modeImages [3] = { "Monitor", "Full", "Quiet" };
+
+//==============================================================================
+//
+//==============================================================================
+//
+Session::Session ()
+{
+   this->getLineFunc = nullptr;
+   this->reportStream = &std::cerr;
+   this->targetFilename = "";
+
+   this->interruptRequest = false;
+   this->executeInProgress = false;
+
+   this->closeRequest   = false;
+   this->abandonRequest = false;
+   this->exitCode       = 0;
+
+   this->macroX = "";
+   this->macroY = "";
+   this->macroZ = "";
+   this->definitionsVersion = 0;
+   this->newDefinitions ();
+   this->optimize = true;
+   this->profile = nullptr;
+   this->traceLog = nullptr;
+   this->parserState = new ParserState ();
+
+   this->lastModify   = "";
+   this->lastSearch   = "";
+   this->lastFilename = "";
+
+   this->cursorMark = '^';
+   this->smartQuote = ':';
+
+   this->mode        = Monitor;
+   this->promptOn    = true;
+   this->lineNumbers = false;
+
+   this->searchMax    = 100000;
+   this->repeatMax    = 50000;
+   this->repeatMaxSet = false;
+   this->terminalMax  = 160;
+}
+
+//------------------------------------------------------------------------------
+//
+Session::~Session ()
+{
+   delete this->profile;
+   delete this->traceLog;
+   delete this->parserState;
+}
+
+//------------------------------------------------------------------------------
+// private
+void Session::newDefinitions ()
+{
+   this->definitionsVersion = ++definitionsCount;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setGetLineFunction (GetLineFuncPtr getLineFuncIn)
+{
+   this->getLineFunc = getLineFuncIn;
+}
+
+//------------------------------------------------------------------------------
+//
+Session::GetLineFuncPtr Session::getGetLineFunc () const
+{
+   return this->getLineFunc;
+}
+
+//------------------------------------------------------------------------------
+//
+std::string Session::getLine (const char* prompt) const
+{
+   if (!this->getLineFunc) {
+      this->report () << "get_line function undefined" << std::endl;
+      return "%c\n";
+   }
+
+   return (*this->getLineFunc) (prompt);
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setReport (std::ostream* stream)
+{
+   this->reportStream = stream ? stream : &std::cerr;
+}
+
+//------------------------------------------------------------------------------
+//
+std::ostream& Session::report () const
+{
+   return *this->reportStream;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::show (const int detail, std::ostream& stream) const
+{
+   // Include version ??
+   // Just do the lot ??
+
+   if (detail >= 0) {
+      stream << "Macro X = \"" << this->macroX << '"' << std::endl;
+      stream << "Macro Y = \"" << this->macroY << '"' << std::endl;
+      stream << "Macro Z = \"" << this->macroZ << '"' << std::endl;
+   }
+
+   if (detail >= 1) {
+      stream << "Last Search: \"" << this->lastSearch   << '"' << std::endl;
+      stream << "Last Modify: \"" << this->lastModify   << '"' << std::endl;
+      stream << "Last File:   \"" << this->lastFilename << '"' << std::endl;
+   }
+
+   if (detail >= 2) {
+      stream << "Monitor Mode: " << modeImages [this->mode] << std::endl;
+      stream << "Line Numbers: " << (this->lineNumbers ? "On" : "Off") << std::endl;
+      stream << "Prompting: "    << (this->promptOn ? "On" : "Off") << std::endl;
+      stream << "Cursor: '"      << this->cursorMark << "'" << std::endl;
+      stream << "Smart Quote: '" << this->smartQuote << "'" << std::endl;
+      stream << "Optimize: "     << (this->optimize ? "On" : "Off") << std::endl;
+      stream << "Profiling: ";
+      if (this->profile) {
+         stream << "On, ";
+         this->profile->summary (stream);
+      } else {
+         stream << "Off";
+      }
+      stream << std::endl;
+      stream << "Tracing: ";
+      if (this->traceLog) {
+         stream << "On, " << this->traceLog->getSteps () << " steps to '"
+                << this->traceLog->getFilename () << "'";
+      } else {
+         stream << "Off";
+      }
+      stream << std::endl;
+   }
+
+   if (detail >= 3) {
+      stream << "Repeat Limit: " << this->repeatMax << std::endl;
+      stream << "Search Limit: " << this->searchMax << std::endl;
+      stream << "Terminal Max: " << this->terminalMax << std::endl;
+   }
+
+   if (detail >= 4) {
+      CommandParser::showRewrites (*this->parserState, stream);
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setTargetFilename (const std::string& filename)
+{
+   this->targetFilename = filename;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getTargetFilename () const
+{
+   return this->targetFilename;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setExecutionInProgress()
+{
+   this->executeInProgress = true;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::clearExecutionInProgress()
+{
+   this->executeInProgress = false;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setInterruptRequest ()
+{
+   if (this->executeInProgress) {
+      this->report () << "\nSIGINT received - quiting current command sequence.\n";
+   }
+   this->interruptRequest = true;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::clearInterruptRequest ()
+{
+   this->interruptRequest = false;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getInterruptRequest () const
+{
+   return this->interruptRequest;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::requestClose (const int exitCodeIn)
+{
+   this->closeRequest = true;
+   this->exitCode = exitCodeIn;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getCloseRequested () const
+{
+   return this->closeRequest;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::requestAbandon (const int exitCodeIn)
+{
+   this->closeRequest = true;    // implicit
+   this->abandonRequest = true;
+   this->exitCode = exitCodeIn;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getAbandonRequested () const
+{
+   return this->abandonRequest;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setExitCode (const int exitCodeIn)
+{
+   this->exitCode = exitCodeIn;
+}
+
+//------------------------------------------------------------------------------
+//
+int Session::getExitCode () const
+{
+   return this->exitCode;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setMacroX (const std::string& text)
+{
+   this->macroX = text;
+   this->newDefinitions ();
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getMacroX () const
+{
+   return this->macroX;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setMacroY (const std::string& text)
+{
+   this->macroY = text;
+   this->newDefinitions ();
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getMacroY () const
+{
+   return this->macroY;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setMacroZ (const std::string& text)
+{
+   this->macroZ = text;
+   this->newDefinitions ();
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getMacroZ () const
+{
+   return this->macroZ;
+}
+
+//------------------------------------------------------------------------------
+//
+int Session::getDefinitionsVersion () const
+{
+   return this->definitionsVersion;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setOptimize (const bool isOn)
+{
+   if (this->optimize != isOn) {
+      this->optimize = isOn;
+      this->newDefinitions ();
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getOptimize () const
+{
+   return this->optimize;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setProfiling (const bool isOn)
+{
+   if (isOn && !this->profile) {
+      this->profile = new Profile ();
+   } else if (!isOn && this->profile) {
+      delete this->profile;
+      this->profile = nullptr;
+   }
+}
+
+//------------------------------------------------------------------------------
+//
+Profile* Session::getProfile () const
+{
+   return this->profile;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::openTrace (const std::string& filename)
+{
+   this->closeTrace ();
+
+   TraceLog* log = new TraceLog ();
+   if (!log->open (filename)) {
+      delete log;
+      return false;
+   }
+
+   this->traceLog = log;
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::closeTrace ()
+{
+   delete this->traceLog;   // closes the log
+   this->traceLog = nullptr;
+}
+
+//------------------------------------------------------------------------------
+//
+TraceLog* Session::getTraceLog () const
+{
+   return this->traceLog;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::isInstrumented () const
+{
+   return (this->profile != nullptr) || (this->traceLog != nullptr);
+}
+
+//------------------------------------------------------------------------------
+//
+ParserState& Session::getParserState () const
+{
+   return *this->parserState;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setMode (const Modes modeIn)
+{
+   this->mode = modeIn;
+}
+
+//------------------------------------------------------------------------------
+//
+Session::Modes Session::getMode () const
+{
+   return this->mode;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setShowLineNumbers (const bool showLineNumbersIn)
+{
+   this->lineNumbers = showLineNumbersIn;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getShowLineNumbers () const
+{
+   return this->lineNumbers;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setPromptOn (const bool isOn)
+{
+   this->promptOn = isOn;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::getPromptOn () const
+{
+   return this->promptOn;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setSearchMax (const int max)
+{
+   this->searchMax = (max >= 1) ? max : 1;
+}
+
+//------------------------------------------------------------------------------
+//
+int Session::getSearchMax () const
+{
+   return this->searchMax;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setRepeatMax (const int max)
+{
+   this->repeatMax = (max >= 1) ? max : 1;
+   this->repeatMaxSet = true;
+}
+
+//------------------------------------------------------------------------------
+//
+int Session::getRepeatMax () const
+{
+   return this->repeatMax;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::isRepeatMaxSet () const
+{
+   return this->repeatMaxSet;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setCursorMark (const char mark)
+{
+   this->cursorMark = mark;
+}
+
+//------------------------------------------------------------------------------
+//
+char Session::getCursorMark () const
+{
+   return this->cursorMark;
+}
+
+//------------------------------------------------------------------------------
+//
+bool Session::setSmartQuote (const char quote)
+{
+   if (CommandParser::isQuote(quote)) {
+      this->smartQuote = quote;
+      this->newDefinitions ();
+      return true;
+   }
+   return false;
+}
+
+//------------------------------------------------------------------------------
+//
+char Session::getSmartQuote () const
+{
+   return this->smartQuote;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setTerminalMax (const int max)
+{
+   this->terminalMax = (max >= 32) ? max : 32;
+}
+
+//------------------------------------------------------------------------------
+//
+int Session::getTerminalMax () const
+{
+   return this->terminalMax;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setLastSearch (const std::string_view text)
+{
+   this->lastSearch = text;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getLastSearch () const
+{
+   return this->lastSearch;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setLastModify (const std::string_view text)
+{
+   this->lastModify = text;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getLastModify () const
+{
+   return this->lastModify;
+}
+
+//------------------------------------------------------------------------------
+//
+void Session::setLastFilename (const std::string& filename)
+{
+   this->lastFilename = filename;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& Session::getLastFilename () const
+{
+   return this->lastFilename;
+}
+
+// end
@@ -0,0 +1,206 @@
+/* session.h
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef ACE_SESSION_H
+#define ACE_SESSION_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+class ParserState;
+class Profile;
+class TraceLog;
+
+// The state of an edit session, i.e. the macros, last search/modify text,
+// modes, limits and close/interrupt requests. Each DataBuffer is associated
+// with a session, and commands executed on the buffer use that session.
+// Global provides access to the current session, which by default is the one
+// process wide session, so separate sessions are only needed when more than
+// one edit session is run in the one process. A session, including its parser
+// state, is used by one thread at a time; different sessions share no state.
+//
+class Session
+{
+public:
+   enum Modes {
+      Monitor = 0,
+      Full,
+      Quiet
+   };
+
+   typedef std::string (*GetLineFuncPtr) (const char* prompt);
+
+   explicit Session ();
+   ~Session ();
+
+   void setGetLineFunction (GetLineFuncPtr getLineFunc);
+   GetLineFuncPtr getGetLineFunc () const;
+
+   std::string getLine (const char* prompt) const;
+
+   // Reports, i.e. messages and printed lines, are written to the report
+   // stream, by default std::cerr. nullptr reverts to std::cerr. The stream
+   // must outlive its use by the session.
+   //
+   void setReport (std::ostream* stream);
+   std::ostream& report () const;
+
+   void show (const int detail, std::ostream& stream) const;
+
+   void setTargetFilename (const std::string& filename);
+   const std::string& getTargetFilename () const;
+
+   void setExecutionInProgress();
+   void clearExecutionInProgress();
+
+   void setInterruptRequest ();
+   void clearInterruptRequest ();
+   bool getInterruptRequest () const;
+
+   void requestClose (const int exitCode);
+   bool getCloseRequested () const;
+
+   void requestAbandon (const int exitCode);
+   bool getAbandonRequested () const;
+
+   void setExitCode (const int exitCode);
+   int  getExitCode () const;
+
+   void setMacroX (const std::string& text);
+   const std::string& getMacroX () const;
+
+   void setMacroY (const std::string& text);
+   const std::string& getMacroY () const;
+
+   void setMacroZ (const std::string& text);
+   const std::string& getMacroZ () const;
+
+   // Changes whenever a macro, the smart quote or the optimize setting
+   // changes, i.e. whenever a command line might parse differently.
+   // Versions are unique across all sessions.
+   //
+   int getDefinitionsVersion () const;
+
+   // When on (the default), adjacent commands are fused when parsed. When
+   // off, commands are executed as written, i.e. the reference behaviour.
+   //
+   void setOptimize (const bool isOn);
+   bool getOptimize () const;
+
+   // Profiling (%U, --profile) records the execution count and time of each
+   // command. The profile is nullptr when profiling is off. Turning profiling
+   // off discards the profile.
+   //
+   void setProfiling (const bool isOn);
+   Profile* getProfile () const;
+
+   // Tracing (--trace) writes a record of each command executed to the file,
+   // see TraceLog. The trace log is nullptr when tracing is off. Returns false,
+   // after reporting the error, if the file cannot be opened.
+   //
+   bool openTrace (const std::string& filename);
+   void closeTrace ();
+   TraceLog* getTraceLog () const;
+
+   // True when profiling or tracing, i.e. when each command executed must be
+   // timed and recorded individually.
+   //
+   bool isInstrumented () const;
+
+   // The command parser's state for this session, i.e. its prepared macros,
+   // parsed command line cache and optimizer rewrites log.
+   //
+   ParserState& getParserState () const;
+
+   void setMode (const Modes mode);
+   Modes getMode () const;
+
+   void setShowLineNumbers (const bool showLineNumbers);
+   bool getShowLineNumbers () const;
+
+   void setPromptOn (const bool isOn);
+   bool getPromptOn () const;
+
+   void setSearchMax (const int max);
+   int getSearchMax () const;
+
+   // The repeat limit for * commands. Unless the limit has been explicitly set
+   // (%R), X* and (...)* loops are not limited, and stop when they fail or no
+   // longer make progress, except for I*, I-*, B*, B-*, N* and N-*, which can
+   // do neither, and so are limited by the default.
+   //
+   void setRepeatMax (const int max);
+   int getRepeatMax () const;
+   bool isRepeatMaxSet () const;
+
+   void setCursorMark (const char mark);
+   char getCursorMark () const;
+
+   bool setSmartQuote (const char quote);
+   char getSmartQuote () const;
+
+   void setTerminalMax (const int max);
+   int getTerminalMax () const;
+
+   void setLastSearch (const std::string_view text);
+   const std::string& getLastSearch () const;
+
+   void setLastModify (const std::string_view text);
+   const std::string& getLastModify () const;
+
+   void setLastFilename (const std::string& filename);
+   const std::string& getLastFilename () const;
+
+private:
+   // Don't allow copying.
+   //
+   explicit Session (const Session&);
+   Session& operator= (const Session&);
+
+   void newDefinitions ();
+
+   GetLineFuncPtr getLineFunc;
+   std::ostream* reportStream;
+   std::string targetFilename;
+
+   bool interruptRequest;
+   bool executeInProgress;
+   bool closeRequest;
+   bool abandonRequest;
+   int exitCode;
+
+   std::string macroX;
+   std::string macroY;
+   std::string macroZ;
+   int definitionsVersion;
+   bool optimize;
+   Profile* profile;
+   TraceLog* traceLog;
+   ParserState* parserState;
+
+   std::string lastModify;
+   std::string lastSearch;
+   std::string lastFilename;
+
+   Modes mode;
+   bool promptOn;
+   bool lineNumbers;
+   char cursorMark;
+   char smartQuote;
+
+   int searchMax;
+   int repeatMax;
+   bool repeatMaxSet;
+   int terminalMax;
+};
+
+#endif // ACE_SESSION_H
@@ -0,0 +1,263 @@
+/* trace_log.cpp
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#include "trace_log.h"
+#include <fcntl.h>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "command_parser.h"
+
+// Number of steps held before being written out, about 200K bytes.
+//
+static const size_t ringSize = 4096;
+
+//------------------------------------------------------------------------------
+//
+TraceLog::TraceLog ()
+{
+   this->fd = -1;
+   this->steps = 0;
+   this->used = 0;
+}
+
+//------------------------------------------------------------------------------
+//
+TraceLog::~TraceLog ()
+{
+   this->close ();
+}
+
+//------------------------------------------------------------------------------
+//
+bool TraceLog::open (const std::string& filenameIn)
+{
+   this->close ();
+
+   this->fd = ::open (filenameIn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (this->fd < 0) {
+      std::cerr << "Cannot open trace file '" << filenameIn << "' : ";
+      perror ("");
+      return false;
+   }
+
+   this->filename = filenameIn;
+   this->opened = Clock::now ();
+   this->steps = 0;
+   this->ring.resize (ringSize);
+   this->used = 0;
+   this->siteIndex.clear ();
+   this->sites.clear ();
+   this->pendingSites.clear ();
+   return true;
+}
+
+//------------------------------------------------------------------------------
+//
+void TraceLog::close ()
+{
+   if (this->fd < 0) return;
+
+   this->flush ();
+   if (this->fd >= 0) ::close (this->fd);
+   this->fd = -1;
+}
+
+//------------------------------------------------------------------------------
+//
+bool TraceLog::isOpen () const
+{
+   return this->fd >= 0;
+}
+
+//------------------------------------------------------------------------------
+//
+const std::string& TraceLog::getFilename () const
+{
+   return this->filename;
+}
+
+//------------------------------------------------------------------------------
+//
+long long TraceLog::getSteps () const
+{
+   return this->steps;
+}
+
+//------------------------------------------------------------------------------
+//
+void TraceLog::record (const BasicCommands* command, const bool status,
+                       const Cursor& before, const Cursor& after,
+                       const Clock::time_point& start, const Clock::time_point& finish)
+{
+   if (this->fd < 0) return;
+
+   Step& step = this->ring [this->used];
+   step.time = std::chrono::duration_cast<std::chrono::nanoseconds> (start - this->opened).count ();
+   step.nanoSeconds = std::chrono::duration_cast<std::chrono::nanoseconds> (finish - start).count ();
+   step.site = this->siteOf (command);
+   step.before = before;
+   step.after = after;
+   step.status = status;
+
+   this->steps++;
+   if (++this->used >= this->ring.size ()) {
+      this->flush ();
+   }
+}
+
+//------------------------------------------------------------------------------
+// private
+int TraceLog::siteOf (const BasicCommands* command)
+{
+   const BasicCommands::Kinds kind = command->getKind ();
+
+   SiteIndex::const_iterator found = this->siteIndex.find (command);
+   if ((found != this->siteIndex.end ()) &&
+       (this->sites [found->second].kind == kind) &&
+       (this->sites [found->second].column == command->getColumn ()))
+   {
+      return found->second;
+   }
+
+   Site site;
+   site.kind = kind;
+   site.column = command->getColumn ();
+
+   const int result = this->sites.size ();
+   this->siteIndex [command] = result;
+   this->sites.push_back (site);
+
+   std::string source = CommandParser::source (command);
+   switch (command->getModifier ()) {
+      case AbstractCommands::NoFail: source += '?';  break;
+      case AbstractCommands::Invert: source += '\\'; break;
+      default: break;
+   }
+
+   char item [80];
+   snprintf (item, sizeof (item), "{\"site\": %d, \"column\": %d, \"command\": ",
+             result, site.column);
+   this->pendingSites += item;
+   this->pendingSites += TraceLog::jsonString (command->image ());
+   this->pendingSites += ", \"source\": ";
+   this->pendingSites += TraceLog::jsonString (source);
+   this->pendingSites += "}\n";
+
+   return result;
+}
+
+//------------------------------------------------------------------------------
+// private
+// Formats the site lines and steps recorded since the last flush, and writes
+// them out in one go. On error, the error is reported and tracing stops.
+//
+void TraceLog::flush ()
+{
+   std::string text;
+   text.swap (this->pendingSites);
+   text.reserve (text.length () + 120 * this->used);
+
+   const long long first = this->steps - this->used;
+   for (size_t j = 0; j < this->used; j++) {
+      const Step& step = this->ring [j];
+      char item [200];
+      snprintf (item, sizeof (item),
+                "{\"step\": %lld, \"t_ns\": %lld, \"site\": %d, "
+                "\"before\": [%d, %d], \"after\": [%d, %d], "
+                "\"ok\": %s, \"ns\": %lld}\n",
+                first + (long long) j, step.time, step.site,
+                step.before.line, step.before.col,
+                step.after.line, step.after.col,
+                step.status ? "true" : "false", step.nanoSeconds);
+      text += item;
+   }
+   this->used = 0;
+
+   if (text.empty ()) return;
+
+   if (write (this->fd, text.data (), text.length ()) != ssize_t (text.length ())) {
+      std::cerr << "Cannot write trace file '" << this->filename << "' : ";
+      perror ("");
+      ::close (this->fd);
+      this->fd = -1;
+   }
+}
+
+//------------------------------------------------------------------------------
+// Returns the length of the valid UTF-8 multi-byte sequence at text [j], or 0
+// if there is none, i.e. overlong forms, surrogates and code points beyond
+// U+10FFFF are all rejected.
+//
+static size_t utf8Length (const std::string& text, const size_t j)
+{
+   const unsigned char c = text [j];
+   size_t length;
+   unsigned char low = 0x80;
+   unsigned char high = 0xBF;
+
+   if ((c >= 0xC2) && (c <= 0xDF)) {
+      length = 2;
+   } else if ((c >= 0xE0) && (c <= 0xEF)) {
+      length = 3;
+      if (c == 0xE0) low = 0xA0;
+      if (c == 0xED) high = 0x9F;
+   } else if ((c >= 0xF0) && (c <= 0xF4)) {
+      length = 4;
+      if (c == 0xF0) low = 0x90;
+      if (c == 0xF4) high = 0x8F;
+   } else {
+      return 0;
+   }
+
+   if (j + length > text.length()) return 0;
+
+   for (size_t k = 1; k < length; k++) {
+      const unsigned char d = text [j + k];
+      if ((d < low) || (d > high)) return 0;
+      low = 0x80;   // only the second byte has a restricted range
+      high = 0xBF;
+   }
+   return length;
+}
+
+//------------------------------------------------------------------------------
+// static
+std::string TraceLog::jsonString (const std::string& text)
+{
+   std::string result = "\"";
+   size_t j = 0;
+   while (j < text.length()) {
+      const unsigned char c = text [j];
+      if ((c == '"') || (c == '\\')) {
+         result += '\\';
+         result += c;
+      } else if ((c >= 0x20) && (c < 0x7F)) {
+         result += c;
+      } else {
+         const size_t length = (c >= 0x80) ? utf8Length (text, j) : 0;
+         if (length > 0) {
+            result.append (text, j, length);
+            j += length;
+            continue;
+         }
+         char item [8];
+         snprintf (item, sizeof (item), "\\u%04x", c);
+         result += item;
+      }
+      j++;
+   }
+   result += '"';
+   return result;
+}
+
+// end
@@ -0,0 +1,113 @@
+/* trace_log.h
+ *
+ * This file is part of the ACE command line editor.
+ *
+ * SPDX-FileCopyrightText: 1980-2026  Andrew C. Starritt
+ * SPDX-License-Identifier: GPL-3.0-only
+ *
+ * Contact details:
+ * andrew.starritt@gmail.com
+ */
+
+#ifndef ACE_TRACE_LOG_H
+#define ACE_TRACE_LOG_H
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "commands.h"
+
+// Execution trace (--trace), i.e. one record per executed basic command: the
+// start time, the cursor line and column before and after, the status and
+// the elapsed time, written to a file as JSON lines for offline analysis.
+//
+// Steps are held as plain records in a fixed size ring, and are only
+// formatted and written out, in one block, when the ring is full or the log
+// is closed. Each command is described once, by a site line (as per image
+// and source) written before the first step that refers to it, and steps
+// refer to the site by number. A session's log is only used by the thread
+// executing that session, so the ring needs no locking.
+//
+class TraceLog
+{
+public:
+   typedef std::chrono::steady_clock Clock;
+
+   struct Cursor {
+      int line;
+      int col;
+   };
+
+   explicit TraceLog ();
+   ~TraceLog ();   // closes the log
+
+   // Creates/truncates the file. Returns false, after reporting the error,
+   // if the file cannot be opened.
+   //
+   bool open (const std::string& filename);
+
+   // Writes out any remaining steps and closes the file.
+   //
+   void close ();
+
+   bool isOpen () const;
+   const std::string& getFilename () const;
+
+   // Records one execution of the command. The status is that returned by
+   // the command, i.e. after any modifier has been applied.
+   //
+   void record (const BasicCommands* command, const bool status,
+                const Cursor& before, const Cursor& after,
+                const Clock::time_point& start, const Clock::time_point& finish);
+
+   long long getSteps () const;
+
+   // Returns the text as a quoted JSON string. Valid UTF-8 sequences are kept
+   // as is; control characters and any bytes that are not part of a valid
+   // UTF-8 sequence are escaped as \u00XX, so the result is always valid JSON.
+   // Also used for the --stats lines.
+   //
+   static std::string jsonString (const std::string& text);
+
+private:
+   // Don't allow copying.
+   //
+   explicit TraceLog (const TraceLog&);
+   TraceLog& operator= (const TraceLog&);
+
+   struct Step {
+      long long time;          // ns since the log was opened
+      long long nanoSeconds;
+      int site;
+      Cursor before;
+      Cursor after;
+      bool status;
+   };
+
+   // As for Profile, commands are keyed by address, so the kind and column
+   // are also checked in case a deleted command line's address is reused.
+   //
+   struct Site {
+      BasicCommands::Kinds kind;
+      int column;
+   };
+
+   int siteOf (const BasicCommands* command);
+   void flush ();
+
+   std::string filename;
+   int fd;
+   Clock::time_point opened;
+   long long steps;
+
+   std::vector<Step> ring;
+   size_t used;
+
+   typedef std::unordered_map <const BasicCommands*, int> SiteIndex;
+   SiteIndex siteIndex;
+   std::vector<Site> sites;
+   std::string pendingSites;   // site lines not yet written
+};
+
+#endif // ACE_TRACE_LOG_H